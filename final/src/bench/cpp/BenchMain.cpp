@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "SoundRecordingUtilities.h"
+
+/**
+ * Host benchmarks for the engine. Runs the named suites, or all of them, and writes the results
+ * as JSON to stdout or to the file given with --output, for tools which track performance
+ * across builds:
+ *
+ *     wavemaker-bench [--output results.json] [suite...]
+ */
+
+namespace {
+
+struct BenchSuite {
+    const char *name;
+    void (*run)(BenchResults &results);
+};
+
+const BenchSuite kSuites[] = {
+        { "recordingCopy", benchRecordingCopy },
+        { "mixer", benchMixer },
+        { "callbackStats", benchCallbackStats },
+        { "resampler", benchResampler },
+        { "engineCallback", benchEngineCallback },
+        { "denormals", benchDenormals },
+};
+
+std::string escapeJson(const std::string &value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+BenchResult::BenchResult(const char *suite, const std::string &name) {
+    mJson = "{";
+    add("suite", std::string(suite));
+    add("name", name);
+}
+
+BenchResult &BenchResult::add(const char *key, int64_t value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%" PRId64, value);
+    return addField(key, text);
+}
+
+BenchResult &BenchResult::add(const char *key, double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.6g", value);
+    return addField(key, text);
+}
+
+BenchResult &BenchResult::add(const char *key, const std::string &value) {
+    return addField(key, "\"" + escapeJson(value) + "\"");
+}
+
+BenchResult &BenchResult::addJson(const char *key, const std::string &value) {
+    return addField(key, value);
+}
+
+BenchResult &BenchResult::addField(const char *key, const std::string &value) {
+
+    // The closing brace is kept on the end so that the object is always complete.
+    if (mJson.back() == '}') {
+        mJson.back() = ',';
+    }
+    mJson += "\"" + escapeJson(key) + "\":" + value + "}";
+    return *this;
+}
+
+int main(int argc, char **argv) {
+
+    const char *outputPath = nullptr;
+    std::vector<const BenchSuite *> suites;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+            continue;
+        }
+        const BenchSuite *suite = nullptr;
+        for (const BenchSuite &candidate : kSuites) {
+            if (strcmp(argv[i], candidate.name) == 0) suite = &candidate;
+        }
+        if (suite == nullptr) {
+            fprintf(stderr, "Unknown suite %s. Suites are:", argv[i]);
+            for (const BenchSuite &candidate : kSuites) fprintf(stderr, " %s", candidate.name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        suites.push_back(suite);
+    }
+    if (suites.empty()) {
+        for (const BenchSuite &suite : kSuites) suites.push_back(&suite);
+    }
+
+    BenchResults results;
+    for (const BenchSuite *suite : suites) {
+        fprintf(stderr, "Running %s\n", suite->name);
+        suite->run(results);
+    }
+
+    FILE *output = (outputPath != nullptr) ? fopen(outputPath, "w") : stdout;
+    if (output == nullptr) {
+        fprintf(stderr, "Couldn't open %s\n", outputPath);
+        return 1;
+    }
+    fprintf(output, "{\"simd\":\"%s\",\"results\":[\n", getSimdImplementationName());
+    for (size_t i = 0; i < results.size(); ++i) {
+        fprintf(output, "%s%s\n", results[i].c_str(), (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(output, "]}\n");
+    if (output != stdout) fclose(output);
+    return 0;
+}
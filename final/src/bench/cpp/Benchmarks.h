@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_BENCHMARKS_H
+#define WAVEMAKER2_BENCHMARKS_H
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * One measurement, written out as a flat JSON object. Every result has the suite and name it
+ * came from, followed by whatever parameters and figures the suite adds, in the order added.
+ */
+class BenchResult {
+
+public:
+    BenchResult(const char *suite, const std::string &name);
+    BenchResult &add(const char *key, int64_t value);
+    BenchResult &add(const char *key, double value);
+    BenchResult &add(const char *key, const std::string &value);
+    // value must already be valid JSON, for example OfflineReport::toJson().
+    BenchResult &addJson(const char *key, const std::string &value);
+    const std::string &toJson() const { return mJson; };
+
+private:
+    std::string mJson;
+
+    BenchResult &addField(const char *key, const std::string &value);
+};
+
+using BenchResults = std::vector<std::string>;
+
+inline int64_t getNowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Time iteration(), calling it in batches until at least kMinBenchNanos have passed, and return
+ * the mean time per call. The first batch is a warm up and isn't counted. Calls which compile to
+ * nothing stop after kMaxBenchCalls.
+ */
+constexpr int64_t kMinBenchNanos = 200000000;
+constexpr int64_t kMaxBenchCalls = 1LL << 32;
+
+template <typename Iteration>
+double measureNanosPerCall(Iteration &&iteration) {
+
+    iteration();
+    int64_t calls = 0;
+    const int64_t start = getNowNanos();
+    int64_t elapsed = 0;
+    for (int64_t batch = 1; elapsed < kMinBenchNanos && calls < kMaxBenchCalls; batch *= 2) {
+        for (int64_t i = 0; i < batch; ++i) iteration();
+        calls += batch;
+        elapsed = getNowNanos() - start;
+    }
+    return static_cast<double>(elapsed) / calls;
+}
+
+// Suites. Each appends a result per measurement.
+void benchRecordingCopy(BenchResults &results);
+void benchMixer(BenchResults &results);
+void benchCallbackStats(BenchResults &results);
+void benchResampler(BenchResults &results);
+void benchEngineCallback(BenchResults &results);
+void benchDenormals(BenchResults &results);
+
+#endif //WAVEMAKER2_BENCHMARKS_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <vector>
+#include "Benchmarks.h"
+#include "CallbackStats.h"
+#include "Definitions.h"
+#include "OfflineBackend.h"
+#include "SoundRecordingUtilities.h"
+
+namespace {
+
+constexpr int32_t kStatsBufferFrames = 192;
+constexpr int32_t kStatsSampleRate = 48000;
+constexpr int32_t kStatsMixTracks = 8;
+
+CallbackResult silentCallback(AudioStream *, void *, void *, int32_t) {
+    return CallbackResult::Continue;
+}
+
+} // namespace
+
+void benchCallbackStats(BenchResults &results) {
+
+    // Time a stand-in for a callback's work, an 8 track mix, with and without the timer around it.
+    OfflineBackend backend;
+    StreamParameters parameters;
+    parameters.sampleRate = kStatsSampleRate;
+    parameters.channelCount = kChannelCountStereo;
+    parameters.dataCallback = silentCallback;
+    std::unique_ptr<AudioStream> stream = backend.openStream(parameters);
+
+    std::vector<float> source(kStatsBufferFrames, 0.25f);
+    std::vector<float> mix(kStatsBufferFrames);
+    auto work = [&]() {
+        fillArrayWithZeros(mix.data(), kStatsBufferFrames);
+        for (int32_t i = 0; i < kStatsMixTracks; ++i) {
+            mixArrayWithGain(source.data(), mix.data(), 0.5f, kStatsBufferFrames);
+        }
+    };
+
+    CallbackStats stats;
+    const double workNanos = measureNanosPerCall(work);
+    const double timedNanos = measureNanosPerCall([&]() {
+        ScopedCallbackTimer timer(stats, stream.get(), kStatsBufferFrames);
+        work();
+    });
+    const double timerNanos = measureNanosPerCall([&]() {
+        ScopedCallbackTimer timer(stats, stream.get(), kStatsBufferFrames);
+    });
+
+    const double budgetNanos = kStatsBufferFrames * 1e9 / kStatsSampleRate;
+    results.push_back(BenchResult("callbackStats", "overhead")
+            .add("isCompiledIn", static_cast<int64_t>(WAVEMAKER2_CALLBACK_STATS))
+            .add("bufferFrames", static_cast<int64_t>(kStatsBufferFrames))
+            .add("timerNanos", timerNanos)
+            .add("workNanos", workNanos)
+            .add("timedWorkNanos", timedNanos)
+            .add("callbackBudgetFraction", timerNanos / budgetNanos)
+            .toJson());
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thread>
+#include <vector>
+#include "Benchmarks.h"
+#include "RealtimeThread.h"
+
+namespace {
+
+constexpr int32_t kDenormalBufferFrames = 192;
+constexpr float kDenormalFeedback = 0.5f;
+
+// A feedback echo of the input, the kind of decaying recursion which ends up in denormals.
+struct FeedbackEcho {
+    float state = 0;
+
+    void process(const float *input, float *output, int32_t numFrames) {
+        for (int32_t i = 0; i < numFrames; ++i) {
+            state = input[i] + kDenormalFeedback * state;
+            output[i] = state;
+        }
+    }
+};
+
+void benchEcho(const char *signalName, float level, bool isFlushing, BenchResults &results) {
+
+    std::vector<float> input(kDenormalBufferFrames, level);
+    std::vector<float> output(kDenormalBufferFrames);
+    FeedbackEcho echo;
+    const double nanos = measureNanosPerCall([&]() {
+        echo.process(input.data(), output.data(), kDenormalBufferFrames);
+    });
+    results.push_back(BenchResult("denormals", "feedbackEcho")
+            .add("signal", std::string(signalName))
+            .add("isFlushing", static_cast<int64_t>(isFlushing))
+            .add("bufferFrames", static_cast<int64_t>(kDenormalBufferFrames))
+            .add("nanosPerFrame", nanos / kDenormalBufferFrames)
+            .toJson());
+}
+
+// A level which settles at a normal value, and one whose echo stays well below FLT_MIN.
+void benchEchoes(bool isFlushing, BenchResults &results) {
+    benchEcho("normal", 0.25f, isFlushing, results);
+    benchEcho("denormal", 1e-42f, isFlushing, results);
+}
+
+} // namespace
+
+void benchDenormals(BenchResults &results) {
+
+    // The flush mode belongs to the thread, so run on one of our own and leave the other suites
+    // with the default.
+    std::thread([&results]() {
+        benchEchoes(false, results);
+
+        // Set the thread up as the first audio callback would.
+        RealtimeThreadSetup setup;
+        setup.reset(0);
+        setup.applyOnce();
+        RealtimeThreadInfo info;
+        const bool isFlushing = setup.getInfo(info) && info.isFlushingDenormals;
+        benchEchoes(isFlushing, results);
+    }).join();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include "AudioEngine.h"
+#include "Benchmarks.h"
+#include "Definitions.h"
+#include "OfflineBackend.h"
+
+namespace {
+
+constexpr int32_t kEngineSampleRate = 48000;
+constexpr int32_t kEngineBufferSizes[] = { 64, 128, 192, 256, 512, 1024, 2048, 4096 };
+constexpr int32_t kEngineChannelCounts[] = { kChannelCountMono, kChannelCountStereo };
+constexpr int32_t kEngineTrackCount = 4;
+// Each take is recorded for about this long, then trimmed to a loop which wraps at a chosen point
+// within a callback.
+constexpr int32_t kEngineTakeFrames = kEngineSampleRate;
+constexpr int64_t kEnginePlayFrames = 4 * kEngineSampleRate;
+
+// Where the loop wraps within the callback which reaches its end: on a buffer boundary, a frame
+// in, and half way through.
+enum class LoopWrap { Aligned, OneFrameIn, Midway };
+
+const char *getLoopWrapName(LoopWrap wrap) {
+    switch (wrap) {
+        case LoopWrap::Aligned: return "aligned";
+        case LoopWrap::OneFrameIn: return "oneFrameIn";
+        case LoopWrap::Midway: return "midway";
+    }
+    return "unknown";
+}
+
+int32_t getLoopFrames(int32_t bufferFrames, LoopWrap wrap) {
+    const int32_t alignedFrames = (kEngineTakeFrames / 2 / bufferFrames) * bufferFrames;
+    switch (wrap) {
+        case LoopWrap::OneFrameIn: return alignedFrames + 1;
+        case LoopWrap::Midway: return alignedFrames + bufferFrames / 2;
+        case LoopWrap::Aligned:
+        default: return alignedFrames;
+    }
+}
+
+// Time the engine's playback and recording callbacks while looping a few tracks.
+void benchEngine(int32_t bufferFrames, int32_t channelCount, BenchResults &results) {
+
+    OfflineConfig config;
+    config.sampleRate = kEngineSampleRate;
+    config.inputFramesPerBurst = bufferFrames;
+    config.outputFramesPerBurst = bufferFrames;
+    config.outputChannelCount = channelCount;
+    auto *backend = new OfflineBackend(config);
+    backend->setInputSine(440, 0.5f);
+    AudioEngine engine { std::unique_ptr<AudioBackend>(backend) };
+    engine.setRecordingCapacity((kEngineTrackCount * kEngineTakeFrames) / kEngineSampleRate + 1);
+    engine.start();
+
+    for (int32_t i = 0; i < kEngineTrackCount; ++i) {
+        engine.setRecording(true);
+        backend->run(kEngineTakeFrames);
+        engine.setRecording(false);
+        backend->run(bufferFrames);
+    }
+    engine.setLooping(true);
+    engine.setPlaying(true);
+
+    for (LoopWrap wrap : { LoopWrap::Aligned, LoopWrap::OneFrameIn, LoopWrap::Midway }) {
+        const int32_t loopFrames = getLoopFrames(bufferFrames, wrap);
+        for (int32_t i = 0; i < engine.getTrackCount(); ++i) {
+            engine.setTrackLoopLength(i, loopFrames);
+        }
+        const OfflineReport report = backend->run(kEnginePlayFrames);
+        const double budgetNanos = bufferFrames * 1e9 / kEngineSampleRate;
+        results.push_back(BenchResult("engineCallback", "loopPlayback")
+                .add("bufferFrames", static_cast<int64_t>(bufferFrames))
+                .add("channelCount", static_cast<int64_t>(channelCount))
+                .add("tracks", static_cast<int64_t>(engine.getTrackCount()))
+                .add("loopWrap", std::string(getLoopWrapName(wrap)))
+                .add("loopFrames", static_cast<int64_t>(loopFrames))
+                .add("playbackNanosPerCallback", report.output.getMeanNanos())
+                .add("playbackCallbackBudgetFraction", report.output.getMeanNanos() / budgetNanos)
+                .addJson("report", report.toJson())
+                .toJson());
+    }
+    engine.stop();
+}
+
+} // namespace
+
+void benchEngineCallback(BenchResults &results) {
+
+    for (int32_t bufferFrames : kEngineBufferSizes) {
+        for (int32_t channelCount : kEngineChannelCounts) {
+            benchEngine(bufferFrames, channelCount, results);
+        }
+    }
+}
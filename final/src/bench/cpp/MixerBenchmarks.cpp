@@ -0,0 +1,77 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <vector>
+#include "Benchmarks.h"
+#include "PeakPyramid.h"
+#include "SampleBlockPool.h"
+#include "TrackMixer.h"
+
+namespace {
+
+constexpr int32_t kMixerSampleRate = 48000;
+constexpr int32_t kTakeFrames = 2 * kMixerSampleRate;
+constexpr int32_t kMixerTrackCounts[] = { 1, 8, 16, 32 };
+constexpr int32_t kMixerBufferSizes[] = { 192, 1024 };
+
+// Time one playback callback's worth of mixing into stereo float.
+void benchMix(int32_t trackCount, int32_t mutedCount, int32_t bufferFrames,
+              BenchResults &results) {
+
+    SampleBlockPool blockPool;
+    const int32_t blocksPerTake = (kTakeFrames * static_cast<int32_t>(sizeof(float))) /
+                                  kBlockSizeInBytes + 1 + PeakPyramid::getBlocksNeeded(kTakeFrames);
+    blockPool.reserve(trackCount * blocksPerTake);
+    TrackMixer mixer(blockPool);
+    mixer.setLooping(true);
+
+    std::vector<float> take(kTakeFrames);
+    for (int32_t i = 0; i < kTakeFrames; ++i) take[i] = 0.1f * sinf(i * 0.05f);
+    for (int32_t i = 0; i < trackCount; ++i) {
+        Track *track = mixer.prepareTake();
+        track->getRecording().write(take.data(), kTakeFrames);
+        track->setGain(0.5f);
+        mixer.addTake();
+    }
+    for (int32_t i = 0; i < mutedCount; ++i) mixer.getTrack(i)->setMuted(true);
+
+    std::vector<float> output(bufferFrames * kChannelCountStereo);
+    const double nanos = measureNanosPerCall([&]() {
+        mixer.render<kChannelCountStereo>(output.data(), bufferFrames);
+    });
+    const double budgetNanos = bufferFrames * 1e9 / kMixerSampleRate;
+    results.push_back(BenchResult("mixer", (mutedCount > 0) ? "mutedMix" : "mix")
+            .add("tracks", static_cast<int64_t>(trackCount))
+            .add("mutedTracks", static_cast<int64_t>(mutedCount))
+            .add("bufferFrames", static_cast<int64_t>(bufferFrames))
+            .add("nanosPerCallback", nanos)
+            .add("callbackBudgetFraction", nanos / budgetNanos)
+            .toJson());
+}
+
+} // namespace
+
+void benchMixer(BenchResults &results) {
+
+    for (int32_t bufferFrames : kMixerBufferSizes) {
+        for (int32_t trackCount : kMixerTrackCounts) {
+            benchMix(trackCount, 0, bufferFrames, results);
+            // Muted tracks should cost next to nothing, so this should be close to one track.
+            if (trackCount > 1) benchMix(trackCount, trackCount - 1, bufferFrames, results);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Benchmarks.h"
+#include "PeakPyramid.h"
+#include "SampleBlockPool.h"
+#include "SoundRecording.h"
+
+namespace {
+
+constexpr int32_t kRecordingSamples = 480000; // 10s @ 48kHz
+constexpr int32_t kCopyBufferSizes[] = { 64, 192, 1024, 4096 };
+
+/**
+ * The recording as it was before it copied in blocks, moving one sample and doing one atomic
+ * increment at a time. Kept as the baseline the block copies are compared against.
+ */
+class PerSampleRecording {
+
+public:
+    int32_t write(const float *sourceData, int32_t numSamples) {
+        if (mWriteIndex + numSamples > kRecordingSamples) {
+            numSamples = kRecordingSamples - mWriteIndex;
+        }
+        for (int i = 0; i < numSamples; ++i) {
+            mData[mWriteIndex++] = sourceData[i];
+        }
+        return numSamples;
+    }
+
+    int32_t read(float *targetData, int32_t numSamples) {
+        int32_t framesRead = 0;
+        while (framesRead < numSamples && mReadIndex < mWriteIndex) {
+            targetData[framesRead++] = mData[mReadIndex++];
+            if (mIsLooping && mReadIndex == mWriteIndex) mReadIndex = 0;
+        }
+        return framesRead;
+    }
+
+    void clear() { mWriteIndex = 0; };
+    void setLooping(bool isLooping) { mIsLooping = isLooping; };
+
+private:
+    std::atomic<int32_t> mWriteIndex { 0 };
+    std::atomic<int32_t> mReadIndex { 0 };
+    std::atomic<bool> mIsLooping { false };
+    std::vector<float> mData = std::vector<float>(kRecordingSamples);
+};
+
+const char *getFormatName(StorageFormat format) {
+    switch (format) {
+        case StorageFormat::I16: return "i16";
+        case StorageFormat::Packed24: return "packed24";
+        case StorageFormat::Float:
+        default: return "float";
+    }
+}
+
+// Writes a whole recording, then reads it back round the loop, bufferFrames at a time.
+template <typename Recording>
+void benchCopies(Recording &recording, const char *name, const char *format,
+                 int32_t bufferFrames, BenchResults &results) {
+
+    std::vector<float> buffer(bufferFrames, 0.5f);
+    const double writeNanos = measureNanosPerCall([&]() {
+        recording.clear();
+        for (int32_t i = 0; i < kRecordingSamples; i += bufferFrames) {
+            recording.write(buffer.data(), bufferFrames);
+        }
+    });
+    recording.setLooping(true);
+    const double readNanos = measureNanosPerCall([&]() {
+        for (int32_t i = 0; i < kRecordingSamples; i += bufferFrames) {
+            recording.read(buffer.data(), bufferFrames);
+        }
+    });
+
+    for (int operation = 0; operation < 2; ++operation) {
+        const double nanos = (operation == 0) ? writeNanos : readNanos;
+        results.push_back(BenchResult("recordingCopy", name)
+                .add("format", std::string(format))
+                .add("operation", std::string((operation == 0) ? "write" : "read"))
+                .add("bufferFrames", static_cast<int64_t>(bufferFrames))
+                .add("framesPerSecond", kRecordingSamples * 1e9 / nanos)
+                .toJson());
+    }
+}
+
+} // namespace
+
+void benchRecordingCopy(BenchResults &results) {
+
+    const StorageFormat formats[] = { StorageFormat::Float, StorageFormat::I16,
+                                      StorageFormat::Packed24 };
+    for (int32_t bufferFrames : kCopyBufferSizes) {
+        PerSampleRecording perSample;
+        benchCopies(perSample, "perSample", "float", bufferFrames, results);
+
+        for (StorageFormat format : formats) {
+            // Reserve every block the recording will need so that none are allocated while it's
+            // being timed.
+            SampleBlockPool blockPool;
+            const int64_t bytes = static_cast<int64_t>(kRecordingSamples) *
+                                  getBytesPerSample(format);
+            blockPool.reserve(static_cast<int32_t>(bytes / kBlockSizeInBytes) + 1 +
+                              PeakPyramid::getBlocksNeeded(kRecordingSamples));
+            std::unique_ptr<SoundRecording> recording = createSoundRecording(format, blockPool);
+            benchCopies(*recording, "block", getFormatName(format), bufferFrames, results);
+        }
+    }
+}
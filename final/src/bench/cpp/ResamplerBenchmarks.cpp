@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <vector>
+#include "Benchmarks.h"
+#include "Resampler.h"
+
+namespace {
+
+constexpr int32_t kResamplerBlockFrames = 192;
+
+struct RatePair {
+    int32_t inputRate;
+    int32_t outputRate;
+};
+
+// Importing CD-rate files, a device at 44.1kHz, and the large step used for downsampled views.
+constexpr RatePair kRatePairs[] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 } };
+
+const char *getQualityName(ResamplerQuality quality) {
+    switch (quality) {
+        case ResamplerQuality::Low: return "low";
+        case ResamplerQuality::Medium: return "medium";
+        case ResamplerQuality::High: return "high";
+    }
+    return "unknown";
+}
+
+// Time resampling one callback's worth of input, as the streaming input path does.
+void benchResample(RatePair rates, ResamplerQuality quality, BenchResults &results) {
+
+    Resampler resampler(rates.inputRate, rates.outputRate, quality);
+    std::vector<float> input(kResamplerBlockFrames);
+    for (int32_t i = 0; i < kResamplerBlockFrames; ++i) input[i] = 0.5f * sinf(i * 0.05f);
+    std::vector<float> output(resampler.getMaxOutputFrames(kResamplerBlockFrames));
+
+    const double nanos = measureNanosPerCall([&]() {
+        resampler.process(input.data(), kResamplerBlockFrames, output.data());
+    });
+    const double nanosPerInputFrame = nanos / kResamplerBlockFrames;
+    results.push_back(BenchResult("resampler", "stream")
+            .add("inputRate", static_cast<int64_t>(rates.inputRate))
+            .add("outputRate", static_cast<int64_t>(rates.outputRate))
+            .add("quality", std::string(getQualityName(quality)))
+            .add("tapsPerPhase", static_cast<int64_t>(resampler.getTapsPerPhase()))
+            .add("blockFrames", static_cast<int64_t>(kResamplerBlockFrames))
+            .add("nanosPerInputFrame", nanosPerInputFrame)
+            .add("realtimeFactor", 1e9 / (nanosPerInputFrame * rates.inputRate))
+            .toJson());
+}
+
+} // namespace
+
+void benchResampler(BenchResults &results) {
+
+    for (const RatePair &rates : kRatePairs) {
+        for (ResamplerQuality quality : { ResamplerQuality::Low, ResamplerQuality::Medium,
+                                          ResamplerQuality::High }) {
+            benchResample(rates, quality, results);
+        }
+    }
+}
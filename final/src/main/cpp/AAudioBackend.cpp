@@ -0,0 +1,172 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <aaudio/AAudio.h>
+#include <android/log.h>
+#include "AAudioBackend.h"
+
+namespace {
+
+class AAudioBackendStream : public AudioStream {
+
+public:
+    explicit AAudioBackendStream(const StreamParameters &parameters) : mParameters(parameters) {};
+
+    ~AAudioBackendStream() override {
+        if (mStream == nullptr) return;
+        aaudio_result_t result = AAudioStream_close(mStream);
+        if (result != AAUDIO_OK) {
+            __android_log_print(ANDROID_LOG_DEBUG, __func__, "Error closing stream %s",
+                                AAudio_convertResultToText(result));
+        }
+    }
+
+    bool requestStart() override {
+        aaudio_result_t result = AAudioStream_requestStart(mStream);
+        if (result != AAUDIO_OK) {
+            __android_log_print(ANDROID_LOG_DEBUG, __func__, "Error starting stream %s",
+                                AAudio_convertResultToText(result));
+        }
+        return result == AAUDIO_OK;
+    }
+
+    bool requestStop() override {
+        aaudio_result_t result = AAudioStream_requestStop(mStream);
+        if (result != AAUDIO_OK) {
+            __android_log_print(ANDROID_LOG_DEBUG, __func__, "Error stopping stream %s",
+                                AAudio_convertResultToText(result));
+        }
+        return result == AAUDIO_OK;
+    }
+
+    SampleFormat getFormat() const override {
+        return (AAudioStream_getFormat(mStream) == AAUDIO_FORMAT_PCM_I16) ?
+               SampleFormat::I16 : SampleFormat::Float;
+    }
+
+    int32_t getChannelCount() const override { return AAudioStream_getChannelCount(mStream); }
+    int32_t getSampleRate() const override { return AAudioStream_getSampleRate(mStream); }
+    int32_t getDeviceId() const override { return AAudioStream_getDeviceId(mStream); }
+    int32_t getFramesPerBurst() const override { return AAudioStream_getFramesPerBurst(mStream); }
+    int32_t getBufferSizeInFrames() const override {
+        return AAudioStream_getBufferSizeInFrames(mStream);
+    }
+    int32_t setBufferSizeInFrames(int32_t numFrames) override {
+        return AAudioStream_setBufferSizeInFrames(mStream, numFrames);
+    }
+    int32_t getBufferCapacityInFrames() const override {
+        return AAudioStream_getBufferCapacityInFrames(mStream);
+    }
+    int32_t getXRunCount() const override { return AAudioStream_getXRunCount(mStream); }
+
+    int32_t read(void *buffer, int32_t numFrames, int64_t timeoutNanos) override {
+        return AAudioStream_read(mStream, buffer, numFrames, timeoutNanos);
+    }
+
+    int32_t getFramesAvailable() const override {
+        return static_cast<int32_t>(AAudioStream_getFramesWritten(mStream) -
+                                    AAudioStream_getFramesRead(mStream));
+    }
+
+    const StreamParameters &getParameters() const { return mParameters; }
+    AAudioStream **getStreamAddress() { return &mStream; }
+
+private:
+    AAudioStream *mStream = nullptr;
+    StreamParameters mParameters;
+};
+
+aaudio_data_callback_result_t dataCallback(
+        AAudioStream __unused *stream,
+        void *userData,
+        void *audioData,
+        int32_t numFrames) {
+
+    auto *backendStream = static_cast<AAudioBackendStream *>(userData);
+    const StreamParameters &parameters = backendStream->getParameters();
+    CallbackResult result = parameters.dataCallback(backendStream, parameters.userData, audioData,
+                                                    numFrames);
+    return (result == CallbackResult::Continue) ?
+           AAUDIO_CALLBACK_RESULT_CONTINUE : AAUDIO_CALLBACK_RESULT_STOP;
+}
+
+void errorCallback(AAudioStream __unused *stream,
+                   void *userData,
+                   aaudio_result_t error){
+
+    auto *backendStream = static_cast<AAudioBackendStream *>(userData);
+    const StreamParameters &parameters = backendStream->getParameters();
+    if (parameters.errorCallback == nullptr) return;
+    parameters.errorCallback(backendStream, parameters.userData,
+                             (error == AAUDIO_ERROR_DISCONNECTED) ?
+                             StreamError::Disconnected : StreamError::Unknown);
+}
+
+// Here we declare a new type: StreamBuilder which is a smart pointer to an AAudioStreamBuilder
+// with a custom deleter. The function AudioStreamBuilder_delete will be called when the
+// object is deleted. Using a smart pointer allows us to avoid memory management of an
+// AAudioStreamBuilder.
+using StreamBuilder = std::unique_ptr<AAudioStreamBuilder, decltype(&AAudioStreamBuilder_delete)>;
+
+// Now we define a method to construct our StreamBuilder
+StreamBuilder makeStreamBuilder(){
+
+    AAudioStreamBuilder *builder = nullptr;
+    aaudio_result_t result = AAudio_createStreamBuilder(&builder);
+    if (result != AAUDIO_OK) {
+        __android_log_print(ANDROID_LOG_ERROR, __func__, "Failed to create stream builder %s (%d)",
+              AAudio_convertResultToText(result), result);
+        return StreamBuilder(nullptr, &AAudioStreamBuilder_delete);
+    }
+    return StreamBuilder(builder, &AAudioStreamBuilder_delete);
+}
+
+} // namespace
+
+std::unique_ptr<AudioStream> AAudioBackend::openStream(const StreamParameters &parameters) {
+
+    StreamBuilder builder = makeStreamBuilder();
+    if (builder == nullptr) return nullptr;
+
+    AAudioStreamBuilder_setDirection(builder.get(),
+                                     (parameters.direction == StreamDirection::Input) ?
+                                     AAUDIO_DIRECTION_INPUT : AAUDIO_DIRECTION_OUTPUT);
+    AAudioStreamBuilder_setFormat(builder.get(), (parameters.format == SampleFormat::I16) ?
+                                                 AAUDIO_FORMAT_PCM_I16 : AAUDIO_FORMAT_PCM_FLOAT);
+    AAudioStreamBuilder_setChannelCount(builder.get(), parameters.channelCount);
+    AAudioStreamBuilder_setSampleRate(builder.get(), parameters.sampleRate);
+    AAudioStreamBuilder_setDeviceId(builder.get(), parameters.deviceId);
+    AAudioStreamBuilder_setPerformanceMode(builder.get(), AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    AAudioStreamBuilder_setSharingMode(builder.get(), AAUDIO_SHARING_MODE_EXCLUSIVE);
+
+    // The callbacks are given our stream object rather than the engine, so it's created first and
+    // the AAudio stream is opened straight into it.
+    std::unique_ptr<AAudioBackendStream> stream(new AAudioBackendStream(parameters));
+    if (parameters.dataCallback != nullptr) {
+        AAudioStreamBuilder_setDataCallback(builder.get(), ::dataCallback, stream.get());
+    }
+    AAudioStreamBuilder_setErrorCallback(builder.get(), ::errorCallback, stream.get());
+
+    aaudio_result_t result = AAudioStreamBuilder_openStream(builder.get(),
+                                                            stream->getStreamAddress());
+    if (result != AAUDIO_OK){
+        __android_log_print(ANDROID_LOG_DEBUG, __func__,
+                            "Error opening stream %s",
+                            AAudio_convertResultToText(result));
+        return nullptr;
+    }
+    return stream;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_AAUDIOBACKEND_H
+#define WAVEMAKER2_AAUDIOBACKEND_H
+
+#include "AudioBackend.h"
+
+/**
+ * Opens low latency, exclusive mode AAudio streams.
+ */
+class AAudioBackend : public AudioBackend {
+
+public:
+    std::unique_ptr<AudioStream> openStream(const StreamParameters &parameters) override;
+};
+
+#endif //WAVEMAKER2_AAUDIOBACKEND_H
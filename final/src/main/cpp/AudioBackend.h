@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_AUDIOBACKEND_H
+#define WAVEMAKER2_AUDIOBACKEND_H
+
+#include <cstdint>
+#include <memory>
+
+enum class StreamDirection { Output, Input };
+enum class SampleFormat { Float, I16 };
+enum class CallbackResult { Continue, Stop };
+enum class StreamError { Disconnected, Unknown };
+
+constexpr int32_t kUnspecified = 0;
+
+inline int32_t getBytesPerSample(SampleFormat format) {
+    return (format == SampleFormat::I16) ? sizeof(int16_t) : sizeof(float);
+}
+
+class AudioStream;
+
+using DataCallback = CallbackResult (*)(AudioStream *stream, void *userData, void *audioData,
+                                        int32_t numFrames);
+using ErrorCallback = void (*)(AudioStream *stream, void *userData, StreamError error);
+
+struct StreamParameters {
+    StreamDirection direction = StreamDirection::Output;
+    SampleFormat format = SampleFormat::Float;
+    int32_t channelCount = kUnspecified;
+    int32_t sampleRate = kUnspecified;
+    int32_t deviceId = kUnspecified;
+    // Input streams may be opened without a data callback and read from instead.
+    DataCallback dataCallback = nullptr;
+    ErrorCallback errorCallback = nullptr;
+    void *userData = nullptr;
+};
+
+/**
+ * An open stream. Closed when it's destroyed.
+ */
+class AudioStream {
+
+public:
+    virtual ~AudioStream() = default;
+    virtual bool requestStart() = 0;
+    virtual bool requestStop() = 0;
+    virtual SampleFormat getFormat() const = 0;
+    virtual int32_t getChannelCount() const = 0;
+    virtual int32_t getSampleRate() const = 0;
+    virtual int32_t getDeviceId() const = 0;
+    virtual int32_t getFramesPerBurst() const = 0;
+    virtual int32_t getBufferSizeInFrames() const = 0;
+    // Returns the size actually set, which is clamped to the capacity, or a negative value on error.
+    virtual int32_t setBufferSizeInFrames(int32_t numFrames) = 0;
+    virtual int32_t getBufferCapacityInFrames() const = 0;
+    virtual int32_t getXRunCount() const = 0;
+
+    /**
+     * Read from an input stream which was opened without a data callback. A timeout of 0 returns
+     * immediately with whatever is available.
+     *
+     * @return the number of frames read, or a negative value on error
+     */
+    virtual int32_t read(void *buffer, int32_t numFrames, int64_t timeoutNanos) = 0;
+    // The number of frames an input stream has captured which haven't been read yet.
+    virtual int32_t getFramesAvailable() const = 0;
+};
+
+/**
+ * Opens streams for the AudioEngine. The AAudio backend is used on devices, and the offline
+ * backend drives the engine's callbacks without any audio hardware.
+ */
+class AudioBackend {
+
+public:
+    virtual ~AudioBackend() = default;
+
+    // Returns nullptr if the stream couldn't be opened.
+    virtual std::unique_ptr<AudioStream> openStream(const StreamParameters &parameters) = 0;
+};
+
+#endif //WAVEMAKER2_AUDIOBACKEND_H
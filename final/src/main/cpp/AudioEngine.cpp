@@ -15,205 +15,947 @@
  */
 
 #include "AudioEngine.h"
-#include "SoundRecordingUtilities.h"
-#include <aaudio/AAudio.h>
-#include <android/log.h>
-#include <thread>
-#include <mutex>
-
-aaudio_data_callback_result_t recordingDataCallback(
-        AAudioStream __unused *stream,
+#include "FrameRenderer.h"
+#include "Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+CallbackResult recordingDataCallback(
+        AudioStream *stream,
         void *userData,
         void *audioData,
         int32_t numFrames) {
 
-    return ((AudioEngine *) userData)->recordingCallback(
+    auto *engine = static_cast<AudioEngine *>(userData);
+    engine->getRecordingThreadSetup().applyOnce();
+    ScopedCallbackTimer timer(engine->getRecordingStats(), stream, numFrames);
+    return engine->recordingCallback(
             static_cast<float *>(audioData), numFrames);
 }
 
-aaudio_data_callback_result_t playbackDataCallback(
-        AAudioStream __unused *stream,
+CallbackResult playbackDataCallback(
+        AudioStream *stream,
         void *userData,
         void *audioData,
         int32_t numFrames) {
 
-    return ((AudioEngine *) userData)->playbackCallback(static_cast<float *>(audioData), numFrames);
+    auto *engine = static_cast<AudioEngine *>(userData);
+    engine->getPlaybackThreadSetup().applyOnce();
+    ScopedCallbackTimer timer(engine->getPlaybackStats(), stream, numFrames);
+    return engine->playbackCallback(audioData, numFrames);
 }
 
-void errorCallback(AAudioStream __unused *stream,
+void errorCallback(AudioStream *stream,
                    void *userData,
-                   aaudio_result_t error){
-    if (error == AAUDIO_ERROR_DISCONNECTED){
-        // The error callback expects to return immediately so it's not safe to restart our streams
-        // in here. Instead we use a separate thread.
-        std::function<void(void)> restartFunction = std::bind(&AudioEngine::restart,
-                                                              static_cast<AudioEngine *>(userData));
-        new std::thread(restartFunction);
+                   StreamError error){
+    static_cast<AudioEngine *>(userData)->onStreamError(stream, error);
+}
+
+namespace {
+
+constexpr uint32_t kCommandRestart = 1 << 0;
+constexpr uint32_t kCommandExit = 1 << 1;
+constexpr uint32_t kCommandMeasureLatency = 1 << 2;
+constexpr uint32_t kCommandDrainTransport = 1 << 3;
+constexpr uint32_t kCommandLogThreadInfo = 1 << 4;
+
+// Used to size the recording memory if it's reserved before the streams have reported a rate.
+constexpr int32_t kDefaultSampleRate = 48000;
+
+// The audio callbacks can't post commands without risking a wait on mControlLock, so while a
+// latency measurement is capturing, or new streams have yet to call back, the control thread
+// checks on them at this interval instead.
+constexpr std::chrono::milliseconds kLatencyPollInterval { 10 };
+// Imports are decoded this many frames at a time, and wait this long for the block pool to be
+// topped up when they get ahead of it.
+constexpr int32_t kImportChunkFrames = 16384;
+constexpr std::chrono::milliseconds kImportRetryInterval { 5 };
+
+int64_t getNanosecondsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+AudioEngine::~AudioEngine() {
+
+    if (mControlThread.joinable()) {
+        postCommand(kCommandExit);
+        mControlThread.join();
+    }
+    stop();
+}
+
+void AudioEngine::start(bool isFullDuplex) {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    if (mIsStarted) return;
+    mIsFullDuplex = isFullDuplex;
+    if (!mControlThread.joinable()) {
+        mControlThread = std::thread(&AudioEngine::runControlThread, this);
+    }
+
+    // Keep blocks ready for the recording callback while the streams are running.
+    mBlockPool.startRefilling();
+    mRecordingStats.reset();
+    mPlaybackStats.reset();
+    mIsStarted = true;
+
+    // Let the streams negotiate their parameters from scratch.
+    mLastPlaybackSampleRate = kUnspecified;
+    mLastPlaybackFormat = mRequestedPlaybackFormat;
+    mLastPlaybackChannelCount = kChannelCountStereo;
+    openStreams();
+    reserveRecordingMemory();
+}
+
+void AudioEngine::stop() {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mIsImporting = false;
+    if (mImportThread.joinable()) mImportThread.join();
+    closeStreams();
+    {
+        // With the callback stopped, catch up with the last undo or redo here so that the tracks
+        // it left behind can be freed.
+        std::lock_guard<std::mutex> transportLock(mTransportLock);
+        mMixer.applyRequestedTracks();
+        mMixer.releaseUnusedTracks();
+    }
+    mDiskWriter.close();
+    mBlockPool.stopRefilling();
+    // Blocks which already hold takes are kept.
+    mBlockPool.releaseReadyBlocks();
+    mLatencyTester.cancel();
+    mIsStarted = false;
+}
+
+void AudioEngine::setRecordingCapacity(int32_t seconds) {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mRecordingCapacitySeconds = std::max(0, seconds);
+    if (mIsStarted) reserveRecordingMemory();
+}
+
+void AudioEngine::reserveRecordingMemory() {
+
+    if (mRecordingCapacitySeconds == 0) {
+        mBlockPool.reserve(0);
+        return;
     }
+    const int32_t sampleRate = (mLastPlaybackSampleRate != kUnspecified) ?
+                               mLastPlaybackSampleRate : kDefaultSampleRate;
+    const int64_t bytes = static_cast<int64_t>(mRecordingCapacitySeconds) * sampleRate *
+                          getBytesPerSample(mMixer.getStorageFormat());
+    const auto numBlocks = static_cast<int32_t>(
+            (bytes + kBlockSizeInBytes - 1) / kBlockSizeInBytes) +
+            PeakPyramid::getBlocksNeeded(static_cast<int64_t>(mRecordingCapacitySeconds) *
+                                         sampleRate);
+    if (!mBlockPool.reserve(numBlocks)) {
+        LOGD("Reserved %d blocks for recording but couldn't lock them", numBlocks);
+    }
+}
+
+bool AudioEngine::importTrack(const char *path) {
+
+    std::unique_ptr<WavFileReader> file(new WavFileReader());
+    if (!file->open(path)) return false;
+
+    std::lock_guard<std::mutex> lifecycleLock(mLifecycleLock);
+    if (!mIsStarted || mLastPlaybackSampleRate == kUnspecified || mIsImporting) return false;
+    if (mImportThread.joinable()) mImportThread.join();
+
+    // An import is a take which is written by the import thread rather than the recording
+    // callback.
+    {
+        std::lock_guard<std::mutex> lock(mTransportLock);
+        if (mIsTakeScheduled || mIsTakeInProgress) return false;
+        mImportTrack = mMixer.prepareTake();
+        if (mImportTrack == nullptr) return false;
+        // The track is mixed in before it's finished. If it's undone or cleared in the meantime,
+        // pinning it stops it from being freed while it's still being written.
+        mImportTrack->getRecording().pin();
+        mIsTakeInProgress = true;
+    }
+    mImportFile = std::move(file);
+    mIsImporting = true;
+    mImportThread = std::thread(&AudioEngine::runImport, this, mLastPlaybackSampleRate);
+    return true;
 }
 
-// Here we declare a new type: StreamBuilder which is a smart pointer to an AAudioStreamBuilder
-// with a custom deleter. The function AudioStreamBuilder_delete will be called when the
-// object is deleted. Using a smart pointer allows us to avoid memory management of an
-// AAudioStreamBuilder.
-using StreamBuilder = std::unique_ptr<AAudioStreamBuilder, decltype(&AAudioStreamBuilder_delete)>;
+void AudioEngine::runImport(int32_t sampleRate) {
+
+    const WavInfo &info = mImportFile->getInfo();
+    SoundRecording &recording = mImportTrack->getRecording();
+    const auto fileSampleRate = static_cast<int32_t>(info.sampleRate);
+    std::unique_ptr<Resampler> resampler;
+    if (fileSampleRate != sampleRate) {
+        resampler.reset(new Resampler(fileSampleRate, sampleRate, ResamplerQuality::High));
+    }
+    std::vector<float> decoded(kImportChunkFrames);
+    std::vector<float> resampled(
+            resampler ? resampler->getMaxOutputFrames(kImportChunkFrames) : 0);
+
+    // The resampler holds back the end of the file until it has seen what comes after it, so it's
+    // flushed with silence and the output trimmed to the file's length.
+    const int64_t totalFrames = info.getNumFrames() * sampleRate / fileSampleRate;
+    int64_t framesStored = 0;
+    bool isFlushed = (resampler == nullptr);
+    bool isAdded = false;
+    while (mIsImporting) {
+        int32_t numFrames = mImportFile->readMono(decoded.data(), kImportChunkFrames);
+        if (numFrames == 0) {
+            if (isFlushed) break;
+            numFrames = resampler->getTapsPerPhase();
+            std::fill(decoded.begin(), decoded.begin() + numFrames, 0.0f);
+            isFlushed = true;
+        }
+        const float *frames = decoded.data();
+        if (resampler) {
+            numFrames = resampler->process(decoded.data(), numFrames, resampled.data());
+            frames = resampled.data();
+        }
+        numFrames = static_cast<int32_t>(std::min<int64_t>(numFrames, totalFrames - framesStored));
+        if (!storeImportedFrames(recording, frames, numFrames)) break;
+        framesStored += numFrames;
+        if (!isAdded && framesStored > 0) isAdded = scheduleImportedTrack();
+    }
 
-// Now we define a method to construct our StreamBuilder
-StreamBuilder makeStreamBuilder(){
+    // Even an empty take has to be ended so that the next one can start.
+    while (!isAdded && mIsImporting) {
+        isAdded = scheduleImportedTrack();
+        if (!isAdded) std::this_thread::sleep_for(kImportRetryInterval);
+    }
+    LOGD("Imported %lld frames", static_cast<long long>(framesStored));
+    mImportFile.reset();
+
+    // A new take can start as soon as the track is released.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    if (!isAdded) {
+        mMixer.cancelTake();
+        mIsTakeInProgress = false;
+    }
+    recording.unpin();
+    mImportTrack = nullptr;
+    mMixer.releaseUnusedTracks();
+    mIsImporting = false;
+}
 
-    AAudioStreamBuilder *builder = nullptr;
-    aaudio_result_t result = AAudio_createStreamBuilder(&builder);
-    if (result != AAUDIO_OK) {
-        __android_log_print(ANDROID_LOG_ERROR, __func__, "Failed to create stream builder %s (%d)",
-              AAudio_convertResultToText(result), result);
-        return StreamBuilder(nullptr, &AAudioStreamBuilder_delete);
+bool AudioEngine::storeImportedFrames(SoundRecording &recording, const float *frames,
+                                      int32_t numFrames) {
+
+    // The import can get ahead of the block pool's refill thread, in which case it waits for
+    // more blocks rather than dropping audio. It only gives up if the recording is full.
+    while (numFrames > 0) {
+        const int32_t framesWritten = recording.write(frames, numFrames);
+        frames += framesWritten;
+        numFrames -= framesWritten;
+        if (numFrames == 0) break;
+        if (recording.isFull() || !mIsImporting) return false;
+        std::this_thread::sleep_for(kImportRetryInterval);
     }
-    return StreamBuilder(builder, &AAudioStreamBuilder_delete);
+    return true;
+}
+
+bool AudioEngine::scheduleImportedTrack() {
+
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    TransportEvent event;
+    event.action = TransportAction::AddTrack;
+    event.frameTime = kTransportNow;
+    if (!mTransportQueue.push(event)) return false;
+    drainTransportEventsIfStopped();
+    return true;
+}
+
+bool AudioEngine::startDiskCapture(const char *path, StorageFormat format) {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    if (!mIsStarted || mLastPlaybackSampleRate == kUnspecified) return false;
+    return mDiskWriter.open(path, mLastPlaybackSampleRate, kChannelCountMono, format);
+}
+
+bool AudioEngine::stopDiskCapture() {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    return mDiskWriter.close();
+}
+
+void AudioEngine::restart(){
+    postCommand(kCommandRestart);
 }
 
-void AudioEngine::start() {
+void AudioEngine::onStreamError(AudioStream *stream, StreamError error) {
+
+    // Ignore errors from streams we've already replaced, otherwise the second stream of a pair
+    // reporting the same disconnect could restart the new streams.
+    if (error != StreamError::Disconnected ||
+        (stream != mActivePlaybackStream && stream != mActiveRecordingStream)) {
+        return;
+    }
+
+    // The error callback expects to return immediately so it's not safe to restart our streams
+    // in here. Instead we ask the control thread to do it. Only the first disconnect before a
+    // restart is timed.
+    int64_t noDisconnect = 0;
+    mDisconnectTimeNanos.compare_exchange_strong(noDisconnect, getNanosecondsNow());
+    postCommand(kCommandRestart);
+}
+
+void AudioEngine::postCommand(uint32_t command) {
+
+    // Commands are bits in a single word, so any number of threads can post them without locking
+    // and repeated requests for the same command coalesce into one. The lock is only held to make
+    // sure the control thread can't miss the notification between checking and waiting.
+    mPendingCommands.fetch_or(command);
+    { std::lock_guard<std::mutex> lock(mControlLock); }
+    mControlCondition.notify_one();
+}
+
+void AudioEngine::runControlThread() {
+
+    bool isThreadInfoPending = false;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mControlLock);
+            auto hasWork = [this](){
+                return mPendingCommands != 0 || mLatencyTester.isCaptureComplete();
+            };
+            if (mLatencyTester.isRunning() || isThreadInfoPending) {
+                mControlCondition.wait_for(lock, kLatencyPollInterval, hasWork);
+            } else {
+                mControlCondition.wait(lock, hasWork);
+            }
+        }
+        const uint32_t commands = mPendingCommands.exchange(0);
+        if (commands & kCommandExit) return;
+        if (commands & kCommandRestart) restartStreams();
+        if (commands & kCommandMeasureLatency) prepareLatencyMeasurement();
+        if (commands & kCommandDrainTransport) {
+            std::lock_guard<std::mutex> lock(mLifecycleLock);
+            if (mPlaybackStream == nullptr) drainTransportEvents();
+        }
+        if (mLatencyTester.isCaptureComplete()) mLatencyTester.analyse();
+        if ((commands & kCommandLogThreadInfo) || isThreadInfoPending) {
+            // In full-duplex mode the recording stream has no callback of its own.
+            std::lock_guard<std::mutex> lock(mLifecycleLock);
+            const bool isPlaybackLogged = mPlaybackThreadSetup.logInfo("Playback");
+            const bool isRecordingLogged = mIsFullDuplex ||
+                                           mRecordingThreadSetup.logInfo("Recording");
+            isThreadInfoPending = mPlaybackStream != nullptr &&
+                                  !(isPlaybackLogged && isRecordingLogged);
+        }
+    }
+}
+
+void AudioEngine::restartStreams() {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    if (!mIsStarted) {
+        mDisconnectTimeNanos = 0;
+        return;
+    }
+
+    // Reopen with the parameters we ended up with last time so the new streams don't have to
+    // negotiate them again. Unless a device was chosen it's left unspecified so that we follow the
+    // new route.
+    closeStreams();
+    openStreams();
+
+    const int64_t disconnectTime = mDisconnectTimeNanos.exchange(0);
+    if (disconnectTime != 0) {
+        mLastRestartLatencyNanos = getNanosecondsNow() - disconnectTime;
+        LOGD("Restarted streams %.1f ms after disconnect", mLastRestartLatencyNanos / 1e6);
+    }
+    mRestartCount++;
+}
+
+bool AudioEngine::startLatencyMeasurement(LatencySignal signal) {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    if (!mIsStarted) return false;
+    mRequestedLatencySignal = signal;
+    postCommand(kCommandMeasureLatency);
+    return true;
+}
+
+bool AudioEngine::getLatencyResult(LatencyResult &result) const {
+    return mLatencyTester.getResult(result);
+}
+
+void AudioEngine::prepareLatencyMeasurement() {
+
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    if (!mIsStarted || mLastPlaybackSampleRate == kUnspecified) return;
+    if (!mLatencyTester.prepare(mRequestedLatencySignal, mLastPlaybackSampleRate)) {
+        LOGD("A latency measurement is already running");
+    }
+}
+
+void AudioEngine::openStreams() {
 
     // Create the playback stream.
-    StreamBuilder playbackBuilder = makeStreamBuilder();
-    AAudioStreamBuilder_setFormat(playbackBuilder.get(), AAUDIO_FORMAT_PCM_FLOAT);
-    AAudioStreamBuilder_setChannelCount(playbackBuilder.get(), kChannelCountStereo);
-    AAudioStreamBuilder_setPerformanceMode(playbackBuilder.get(), AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
-    AAudioStreamBuilder_setSharingMode(playbackBuilder.get(), AAUDIO_SHARING_MODE_EXCLUSIVE);
-    AAudioStreamBuilder_setDataCallback(playbackBuilder.get(), ::playbackDataCallback, this);
-    AAudioStreamBuilder_setErrorCallback(playbackBuilder.get(), ::errorCallback, this);
-
-    aaudio_result_t result = AAudioStreamBuilder_openStream(playbackBuilder.get(), &mPlaybackStream);
-
-    if (result != AAUDIO_OK){
-        __android_log_print(ANDROID_LOG_DEBUG, __func__,
-                            "Error opening playback stream %s",
-                            AAudio_convertResultToText(result));
+    StreamParameters playbackParameters;
+    playbackParameters.direction = StreamDirection::Output;
+    playbackParameters.format = mLastPlaybackFormat;
+    playbackParameters.channelCount = mLastPlaybackChannelCount;
+    playbackParameters.sampleRate = mLastPlaybackSampleRate;
+    playbackParameters.deviceId = mPlaybackDeviceId;
+    playbackParameters.dataCallback = ::playbackDataCallback;
+    playbackParameters.errorCallback = ::errorCallback;
+    playbackParameters.userData = this;
+
+    mPlaybackThreadSetup.reset(mCallbackCpuMask);
+    mPlaybackStream = mBackend->openStream(playbackParameters);
+    if (mPlaybackStream == nullptr){
+        LOGD("Error opening playback stream");
         return;
     }
+    mActivePlaybackStream = mPlaybackStream.get();
 
     // Obtain the sample rate from the playback stream so we can request the same sample rate from
     // the recording stream.
-    int32_t sampleRate = AAudioStream_getSampleRate(mPlaybackStream);
-
-    result = AAudioStream_requestStart(mPlaybackStream);
-    if (result != AAUDIO_OK){
-        __android_log_print(ANDROID_LOG_DEBUG, __func__,
-                            "Error starting playback stream %s",
-                            AAudio_convertResultToText(result));
-        closeStream(&mPlaybackStream);
+    int32_t sampleRate = mPlaybackStream->getSampleRate();
+
+    // Render in whatever format and channel count we were actually given, and remember them for
+    // the next time the streams are reopened.
+    mPlaybackFormat = mPlaybackStream->getFormat();
+    mPlaybackChannelCount = mPlaybackStream->getChannelCount();
+    mLastPlaybackFormat = mPlaybackFormat;
+    mLastPlaybackChannelCount = mPlaybackChannelCount;
+    mLastPlaybackSampleRate = sampleRate;
+
+    mLatencyTuner.setPolicy(mRequestedTunerPolicy);
+    if (mRequestedTunerPolicy.isEnabled) mLatencyTuner.reset(*mPlaybackStream);
+
+    // In full-duplex mode the playback stream can't start until there's input for it to read.
+    if (!mIsFullDuplex && !mPlaybackStream->requestStart()){
+        LOGD("Error starting playback stream");
+        closeStreams();
         return;
     }
 
     // Create the recording stream.
-    StreamBuilder recordingBuilder = makeStreamBuilder();
-    AAudioStreamBuilder_setDirection(recordingBuilder.get(), AAUDIO_DIRECTION_INPUT);
-    AAudioStreamBuilder_setPerformanceMode(recordingBuilder.get(), AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
-    AAudioStreamBuilder_setSharingMode(recordingBuilder.get(), AAUDIO_SHARING_MODE_EXCLUSIVE);
-    AAudioStreamBuilder_setFormat(recordingBuilder.get(), AAUDIO_FORMAT_PCM_FLOAT);
-    AAudioStreamBuilder_setSampleRate(recordingBuilder.get(), sampleRate);
-    AAudioStreamBuilder_setChannelCount(recordingBuilder.get(), kChannelCountMono);
-    AAudioStreamBuilder_setDataCallback(recordingBuilder.get(), ::recordingDataCallback, this);
-    AAudioStreamBuilder_setErrorCallback(recordingBuilder.get(), ::errorCallback, this);
-
-    result = AAudioStreamBuilder_openStream(recordingBuilder.get(), &mRecordingStream);
-
-    if (result != AAUDIO_OK){
-        __android_log_print(ANDROID_LOG_DEBUG, __func__,
-                            "Error opening recording stream %s",
-                            AAudio_convertResultToText(result));
-        closeStream(&mRecordingStream);
+    StreamParameters recordingParameters;
+    recordingParameters.direction = StreamDirection::Input;
+    recordingParameters.format = SampleFormat::Float;
+    recordingParameters.sampleRate = sampleRate;
+    recordingParameters.channelCount = kChannelCountMono;
+    recordingParameters.deviceId = mRecordingDeviceId;
+    recordingParameters.dataCallback = mIsFullDuplex ? nullptr : ::recordingDataCallback;
+    recordingParameters.errorCallback = ::errorCallback;
+    recordingParameters.userData = this;
+
+    mRecordingThreadSetup.reset(mCallbackCpuMask);
+    mRecordingStream = mBackend->openStream(recordingParameters);
+    if (mRecordingStream == nullptr){
+        LOGD("Error opening recording stream");
         return;
     }
+    mActiveRecordingStream = mRecordingStream.get();
+
+    // Takes are stored at the playback rate. If the input device couldn't give us that, convert
+    // on the way in so that they don't play back at the wrong pitch.
+    const int32_t recordingSampleRate = mRecordingStream->getSampleRate();
+    if (recordingSampleRate != sampleRate && recordingSampleRate > 0) {
+        LOGD("Resampling input from %d to %d Hz", recordingSampleRate, sampleRate);
+        mInputResampler.reset(new Resampler(recordingSampleRate, sampleRate));
+    } else {
+        mInputResampler.reset();
+    }
 
-    result = AAudioStream_requestStart(mRecordingStream);
-    if (result != AAUDIO_OK){
-        __android_log_print(ANDROID_LOG_DEBUG, __func__,
-                            "Error starting recording stream %s",
-                            AAudio_convertResultToText(result));
+    if (!mRecordingStream->requestStart()){
+        LOGD("Error starting recording stream");
         return;
     }
+
+    if (mIsFullDuplex) {
+        mDuplexInput.reset();
+        mDuplexInputRemainder = 0;
+        if (!mPlaybackStream->requestStart()) {
+            LOGD("Error starting playback stream");
+            closeStreams();
+        }
+    }
+    // The callbacks don't log how their threads were set up, so the control thread does.
+    postCommand(kCommandLogThreadInfo);
 }
 
-void AudioEngine::stop() {
+void AudioEngine::closeStreams() {
+
+    // The playback stream must be closed first, in full-duplex mode its callback reads from the
+    // recording stream.
+    mActivePlaybackStream = nullptr;
+    mActiveRecordingStream = nullptr;
+    stopStream(mPlaybackStream.get());
+    closeStream(mPlaybackStream);
+    stopStream(mRecordingStream.get());
+    closeStream(mRecordingStream);
+    drainTransportEvents();
+}
 
-    stopStream(mPlaybackStream);
-    closeStream(&mPlaybackStream);
-    stopStream(mRecordingStream);
-    closeStream(&mRecordingStream);
+int64_t AudioEngine::getLastRestartLatencyNanos() const {
+    return mLastRestartLatencyNanos;
 }
 
-void AudioEngine::restart(){
+int32_t AudioEngine::getRestartCount() const {
+    return mRestartCount;
+}
+
+CallbackResult AudioEngine::recordingCallback(float *audioData, int32_t numFrames) {
 
-    static std::mutex restartingLock;
-    if (restartingLock.try_lock()){
-        stop();
-        start();
-        restartingLock.unlock();
+    if (mInputResampler == nullptr) {
+        storeInput(audioData, numFrames);
+        return CallbackResult::Continue;
     }
+
+    const int32_t maxChunkFrames = mInputResampler->getMaxInputFrames(kMixBufferFrames);
+    for (int32_t start = 0; start < numFrames; start += maxChunkFrames) {
+        const int32_t chunkFrames = std::min(maxChunkFrames, numFrames - start);
+        const int32_t framesResampled = mInputResampler->process(
+                &audioData[start], chunkFrames, mResampledInputBuffer.data());
+        storeInput(mResampledInputBuffer.data(), framesResampled);
+    }
+    return CallbackResult::Continue;
 }
 
-aaudio_data_callback_result_t AudioEngine::recordingCallback(float *audioData,
-                                                             int32_t numFrames) {
-    if (mIsRecording) {
-        int32_t framesWritten = mSoundRecording.write(audioData, numFrames);
-        if (framesWritten == 0) mIsRecording = false;
+void AudioEngine::storeInput(const float *audioData, int32_t numFrames) {
+    if (mLatencyTester.isRunning()) mLatencyTester.capture(audioData, numFrames);
+    if (mDiskWriter.isOpen()) mDiskWriter.write(audioData, numFrames);
+
+    // While recording, the meter measures the input as it's copied into the take.
+    SignalLevels levels;
+    int32_t framesMeasured = 0;
+    Track *track = mRecordingTrack.load(std::memory_order_acquire);
+    if (mIsRecording && track != nullptr) {
+        SoundRecording &recording = track->getRecording();
+        if (mOnsetGate.isEnabled()) {
+            // What reaches the take may come from the pre-roll rather than this block, so the
+            // meter measures the block separately.
+            bool isFull = false;
+            mOnsetGate.process(audioData, numFrames, [&](const float *frames, int32_t length) {
+                if (!isFull) isFull = recording.write(frames, length) < length;
+            });
+            if (isFull) mIsRecording = false;
+        } else {
+            int32_t framesWritten = recording.write(audioData, numFrames, &levels);
+            if (framesWritten == 0) mIsRecording = false;
+            framesMeasured = framesWritten;
+        }
     }
-    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+    measureArrayLevels(&audioData[framesMeasured], numFrames - framesMeasured, levels);
+    mInputMeter.add(levels);
 }
 
-aaudio_data_callback_result_t AudioEngine::playbackCallback(float *audioData, int32_t numFrames) {
+CallbackResult AudioEngine::playbackCallback(void *audioData, int32_t numFrames) {
+
+    if (mLatencyTuner.getPolicy().isEnabled) mLatencyTuner.tune(*mPlaybackStream);
+    mMixer.applyRequestedTracks();
+    takeTransportEvents();
+
+    // Render up to each scheduled event in turn so that it takes effect on exactly its frame.
+    const int32_t bytesPerFrame = mPlaybackChannelCount * getBytesPerSample(mPlaybackFormat);
+    auto *output = static_cast<uint8_t *>(audioData);
+    int32_t start = 0;
+    for (;;) {
+        resolveLoopBoundary();
+        applyDueTransportEvents();
+        resolveLoopBoundary();
+        if (start == numFrames) break;
+        const int32_t segmentFrames = getFramesUntilNextTransportEvent(numFrames - start);
+        renderFrames(&output[start * bytesPerFrame], segmentFrames);
+        start += segmentFrames;
+        mPlaybackFramePosition.fetch_add(segmentFrames, std::memory_order_release);
+    }
+    return CallbackResult::Continue;
+}
 
-    fillArrayWithZeros(audioData, numFrames * kChannelCountStereo);
+void AudioEngine::renderFrames(void *audioData, int32_t numFrames) {
+
+    // The recording stream is always started before the playback stream and closed after it, so
+    // it's safe to use here.
+    if (mIsFullDuplex) {
+        // If the input runs at another rate, read as many of its frames as these output frames
+        // last for, carrying the fraction over, and let recordingCallback() resample them.
+        AudioStream &input = *mRecordingStream;
+        const int32_t inputRate = mInputResampler ? mInputResampler->getInputRate() : 1;
+        const int32_t outputRate = mInputResampler ? mInputResampler->getOutputRate() : 1;
+        const auto maxChunkFrames = static_cast<int32_t>(std::min<int64_t>(
+                kMixBufferFrames, static_cast<int64_t>(kMixBufferFrames) * outputRate / inputRate));
+        for (int32_t start = 0; start < numFrames; start += maxChunkFrames) {
+            const int32_t chunkFrames = std::min(maxChunkFrames, numFrames - start);
+            const int64_t inputTime = mDuplexInputRemainder +
+                                      static_cast<int64_t>(chunkFrames) * inputRate;
+            const auto inputFrames = static_cast<int32_t>(inputTime / outputRate);
+            mDuplexInputRemainder = inputTime % outputRate;
+            mDuplexInput.read(input, mDuplexInputBuffer.data(), inputFrames);
+            recordingCallback(mDuplexInputBuffer.data(), inputFrames);
+        }
+    }
+
+    // The test signal replaces the tracks until the measurement has been captured.
+    if (mLatencyTester.isRunning()) {
+        renderLatencySignal(audioData, numFrames);
+        return;
+    }
+
+    if (!mIsPlaying) {
+        memset(audioData, 0,
+               numFrames * mPlaybackChannelCount * getBytesPerSample(mPlaybackFormat));
+        return;
+    }
 
-    if (mIsPlaying) {
-        int32_t framesRead = mSoundRecording.read(audioData, numFrames);
-        convertArrayMonoToStereo(audioData, framesRead);
-        if (framesRead < numFrames) mIsPlaying = false;
+    int32_t framesRead;
+    if (mPlaybackFormat == SampleFormat::I16) {
+        framesRead = (mPlaybackChannelCount == kChannelCountMono) ?
+                mMixer.render<kChannelCountMono>(static_cast<int16_t *>(audioData), numFrames) :
+                mMixer.render<kChannelCountStereo>(static_cast<int16_t *>(audioData), numFrames);
+    } else {
+        framesRead = (mPlaybackChannelCount == kChannelCountMono) ?
+                mMixer.render<kChannelCountMono>(static_cast<float *>(audioData), numFrames) :
+                mMixer.render<kChannelCountStereo>(static_cast<float *>(audioData), numFrames);
     }
-    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+    if (framesRead < numFrames) mIsPlaying = false;
 }
 
-void AudioEngine::setRecording(bool isRecording) {
+bool AudioEngine::scheduleTransportEvent(TransportAction action, int64_t frameTime) {
+
+    if (action == TransportAction::AddTrack) return false;
+    std::lock_guard<std::mutex> lock(mTransportLock);
+
+    // Takes are prepared here, before the event is queued, so that the callback only has to flip
+    // a flag. A new take can't be prepared until the callback has finished with the last one.
+    Track *track = nullptr;
+    if (action == TransportAction::StartRecording) {
+        // An imported track is mixed in as soon as it starts, so the take is over before the
+        // import is. Until it's finished the import thread is still writing the track and
+        // claiming blocks, which only one thread at a time may do.
+        if (mIsTakeScheduled || mIsTakeInProgress || mImportTrack != nullptr) return false;
+        track = mMixer.prepareTake();
+        if (track == nullptr) {
+            LOGD("All %d tracks are in use, not recording", kMaxTracks);
+            return false;
+        }
+    } else if (action == TransportAction::StopRecording && !mIsTakeScheduled) {
+        return false;
+    }
+
+    if (action == TransportAction::StartRecording) {
+        mRecordingTrack = track;
+        mOnsetGate.arm();
+        mIsTakeInProgress = true;
+    }
+    TransportEvent event;
+    event.action = action;
+    event.frameTime = frameTime;
+    if (!mTransportQueue.push(event)) {
+        LOGE("Transport queue is full");
+        if (action == TransportAction::StartRecording) {
+            mMixer.cancelTake();
+            mRecordingTrack = nullptr;
+            mIsTakeInProgress = false;
+        }
+        return false;
+    }
+    if (action == TransportAction::StartRecording) mIsTakeScheduled = true;
+    if (action == TransportAction::StopRecording) mIsTakeScheduled = false;
+    drainTransportEventsIfStopped();
+    return true;
+}
 
-    if (isRecording) mSoundRecording.clear();
-    mIsRecording = isRecording;
+void AudioEngine::drainTransportEventsIfStopped() {
+
+    // Checked after the event is queued, so if the streams close after this they'll drain it
+    // themselves.
+    if (mActivePlaybackStream == nullptr) postCommand(kCommandDrainTransport);
 }
 
-void AudioEngine::setPlaying(bool isPlaying) {
+void AudioEngine::drainTransportEvents() {
+
+    // With no playback callback the frame position stands still. Apply what's due now, so that a
+    // take stopped while the streams are closed doesn't stay in progress, and leave later events
+    // for the callback once the streams are reopened.
+    do {
+        takeTransportEvents();
+        resolveLoopBoundary();
+        applyDueTransportEvents();
+        resolveLoopBoundary();
+        applyDueTransportEvents();
+    } while (mTransportQueue.size() > 0 &&
+             mPendingEventCount < static_cast<int32_t>(mPendingEvents.size()));
+}
 
-    if (isPlaying) mSoundRecording.setReadPositionToStart();
-    mIsPlaying = isPlaying;
+int64_t AudioEngine::getPlaybackFramePosition() const {
+    return mPlaybackFramePosition.load(std::memory_order_acquire);
 }
 
-void AudioEngine::stopStream(AAudioStream *stream) const {
+void AudioEngine::takeTransportEvents() {
 
-    static std::mutex stoppingLock;
-    stoppingLock.lock();
-    if (stream != nullptr) {
-        aaudio_result_t result = AAudioStream_requestStop(stream);
-        if (result != AAUDIO_OK) {
-            __android_log_print(ANDROID_LOG_DEBUG, __func__, "Error stopping stream %s",
-                                AAudio_convertResultToText(result));
+    const int64_t now = mPlaybackFramePosition.load(std::memory_order_relaxed);
+    TransportEvent event;
+    while (mPendingEventCount < static_cast<int32_t>(mPendingEvents.size()) &&
+           mTransportQueue.pop(event)) {
+        if (event.frameTime != kTransportNextLoopBoundary && event.frameTime < now) {
+            event.frameTime = now;
         }
+        mPendingEvents[mPendingEventCount++] = event;
     }
-    stoppingLock.unlock();
 }
 
-void AudioEngine::closeStream(AAudioStream **stream) const {
+void AudioEngine::resolveLoopBoundary() {
 
-    static std::mutex closingLock;
-    closingLock.lock();
-    if (*stream != nullptr) {
-        aaudio_result_t result = AAudioStream_close(*stream);
-        if (result != AAUDIO_OK) {
-            __android_log_print(ANDROID_LOG_DEBUG, __func__, "Error closing stream %s",
-                                AAudio_convertResultToText(result));
+    // Where the next boundary is depends on what the events before it do, for example starting
+    // playback, so it's only worked out once it's the oldest event left.
+    if (mPendingEventCount == 0 || mPendingEvents[0].frameTime != kTransportNextLoopBoundary) {
+        return;
+    }
+    const int64_t now = mPlaybackFramePosition.load(std::memory_order_relaxed);
+    mPendingEvents[0].frameTime = mIsPlaying ? now + mMixer.getFramesUntilLoopBoundary() : now;
+}
+
+int32_t AudioEngine::getFramesUntilNextTransportEvent(int32_t maxFrames) const {
+
+    const int64_t now = mPlaybackFramePosition.load(std::memory_order_relaxed);
+    int64_t frames = maxFrames;
+    for (int32_t i = 0; i < mPendingEventCount; ++i) {
+        const int64_t frameTime = mPendingEvents[i].frameTime;
+        if (frameTime != kTransportNextLoopBoundary) frames = std::min(frames, frameTime - now);
+    }
+    return static_cast<int32_t>(frames);
+}
+
+void AudioEngine::applyDueTransportEvents() {
+
+    // Events due at the same frame are applied in the order they were scheduled.
+    const int64_t now = mPlaybackFramePosition.load(std::memory_order_relaxed);
+    int32_t remaining = 0;
+    for (int32_t i = 0; i < mPendingEventCount; ++i) {
+        const TransportEvent &event = mPendingEvents[i];
+        if (event.frameTime > now || event.frameTime == kTransportNextLoopBoundary) {
+            mPendingEvents[remaining++] = event;
+            continue;
         }
-        *stream = nullptr;
+        switch (event.action) {
+            case TransportAction::StartRecording:
+                mIsRecording = true;
+                break;
+            case TransportAction::StopRecording:
+                // The recording callback may already have stopped if it ran out of space.
+                mIsRecording = false;
+                mRecordingTrack.store(nullptr, std::memory_order_release);
+                mMixer.addTake();
+                mIsTakeInProgress = false;
+                break;
+            case TransportAction::StartPlaying:
+                mMixer.setReadPositionToStart();
+                mIsPlaying = true;
+                break;
+            case TransportAction::StopPlaying:
+                mIsPlaying = false;
+                break;
+            case TransportAction::LoopingOn:
+            case TransportAction::LoopingOff:
+                mMixer.setLooping(event.action == TransportAction::LoopingOn);
+                break;
+            case TransportAction::AddTrack:
+                mMixer.addTake();
+                mIsTakeInProgress = false;
+                break;
+        }
+    }
+    mPendingEventCount = remaining;
+}
+
+void AudioEngine::renderLatencySignal(void *audioData, int32_t numFrames) {
+
+    const int32_t bytesPerFrame = mPlaybackChannelCount * getBytesPerSample(mPlaybackFormat);
+    auto *output = static_cast<uint8_t *>(audioData);
+    for (int32_t start = 0; start < numFrames; start += kMixBufferFrames) {
+        const int32_t chunkFrames = std::min(kMixBufferFrames, numFrames - start);
+        mLatencyTester.renderSignal(mLatencySignalBuffer.data(), chunkFrames);
+        writeMonoFrames(mLatencySignalBuffer.data(), &output[start * bytesPerFrame], chunkFrames,
+                        mPlaybackFormat, mPlaybackChannelCount);
     }
-    closingLock.unlock();
+}
+
+void AudioEngine::setRecording(bool isRecording) {
+    scheduleTransportEvent(isRecording ? TransportAction::StartRecording :
+                                         TransportAction::StopRecording, kTransportNow);
+}
+
+void AudioEngine::setPlaying(bool isPlaying) {
+    scheduleTransportEvent(isPlaying ? TransportAction::StartPlaying :
+                                       TransportAction::StopPlaying, kTransportNow);
+}
+
+// Both are only called from closeStreams(), under mLifecycleLock, so streams belonging to other
+// engines can be stopped and closed at the same time.
+void AudioEngine::stopStream(AudioStream *stream) const {
+    if (stream != nullptr) stream->requestStop();
+}
+
+void AudioEngine::closeStream(std::unique_ptr<AudioStream> &stream) const {
+    stream.reset();
+}
+
+void AudioEngine::setStorageFormat(StorageFormat format) {
+
+    // Takes are prepared under the transport lock, so this can't change while one is set up.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    mMixer.setStorageFormat(format);
+}
+
+bool AudioEngine::setOnsetGate(bool isEnabled, float threshold, int32_t preRollFrames) {
+
+    // Takes are armed under the transport lock, so the gate can't be set up while one starts.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    if (mIsTakeScheduled || mIsTakeInProgress) return false;
+    mOnsetGate.configure(isEnabled, threshold, preRollFrames);
+    return true;
+}
+
+void AudioEngine::setPlaybackFormat(SampleFormat format) {
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mRequestedPlaybackFormat = format;
+}
+
+void AudioEngine::setDeviceIds(int32_t playbackDeviceId, int32_t recordingDeviceId) {
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mPlaybackDeviceId = playbackDeviceId;
+    mRecordingDeviceId = recordingDeviceId;
+}
+
+void AudioEngine::setLatencyTunerPolicy(const LatencyTunerPolicy &policy) {
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mRequestedTunerPolicy = policy;
+}
+
+LatencyTunerPolicy AudioEngine::getLatencyTunerPolicy() {
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    return mRequestedTunerPolicy;
+}
+
+bool AudioEngine::getCallbackStats(StreamDirection direction,
+                                   CallbackStatsSnapshot &snapshot) const {
+    const CallbackStats &stats = (direction == StreamDirection::Input) ?
+                                 mRecordingStats : mPlaybackStats;
+    return stats.readSnapshot(snapshot);
+}
+
+void AudioEngine::setCallbackCpuMask(uint64_t cpuMask) {
+    std::lock_guard<std::mutex> lock(mLifecycleLock);
+    mCallbackCpuMask = cpuMask;
+}
+
+bool AudioEngine::getCallbackThreadInfo(StreamDirection direction,
+                                        RealtimeThreadInfo &info) const {
+    const RealtimeThreadSetup &setup = (direction == StreamDirection::Input) ?
+                                       mRecordingThreadSetup : mPlaybackThreadSetup;
+    return setup.getInfo(info);
 }
 
 void AudioEngine::setLooping(bool isOn) {
-    mSoundRecording.setLooping(isOn);
+    scheduleTransportEvent(isOn ? TransportAction::LoopingOn : TransportAction::LoopingOff,
+                           kTransportNow);
+}
+
+void AudioEngine::setTrackGain(int32_t trackIndex, float gain) {
+    // Undo and redo free tracks under the transport lock.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    Track *track = mMixer.getTrack(trackIndex);
+    if (track != nullptr) track->setGain(gain);
+}
+
+void AudioEngine::setTrackMuted(int32_t trackIndex, bool isMuted) {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    Track *track = mMixer.getTrack(trackIndex);
+    if (track != nullptr) track->setMuted(isMuted);
+}
+
+void AudioEngine::setTrackLoopLength(int32_t trackIndex, int32_t numFrames) {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    Track *track = mMixer.getTrack(trackIndex);
+    if (track != nullptr) track->setLoopLength(numFrames);
+}
+
+int32_t AudioEngine::getTrackCount() const {
+    return mMixer.getTrackCount();
+}
+
+bool AudioEngine::clearTracks() {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    return mMixer.clear();
+}
+
+bool AudioEngine::undoTake() {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    return mMixer.undo();
+}
+
+bool AudioEngine::redoTake() {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    return mMixer.redo();
+}
+
+void AudioEngine::setTakeHistoryBudget(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    mMixer.setHistoryBudget(bytes);
+}
+
+TakeHistoryState AudioEngine::getTakeHistoryState() {
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    return mMixer.getHistoryState();
+}
+
+Track *AudioEngine::findTrack(int32_t trackIndex) {
+    // The mixer knows about takes whether they're being recorded or imported. The recording
+    // callback's own pointer goes stale once the take has been added.
+    return (trackIndex == kCurrentTakeIndex) ? mMixer.getCurrentTake() :
+                                               mMixer.getTrack(trackIndex);
+}
+
+int32_t AudioEngine::getTrackPeaks(int32_t trackIndex, int32_t startFrame, int32_t endFrame,
+                                   int32_t numBins, PeakBin *bins) {
+
+    // Takes are prepared and tracks freed under the transport lock, so the track can't go away
+    // while we read it.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    Track *track = findTrack(trackIndex);
+    if (track == nullptr) return 0;
+    return track->getRecording().getPeaks(startFrame, endFrame, numBins, bins);
+}
+
+int64_t AudioEngine::pinSnapshot(int32_t trackIndex) {
+
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    Track *track = findTrack(trackIndex);
+    if (track == nullptr) return 0;
+    const int64_t handle = ++mLastSnapshotHandle;
+    PinnedSnapshot &pinned = mSnapshots[handle];
+    pinned.recording = &track->getRecording();
+    pinned.recording->pin(pinned.snapshot);
+    return handle;
+}
+
+bool AudioEngine::getSnapshot(int64_t handle, RecordingSnapshot &snapshot) {
+
+    // Copied under the lock, as the entry is erased when the handle is unpinned.
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    auto pinned = mSnapshots.find(handle);
+    if (pinned == mSnapshots.end()) return false;
+    snapshot = pinned->second.snapshot;
+    return true;
+}
+
+void AudioEngine::unpinSnapshot(int64_t handle) {
+
+    std::lock_guard<std::mutex> lock(mTransportLock);
+    auto pinned = mSnapshots.find(handle);
+    if (pinned == mSnapshots.end()) return;
+    pinned->second.recording->unpin();
+    mSnapshots.erase(pinned);
+    mMixer.releaseUnusedTracks();
 }
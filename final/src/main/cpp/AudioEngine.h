@@ -19,31 +19,321 @@
 
 #include <cstdint>
 #include <atomic>
+#include <condition_variable>
 #include <memory>
-#include <aaudio/AAudio.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "AudioBackend.h"
+#include "CallbackStats.h"
+#include "DiskWriter.h"
+#include "FullDuplexInput.h"
+#include "InputMeter.h"
+#include "LatencyTester.h"
+#include "LatencyTuner.h"
+#include "LockFreeQueue.h"
+#include "OnsetGate.h"
+#include "RealtimeThread.h"
+#include "Resampler.h"
+#include "SampleBlockPool.h"
 #include "SoundRecording.h"
+#include "TrackMixer.h"
+#include "TransportEvent.h"
+#include "WavFileReader.h"
+
+// Pass as a track index to refer to the take being recorded or imported, or otherwise the newest
+// track.
+constexpr int32_t kCurrentTakeIndex = -1;
 
 class AudioEngine {
 
 public:
-    void start();
+    explicit AudioEngine(std::unique_ptr<AudioBackend> backend) : mBackend(std::move(backend)) {};
+    ~AudioEngine();
+    /**
+     * In full-duplex mode the recording stream has no callback of its own. Instead the playback
+     * callback reads exactly the input it needs, so recording and playback happen in one thread
+     * and one burst.
+     */
+    void start(bool isFullDuplex = false);
     void stop();
+    // Asks the control thread to close and reopen the streams. Safe to call from any thread.
     void restart();
-    aaudio_data_callback_result_t recordingCallback(float *audioData, int32_t numFrames);
-    aaudio_data_callback_result_t playbackCallback(float *audioData, int32_t numFrames);
+    void onStreamError(AudioStream *stream, StreamError error);
+    CallbackResult recordingCallback(float *audioData, int32_t numFrames);
+    CallbackResult playbackCallback(void *audioData, int32_t numFrames);
+    /**
+     * Queue a transport change for the playback callback to apply at frameTime on the playback
+     * stream's frame timeline, or at kTransportNow or kTransportNextLoopBoundary. Safe to call from
+     * any thread apart from the audio callbacks.
+     *
+     * Playback and looping changes land on exactly the frame asked for. So do recording changes
+     * in full-duplex mode, where the input is processed in the same callback. Otherwise the
+     * recording callback picks them up on its next burst. While the streams are closed, for
+     * example during a restart, the control thread applies events which are already due.
+     *
+     * Returns false if the event was rejected: starting a take while one is in progress or an
+     * import is still running, stopping a take which wasn't started, AddTrack, which only the
+     * engine schedules, or a full queue.
+     */
+    bool scheduleTransportEvent(TransportAction action, int64_t frameTime);
+    // The number of frames the playback callback has rendered since the engine was created.
+    int64_t getPlaybackFramePosition() const;
+
+    // Shortcuts for scheduling an event now.
     void setRecording(bool isRecording);
     void setPlaying(bool isPlaying);
     void setLooping(bool isOn);
+    void setTrackGain(int32_t trackIndex, float gain);
+    void setTrackMuted(int32_t trackIndex, bool isMuted);
+    void setTrackLoopLength(int32_t trackIndex, int32_t numFrames);
+    int32_t getTrackCount() const;
+
+    /**
+     * Take history. Each take, and each clear, is a step which can be undone and redone while
+     * playing. Steps share their tracks, so undoing one costs no copying and no memory beyond
+     * the takes themselves. The oldest steps, then the ones which could be redone, are dropped
+     * once the takes they hold would go over the budget. None of these can be used while a take
+     * is being recorded or imported, when they return false.
+     */
+    bool clearTracks();
+    bool undoTake();
+    bool redoTake();
+    // Bytes of recorded audio the history may hold, kDefaultHistoryBudgetBytes by default.
+    void setTakeHistoryBudget(int64_t bytes);
+    TakeHistoryState getTakeHistoryState();
+    /**
+     * Summarise frames [startFrame, endFrame) of a track into numBins min, max and RMS bins for
+     * drawing its waveform, see SoundRecording::getPeaks(). Safe to call from any thread apart
+     * from the audio callbacks, including while the track is being recorded. Returns the number
+     * of bins written.
+     */
+    int32_t getTrackPeaks(int32_t trackIndex, int32_t startFrame, int32_t endFrame,
+                          int32_t numBins, PeakBin *bins);
+
+    /**
+     * Pin a read-only snapshot of the samples a track holds so far, so that they can be exported
+     * without copying them. Its memory is neither freed nor reused until the handle is passed to
+     * unpinSnapshot(), even if the track is cleared, and recording carries on as normal. Returns
+     * 0 if there's no such track. Snapshots must be unpinned before the engine is destroyed.
+     */
+    int64_t pinSnapshot(int32_t trackIndex);
+    /**
+     * Copy out the snapshot for a handle. Returns false if it isn't pinned. The blocks it points
+     * to stay valid until the handle is unpinned, which can happen on another thread as soon as
+     * this returns.
+     */
+    bool getSnapshot(int64_t handle, RecordingSnapshot &snapshot);
+    void unpinSnapshot(int64_t handle);
+
+    /**
+     * Keep enough memory ready to record a take this long without the audio thread touching a
+     * page for the first time. It's allocated and prefaulted, and locked where the system allows
+     * it, straight away if the engine is running or otherwise when it starts, and freed when it
+     * stops. 0 just keeps a few seconds ready.
+     */
+    void setRecordingCapacity(int32_t seconds);
+
+    /**
+     * Load a WAV file into a new track on a background thread, mixed down to mono and resampled
+     * to the engine's rate. The track is mixed in as soon as its first chunk has been decoded,
+     * so it can be played before the import finishes, but no take can start until it has. The
+     * engine must be started and no take can be in progress. Returns false if it isn't, or if
+     * the file can't be read.
+     */
+    bool importTrack(const char *path);
+    bool isImporting() const { return mIsImporting; };
+
+    /**
+     * Stream everything the recording stream captures to a mono WAV file in the given format,
+     * alongside any takes, until stopDiskCapture() is called or the engine stops. The file keeps
+     * the sample rate the engine had when it was opened. Returns false if the engine isn't
+     * started or the file can't be created.
+     */
+    bool startDiskCapture(const char *path, StorageFormat format);
+    // Finishes the file. Returns false if any of it couldn't be written.
+    bool stopDiskCapture();
+    DiskWriterStats getDiskCaptureStats() const { return mDiskWriter.getStats(); };
+
+    /**
+     * Have takes wait for the player rather than starting straight away. Once recording starts,
+     * input is only committed to the take from the first hop whose RMS level reaches threshold,
+     * along with preRollFrames of input from just before it. See OnsetGate. Returns false while
+     * a take is in progress, when the setting can't change.
+     */
+    bool setOnsetGate(bool isEnabled, float threshold, int32_t preRollFrames);
+    // Whether the take in progress is still waiting for the input to start.
+    bool isWaitingForOnset() const {
+        return mIsTakeInProgress && mOnsetGate.isWaitingForOnset();
+    };
+
+    // Float by default. Applies to takes started after the call, earlier ones keep their format.
+    void setStorageFormat(StorageFormat format);
+
+    // Float by default. Opening the playback stream in I16 avoids a conversion on devices whose
+    // audio HAL works in 16-bit. Takes effect the next time the engine is started.
+    void setPlaybackFormat(SampleFormat format);
+
+    // Open the streams on particular devices rather than the default route, so that several
+    // engines can run side by side on different hardware. kUnspecified for either follows the
+    // default. Takes effect the next time the engine is started.
+    void setDeviceIds(int32_t playbackDeviceId, int32_t recordingDeviceId);
+
+    // Takes effect the next time the streams are opened.
+    void setLatencyTunerPolicy(const LatencyTunerPolicy &policy);
+    LatencyTunerPolicy getLatencyTunerPolicy();
+    LatencyTunerState getLatencyTunerState() const { return mLatencyTuner.getState(); };
+
+    // Safe to call from any thread. Returns false if a consistent snapshot couldn't be read.
+    bool getCallbackStats(StreamDirection direction, CallbackStatsSnapshot &snapshot) const;
+
+    /**
+     * Restrict the callback threads to a set of CPUs, bit n for CPU n, such as the big cores from
+     * RealtimeThreadSetup::findFastestCpus(). 0 lets them run anywhere. Takes effect the next time
+     * the streams are opened.
+     */
+    void setCallbackCpuMask(uint64_t cpuMask);
+    // Returns false until the stream has called back. A full-duplex recording stream never does.
+    bool getCallbackThreadInfo(StreamDirection direction, RealtimeThreadInfo &info) const;
+
+    /**
+     * Peak, RMS and clip count of the input over its most recent ~20ms, measured whether or not
+     * a take is being recorded. Cheap enough to call at display rate from any thread apart from
+     * the audio callbacks.
+     */
+    MeterReading getInputLevels() { return mInputMeter.read(); };
+
+    // Time from the first disconnect to the streams being running again, for the last restart.
+    int64_t getLastRestartLatencyNanos() const;
+    int32_t getRestartCount() const;
+
+    /**
+     * Plays a test signal in place of the tracks and measures how long it takes to come back
+     * through the input. The engine must be started. Returns false if it isn't.
+     */
+    bool startLatencyMeasurement(LatencySignal signal);
+    // Returns false until the measurement has finished.
+    bool getLatencyResult(LatencyResult &result) const;
+
+    const FullDuplexInput &getFullDuplexInput() const { return mDuplexInput; };
+
+    // Used by the stream callbacks to time themselves.
+    CallbackStats &getRecordingStats() { return mRecordingStats; };
+    CallbackStats &getPlaybackStats() { return mPlaybackStats; };
+    // Used by the stream callbacks to set up their threads on the first callback.
+    RealtimeThreadSetup &getRecordingThreadSetup() { return mRecordingThreadSetup; };
+    RealtimeThreadSetup &getPlaybackThreadSetup() { return mPlaybackThreadSetup; };
 
 private:
+    std::unique_ptr<AudioBackend> mBackend;
     std::atomic<bool> mIsRecording = {false};
     std::atomic<bool> mIsPlaying = {false};
-    SoundRecording mSoundRecording;
-    AAudioStream* mPlaybackStream = nullptr;
-    AAudioStream* mRecordingStream = nullptr;
+    SampleBlockPool mBlockPool;
+    TrackMixer mMixer { mBlockPool };
+    // The track the current take is recorded into, nullptr once it's been added or cancelled.
+    // Only written to while mIsRecording is true.
+    std::atomic<Track *> mRecordingTrack { nullptr };
+    // Set when a take is prepared and cleared by the playback callback once it has been added.
+    std::atomic<bool> mIsTakeInProgress { false };
+
+    // Transport events go from any thread, one at a time, to the playback callback, which keeps
+    // the ones that aren't due yet in mPendingEvents.
+    std::mutex mTransportLock;
+    bool mIsTakeScheduled = false;
+    LockFreeQueue<TransportEvent, kTransportQueueCapacity> mTransportQueue;
+    std::array<TransportEvent, kTransportQueueCapacity> mPendingEvents;
+    int32_t mPendingEventCount = 0;
+    std::atomic<int64_t> mPlaybackFramePosition { 0 };
+    // Pinned snapshots by handle. Guarded by mTransportLock, like the tracks they pin.
+    struct PinnedSnapshot {
+        SoundRecording *recording;
+        RecordingSnapshot snapshot;
+    };
+    std::unordered_map<int64_t, PinnedSnapshot> mSnapshots;
+    int64_t mLastSnapshotHandle = 0;
+    std::unique_ptr<AudioStream> mPlaybackStream;
+    SampleFormat mRequestedPlaybackFormat = SampleFormat::Float;
+    SampleFormat mPlaybackFormat = SampleFormat::Float;
+    int32_t mPlaybackChannelCount = kChannelCountStereo;
+    std::unique_ptr<AudioStream> mRecordingStream;
+    bool mIsFullDuplex = false;
+    FullDuplexInput mDuplexInput;
+    std::array<float, kMixBufferFrames> mDuplexInputBuffer;
+    // Input frames, times the output rate, owed to the next read when the rates differ.
+    int64_t mDuplexInputRemainder = 0;
+    // Only set when the recording stream didn't get the playback stream's sample rate.
+    std::unique_ptr<Resampler> mInputResampler;
+    std::array<float, kMixBufferFrames> mResampledInputBuffer;
+    LatencyTester mLatencyTester;
+    DiskWriter mDiskWriter;
+    InputMeter mInputMeter;
+    // Armed when a take is prepared and only touched by the recording callback while the take is
+    // in progress.
+    OnsetGate mOnsetGate;
+    // Imports run one at a time on their own thread, writing into a prepared take.
+    std::thread mImportThread;
+    std::atomic<bool> mIsImporting { false };
+    std::unique_ptr<WavFileReader> mImportFile;
+    // Set under mTransportLock until the import thread has finished with the track, whether or
+    // not it has been added.
+    Track *mImportTrack = nullptr;
+    std::atomic<LatencySignal> mRequestedLatencySignal { LatencySignal::Mls };
+    std::array<float, kMixBufferFrames> mLatencySignalBuffer;
+    LatencyTuner mLatencyTuner;
+    int32_t mRecordingCapacitySeconds = 0;
+    LatencyTunerPolicy mRequestedTunerPolicy;
+    CallbackStats mRecordingStats;
+    CallbackStats mPlaybackStats;
+    RealtimeThreadSetup mRecordingThreadSetup;
+    RealtimeThreadSetup mPlaybackThreadSetup;
+
+    // Stream lifecycle. start(), stop() and restarts on the control thread all hold
+    // mLifecycleLock while they open or close streams.
+    std::mutex mLifecycleLock;
+    bool mIsStarted = false;
+    std::atomic<AudioStream *> mActivePlaybackStream { nullptr };
+    std::atomic<AudioStream *> mActiveRecordingStream { nullptr };
+    SampleFormat mLastPlaybackFormat = SampleFormat::Float;
+    int32_t mLastPlaybackChannelCount = kChannelCountStereo;
+    int32_t mLastPlaybackSampleRate = kUnspecified;
+    int32_t mPlaybackDeviceId = kUnspecified;
+    int32_t mRecordingDeviceId = kUnspecified;
+    uint64_t mCallbackCpuMask = 0;
+
+    // A long-lived thread which handles requests from callbacks that can't do the work
+    // themselves, such as restarting the streams after a disconnect.
+    std::thread mControlThread;
+    std::mutex mControlLock;
+    std::condition_variable mControlCondition;
+    std::atomic<uint32_t> mPendingCommands { 0 };
+    std::atomic<int64_t> mDisconnectTimeNanos { 0 };
+    std::atomic<int64_t> mLastRestartLatencyNanos { 0 };
+    std::atomic<int32_t> mRestartCount { 0 };
 
-    void stopStream(AAudioStream *stream) const;
-    void closeStream(AAudioStream **stream) const;
+    void postCommand(uint32_t command);
+    void runControlThread();
+    void restartStreams();
+    void reserveRecordingMemory();
+    void runImport(int32_t sampleRate);
+    bool storeImportedFrames(SoundRecording &recording, const float *frames, int32_t numFrames);
+    bool scheduleImportedTrack();
+    void prepareLatencyMeasurement();
+    // Only called under mTransportLock, which keeps the track alive.
+    Track *findTrack(int32_t trackIndex);
+    void storeInput(const float *audioData, int32_t numFrames);
+    void renderLatencySignal(void *audioData, int32_t numFrames);
+    void renderFrames(void *audioData, int32_t numFrames);
+    void takeTransportEvents();
+    void resolveLoopBoundary();
+    int32_t getFramesUntilNextTransportEvent(int32_t maxFrames) const;
+    void applyDueTransportEvents();
+    void drainTransportEventsIfStopped();
+    // Only called under mLifecycleLock while the playback stream is closed.
+    void drainTransportEvents();
+    void openStreams();
+    void closeStreams();
+    void stopStream(AudioStream *stream) const;
+    void closeStream(std::unique_ptr<AudioStream> &stream) const;
 };
 
 #endif //WAVEMAKER2_AUDIOENGINE_H
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CallbackStats.h"
+
+namespace {
+
+int32_t getHistogramBin(int64_t durationNanos) {
+    int64_t micros = durationNanos / 1000;
+    int32_t bin = 0;
+    while (micros > 0 && bin < kCallbackHistogramBins - 1) {
+        micros >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+// Only the callback writes the stats, so it can update them with a plain load and store instead
+// of a read-modify-write.
+template <typename T>
+void add(std::atomic<T> &value, T amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void CallbackStats::record(int64_t durationNanos, int32_t numFrames, AudioStream *stream) {
+
+    const uint32_t sequence = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    add<int64_t>(mCallbackCount, 1);
+    add<int64_t>(mFrameCount, numFrames);
+    add<int64_t>(mTotalNanos, durationNanos);
+    add<int64_t>(mHistogram[getHistogramBin(durationNanos)], 1);
+    mLastNanos.store(durationNanos, std::memory_order_relaxed);
+    if (durationNanos > mMaxNanos.load(std::memory_order_relaxed)) {
+        mMaxNanos.store(durationNanos, std::memory_order_relaxed);
+    }
+    if (stream != nullptr) {
+        mXRunCount.store(stream->getXRunCount(), std::memory_order_relaxed);
+        mBufferSizeInFrames.store(stream->getBufferSizeInFrames(), std::memory_order_relaxed);
+    }
+
+    mSequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool CallbackStats::readSnapshot(CallbackStatsSnapshot &snapshot) const {
+
+    constexpr int kMaxAttempts = 16;
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+        const uint32_t sequence = mSequence.load(std::memory_order_acquire);
+        if (sequence & 1) continue;
+
+        snapshot.callbackCount = mCallbackCount.load(std::memory_order_relaxed);
+        snapshot.frameCount = mFrameCount.load(std::memory_order_relaxed);
+        snapshot.totalNanos = mTotalNanos.load(std::memory_order_relaxed);
+        snapshot.lastNanos = mLastNanos.load(std::memory_order_relaxed);
+        snapshot.maxNanos = mMaxNanos.load(std::memory_order_relaxed);
+        snapshot.xRunCount = mXRunCount.load(std::memory_order_relaxed);
+        snapshot.bufferSizeInFrames = mBufferSizeInFrames.load(std::memory_order_relaxed);
+        for (int32_t i = 0; i < kCallbackHistogramBins; ++i) {
+            snapshot.histogram[i] = mHistogram[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mSequence.load(std::memory_order_relaxed) == sequence) return true;
+    }
+    return false;
+}
+
+void CallbackStats::reset() {
+
+    mCallbackCount = 0;
+    mFrameCount = 0;
+    mTotalNanos = 0;
+    mLastNanos = 0;
+    mMaxNanos = 0;
+    mXRunCount = 0;
+    mBufferSizeInFrames = 0;
+    for (std::atomic<int64_t> &count : mHistogram) count = 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_CALLBACKSTATS_H
+#define WAVEMAKER2_CALLBACKSTATS_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include "AudioBackend.h"
+
+// Set WAVEMAKER2_CALLBACK_STATS to 0 to compile the callback instrumentation out entirely.
+#ifndef WAVEMAKER2_CALLBACK_STATS
+#define WAVEMAKER2_CALLBACK_STATS 1
+#endif
+
+// Bin 0 counts callbacks which took under 1us, bin i counts those which took 2^(i-1) to 2^i us.
+// The last bin also counts anything slower than that.
+constexpr int32_t kCallbackHistogramBins = 24;
+
+struct CallbackStatsSnapshot {
+    int64_t callbackCount = 0;
+    int64_t frameCount = 0;
+    int64_t totalNanos = 0;
+    int64_t lastNanos = 0;
+    int64_t maxNanos = 0;
+    int32_t xRunCount = 0;
+    int32_t bufferSizeInFrames = 0;
+    std::array<int64_t, kCallbackHistogramBins> histogram {};
+};
+
+/**
+ * Callback durations and stream state for one stream, written by its callback and read from any
+ * other thread.
+ *
+ * record() never allocates or blocks. Readers use a sequence lock: the sequence number is odd
+ * while record() is updating the fields, so a reader which sees it change, or sees it odd, knows
+ * its copy may be torn and tries again.
+ */
+class CallbackStats {
+
+public:
+    void record(int64_t durationNanos, int32_t numFrames, AudioStream *stream);
+    // Returns false if the callback kept updating the stats for too long to get a clean copy.
+    bool readSnapshot(CallbackStatsSnapshot &snapshot) const;
+    // Only call this while the stream isn't running.
+    void reset();
+
+private:
+    std::atomic<uint32_t> mSequence { 0 };
+    std::atomic<int64_t> mCallbackCount { 0 };
+    std::atomic<int64_t> mFrameCount { 0 };
+    std::atomic<int64_t> mTotalNanos { 0 };
+    std::atomic<int64_t> mLastNanos { 0 };
+    std::atomic<int64_t> mMaxNanos { 0 };
+    std::atomic<int32_t> mXRunCount { 0 };
+    std::atomic<int32_t> mBufferSizeInFrames { 0 };
+    std::array<std::atomic<int64_t>, kCallbackHistogramBins> mHistogram {};
+};
+
+/**
+ * Times a callback from construction to destruction and records it in a CallbackStats.
+ */
+#if WAVEMAKER2_CALLBACK_STATS
+
+class ScopedCallbackTimer {
+
+public:
+    ScopedCallbackTimer(CallbackStats &stats, AudioStream *stream, int32_t numFrames)
+            : mStats(stats), mStream(stream), mNumFrames(numFrames),
+              mStartTime(std::chrono::steady_clock::now()) {};
+
+    ~ScopedCallbackTimer() {
+        const auto duration = std::chrono::steady_clock::now() - mStartTime;
+        mStats.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                      mNumFrames, mStream);
+    }
+
+private:
+    CallbackStats &mStats;
+    AudioStream *mStream;
+    int32_t mNumFrames;
+    std::chrono::steady_clock::time_point mStartTime;
+};
+
+#else
+
+class ScopedCallbackTimer {
+
+public:
+    ScopedCallbackTimer(CallbackStats &, AudioStream *, int32_t) {};
+};
+
+#endif
+
+#endif //WAVEMAKER2_CALLBACKSTATS_H
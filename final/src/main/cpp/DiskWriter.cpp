@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "DiskWriter.h"
+#include "Logging.h"
+#include "SoundRecordingUtilities.h"
+
+namespace {
+
+static_assert((kDiskRingSamples & (kDiskRingSamples - 1)) == 0, "Ring size must be a power of two");
+constexpr uint64_t kRingMask = kDiskRingSamples - 1;
+
+// The ring holds seconds of audio, so the writer can sleep for a while between checks.
+constexpr auto kDiskPollInterval = std::chrono::milliseconds(10);
+
+void encode(const float *source, uint8_t *target, int32_t numSamples, StorageFormat format) {
+    switch (format) {
+        case StorageFormat::I16:
+            convertArrayFloatToInt16(source, reinterpret_cast<int16_t *>(target), numSamples);
+            break;
+        case StorageFormat::Packed24:
+            convertArrayFloatToPacked24(source, target, numSamples);
+            break;
+        case StorageFormat::Float:
+        default:
+            memcpy(target, source, numSamples * sizeof(float));
+            break;
+    }
+}
+
+} // namespace
+
+bool DiskWriter::open(const char *path, int32_t sampleRate, int32_t channelCount,
+                      StorageFormat format) {
+
+    close();
+    mFile = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFile < 0) {
+        LOGE("Couldn't create %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    mFormat = format;
+    mChannelCount = channelCount;
+    mInfo = WavInfo();
+    mInfo.formatTag = (format == StorageFormat::Float) ? kWavFormatIeeeFloat : kWavFormatPcm;
+    mInfo.channelCount = static_cast<uint16_t>(channelCount);
+    mInfo.sampleRate = static_cast<uint32_t>(sampleRate);
+    mInfo.bitsPerSample = static_cast<uint16_t>(getBytesPerSample(format) * 8);
+    mOverflowFrameCount = 0;
+    mFramesWritten = 0;
+    mErrorCount = 0;
+
+    uint8_t header[kWavHeaderSize];
+    mHeaderSize = makeWavHeader(mInfo, header);
+    if (!writeAt(header, mHeaderSize, 0)) {
+        ::close(mFile);
+        mFile = -1;
+        return false;
+    }
+    mEncodeBuffer.resize(kDiskWriteBlockSamples * getBytesPerSample(format));
+
+    // Skip anything the last file didn't take. Only write() moves the write counter, so the ring
+    // is never reset.
+    mRingReadCounter.store(mRingWriteCounter.load(std::memory_order_acquire),
+                           std::memory_order_release);
+    mIsWriting = true;
+    mWriterThread = std::thread([this](){
+        while (mIsWriting) {
+            drain(false);
+            std::this_thread::sleep_for(kDiskPollInterval);
+        }
+    });
+    mIsOpen.store(true, std::memory_order_release);
+    return true;
+}
+
+bool DiskWriter::close() {
+
+    if (mFile < 0) return true;
+
+    // A write() which saw the file open just before this may still land in the ring, and will be
+    // written if it arrives before the final drain.
+    mIsOpen.store(false, std::memory_order_release);
+    mIsWriting = false;
+    if (mWriterThread.joinable()) mWriterThread.join();
+    drain(true);
+
+    mInfo.dataSize = static_cast<uint64_t>(mFramesWritten) * mInfo.getBytesPerFrame();
+    uint8_t header[kWavHeaderSize];
+    makeWavHeader(mInfo, header);
+    writeAt(header, mHeaderSize, 0);
+    if (::close(mFile) != 0) {
+        LOGE("Couldn't close the file: %s", strerror(errno));
+        mErrorCount++;
+    }
+    mFile = -1;
+    LOGD("Wrote %lld frames, dropped %lld", static_cast<long long>(mFramesWritten.load()),
+         static_cast<long long>(mOverflowFrameCount.load()));
+    return mErrorCount == 0;
+}
+
+int32_t DiskWriter::write(const float *audioData, int32_t numFrames) {
+
+    if (!isOpen()) return 0;
+
+    const uint64_t writeCounter = mRingWriteCounter.load(std::memory_order_relaxed);
+    const auto freeSamples = static_cast<int32_t>(
+            kDiskRingSamples - (writeCounter - mRingReadCounter.load(std::memory_order_acquire)));
+    const int32_t framesQueued = std::min(numFrames, freeSamples / mChannelCount);
+    const int32_t numSamples = framesQueued * mChannelCount;
+
+    // Copy in two parts if the ring wraps.
+    const auto start = static_cast<int32_t>(writeCounter & kRingMask);
+    const int32_t firstPart = std::min(numSamples, kDiskRingSamples - start);
+    memcpy(&mRing[start], audioData, firstPart * sizeof(float));
+    memcpy(&mRing[0], &audioData[firstPart], (numSamples - firstPart) * sizeof(float));
+    mRingWriteCounter.store(writeCounter + numSamples, std::memory_order_release);
+
+    if (framesQueued < numFrames) {
+        mOverflowFrameCount.fetch_add(numFrames - framesQueued, std::memory_order_relaxed);
+    }
+    return framesQueued;
+}
+
+DiskWriterStats DiskWriter::getStats() const {
+
+    DiskWriterStats stats;
+    stats.framesWritten = mFramesWritten;
+    stats.overflowFrameCount = mOverflowFrameCount;
+    stats.errorCount = mErrorCount;
+    return stats;
+}
+
+void DiskWriter::drain(bool isFinal) {
+
+    const int32_t blockSamples = kDiskWriteBlockSamples / mChannelCount * mChannelCount;
+    const int32_t bytesPerSample = getBytesPerSample(mFormat);
+    for (;;) {
+        const uint64_t readCounter = mRingReadCounter.load(std::memory_order_relaxed);
+        const auto available = static_cast<int32_t>(
+                mRingWriteCounter.load(std::memory_order_acquire) - readCounter);
+        if (available == 0 || (available < blockSamples && !isFinal)) return;
+
+        // Encode straight out of the ring, which frees the space for the callback before the
+        // slow part.
+        const int32_t numSamples = std::min(available, blockSamples);
+        const auto start = static_cast<int32_t>(readCounter & kRingMask);
+        const int32_t firstPart = std::min(numSamples, kDiskRingSamples - start);
+        encode(&mRing[start], mEncodeBuffer.data(), firstPart, mFormat);
+        encode(&mRing[0], &mEncodeBuffer[firstPart * bytesPerSample], numSamples - firstPart,
+               mFormat);
+        mRingReadCounter.store(readCounter + numSamples, std::memory_order_release);
+
+        // A block which can't be written is lost, and the next one takes its place.
+        const uint64_t offset = mHeaderSize +
+                static_cast<uint64_t>(mFramesWritten) * mInfo.getBytesPerFrame();
+        if (writeAt(mEncodeBuffer.data(), static_cast<size_t>(numSamples) * bytesPerSample,
+                    offset)) {
+            mFramesWritten += numSamples / mChannelCount;
+        }
+    }
+}
+
+bool DiskWriter::writeAt(const uint8_t *data, size_t size, uint64_t offset) {
+
+    while (size > 0) {
+        const ssize_t bytesWritten = pwrite64(mFile, data, size, static_cast<off64_t>(offset));
+        if (bytesWritten < 0) {
+            if (errno == EINTR) continue;
+            LOGE("Couldn't write to the file: %s", strerror(errno));
+            mErrorCount++;
+            return false;
+        }
+        data += bytesWritten;
+        size -= bytesWritten;
+        offset += bytesWritten;
+    }
+    return true;
+}
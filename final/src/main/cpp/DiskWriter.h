@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_DISKWRITER_H
+#define WAVEMAKER2_DISKWRITER_H
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "SoundRecording.h"
+#include "WavFormat.h"
+
+constexpr int32_t kDiskRingSamples = 1 << 18; // ~5.5s of mono audio @ 48kHz
+// Samples per write to the file. In every format that's a multiple of 4096 bytes, so with the
+// header padded to kWavHeaderSize every full block is written at an aligned offset as long as the
+// channel count is a power of two.
+constexpr int32_t kDiskWriteBlockSamples = 16384;
+
+struct DiskWriterStats {
+    int64_t framesWritten = 0;
+    // Frames dropped because the writer thread fell so far behind that the ring filled up.
+    int64_t overflowFrameCount = 0;
+    int32_t errorCount = 0;
+};
+
+/**
+ * Streams audio from the recording callback to a WAV file.
+ *
+ * write() copies frames into a lock-free ring and returns straight away. A writer thread drains
+ * the ring in blocks of kDiskWriteBlockSamples, encoding them in the file's sample format, with
+ * one pwrite() per block. The header is written with a length of 0 when the file is opened and
+ * patched with the real length when it's closed, switching to RF64 if the file has outgrown
+ * RIFF's 4GB limit.
+ */
+class DiskWriter {
+
+public:
+    DiskWriter() : mRing(kDiskRingSamples) {};
+    ~DiskWriter() { close(); };
+
+    // Not safe to call from the audio callbacks. Returns false if the file can't be created.
+    bool open(const char *path, int32_t sampleRate, int32_t channelCount, StorageFormat format);
+    /**
+     * Drains the ring, patches the header and closes the file. Not safe to call from the audio
+     * callbacks. Returns false if anything couldn't be written.
+     */
+    bool close();
+    bool isOpen() const { return mIsOpen.load(std::memory_order_acquire); };
+
+    /**
+     * Recording callback only. Queue interleaved frames to be written. Frames which don't fit
+     * in the ring are dropped and counted. Returns the number of frames queued.
+     */
+    int32_t write(const float *audioData, int32_t numFrames);
+
+    DiskWriterStats getStats() const;
+
+private:
+    std::vector<float> mRing;
+    // Samples written to and read from the ring since it was created. Only write() moves the
+    // write counter and only the writer thread moves the read counter.
+    std::atomic<uint64_t> mRingWriteCounter { 0 };
+    std::atomic<uint64_t> mRingReadCounter { 0 };
+    std::atomic<bool> mIsOpen { false };
+    std::atomic<int64_t> mOverflowFrameCount { 0 };
+    std::atomic<int64_t> mFramesWritten { 0 };
+    std::atomic<int32_t> mErrorCount { 0 };
+
+    // Owned by whichever of open(), the writer thread and close() is running.
+    int mFile = -1;
+    WavInfo mInfo;
+    size_t mHeaderSize = 0;
+    int32_t mChannelCount = 1;
+    StorageFormat mFormat = StorageFormat::Float;
+    std::vector<uint8_t> mEncodeBuffer;
+    std::thread mWriterThread;
+    std::atomic<bool> mIsWriting { false };
+
+    // Writes complete blocks, and the partial one at the end too if isFinal is set.
+    void drain(bool isFinal);
+    bool writeAt(const uint8_t *data, size_t size, uint64_t offset);
+};
+
+#endif //WAVEMAKER2_DISKWRITER_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_FRAMERENDERER_H
+#define WAVEMAKER2_FRAMERENDERER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "AudioBackend.h"
+#include "Definitions.h"
+#include "SoundRecording.h"
+#include "SoundRecordingUtilities.h"
+
+// Writes mono samples into an interleaved output buffer of CHANNEL_COUNT channels, converting
+// them to the output sample type on the way. Overloads cover the layouts we open streams with and
+// the generic template handles any other channel count.
+
+template <int CHANNEL_COUNT>
+void writeMonoFrames(const float *source, float *target, int32_t numFrames,
+                     std::integral_constant<int, CHANNEL_COUNT>) {
+    for (int i = 0; i < numFrames; ++i) {
+        for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+            target[(i * CHANNEL_COUNT) + channel] = source[i];
+        }
+    }
+}
+
+inline void writeMonoFrames(const float *source, float *target, int32_t numFrames,
+                            std::integral_constant<int, kChannelCountMono>) {
+    memcpy(target, source, numFrames * sizeof(float));
+}
+
+inline void writeMonoFrames(const float *source, float *target, int32_t numFrames,
+                            std::integral_constant<int, kChannelCountStereo>) {
+    interleaveStereo(source, source, target, numFrames);
+}
+
+template <int CHANNEL_COUNT>
+void writeMonoFrames(const float *source, int16_t *target, int32_t numFrames,
+                     std::integral_constant<int, CHANNEL_COUNT>) {
+
+    if (CHANNEL_COUNT == kChannelCountMono) {
+        convertArrayFloatToInt16(source, target, numFrames);
+        return;
+    }
+
+    // Convert a chunk at a time on the stack, then copy each sample to every channel.
+    constexpr int32_t kChunkFrames = 256;
+    int16_t converted[kChunkFrames];
+    for (int32_t start = 0; start < numFrames; start += kChunkFrames) {
+        const int32_t chunkFrames = std::min(kChunkFrames, numFrames - start);
+        convertArrayFloatToInt16(&source[start], converted, chunkFrames);
+        int16_t *chunkTarget = &target[start * CHANNEL_COUNT];
+        for (int i = 0; i < chunkFrames; ++i) {
+            for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+                chunkTarget[(i * CHANNEL_COUNT) + channel] = converted[i];
+            }
+        }
+    }
+}
+
+// For callers which only know the stream's format at run time. Mono and stereo are supported.
+inline void writeMonoFrames(const float *source, void *target, int32_t numFrames,
+                            SampleFormat format, int32_t channelCount) {
+    if (format == SampleFormat::I16) {
+        if (channelCount == kChannelCountMono) {
+            writeMonoFrames(source, static_cast<int16_t *>(target), numFrames,
+                            std::integral_constant<int, kChannelCountMono>());
+        } else {
+            writeMonoFrames(source, static_cast<int16_t *>(target), numFrames,
+                            std::integral_constant<int, kChannelCountStereo>());
+        }
+    } else {
+        if (channelCount == kChannelCountMono) {
+            writeMonoFrames(source, static_cast<float *>(target), numFrames,
+                            std::integral_constant<int, kChannelCountMono>());
+        } else {
+            writeMonoFrames(source, static_cast<float *>(target), numFrames,
+                            std::integral_constant<int, kChannelCountStereo>());
+        }
+    }
+}
+
+/**
+ * Render numFrames of the recording into an interleaved buffer in a single pass, reading straight
+ * from the recording's storage. Only the frames after the end of the recording are zeroed.
+ *
+ * @return the number of frames read from the recording
+ */
+template <int CHANNEL_COUNT, typename SampleType>
+int32_t renderRecording(SoundRecording &recording, SampleType *audioData, int32_t numFrames) {
+
+    static_assert(std::is_same<SampleType, float>::value ||
+                  std::is_same<SampleType, int16_t>::value, "Unsupported output sample type");
+
+    const int32_t framesRead = recording.readSegments(numFrames,
+            [audioData](const float *samples, int32_t offset, int32_t length){
+        writeMonoFrames(samples, &audioData[offset * CHANNEL_COUNT], length,
+                        std::integral_constant<int, CHANNEL_COUNT>());
+    });
+
+    memset(&audioData[framesRead * CHANNEL_COUNT], 0,
+           (numFrames - framesRead) * CHANNEL_COUNT * sizeof(SampleType));
+    return framesRead;
+}
+
+#endif //WAVEMAKER2_FRAMERENDERER_H
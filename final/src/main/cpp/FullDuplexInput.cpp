@@ -0,0 +1,69 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "FullDuplexInput.h"
+
+void FullDuplexInput::reset() {
+
+    mPrimingCallbacksRemaining = kDuplexPrimingCallbacks;
+    mUnderflowCount = 0;
+    mPaddedFrameCount = 0;
+    mDroppedFrameCount = 0;
+}
+
+int32_t FullDuplexInput::read(AudioStream &input, float *buffer, int32_t numFrames) {
+
+    if (mPrimingCallbacksRemaining > 0) {
+        mPrimingCallbacksRemaining--;
+        discard(input, input.getFramesAvailable());
+        memset(buffer, 0, numFrames * sizeof(float));
+        return 0;
+    }
+
+    int32_t framesRead = std::max(0, input.read(buffer, numFrames, 0));
+    if (framesRead < numFrames) {
+        memset(&buffer[framesRead], 0, (numFrames - framesRead) * sizeof(float));
+        mUnderflowCount.store(mUnderflowCount.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        mPaddedFrameCount.store(mPaddedFrameCount.load(std::memory_order_relaxed) +
+                                numFrames - framesRead, std::memory_order_relaxed);
+    }
+
+    const int32_t maxBacklog = std::max(numFrames, input.getFramesPerBurst());
+    const int32_t backlog = input.getFramesAvailable();
+    if (backlog > maxBacklog) {
+        const int32_t dropped = discard(input, backlog - (maxBacklog / 2));
+        mDroppedFrameCount.store(mDroppedFrameCount.load(std::memory_order_relaxed) + dropped,
+                                 std::memory_order_relaxed);
+    }
+    return framesRead;
+}
+
+int32_t FullDuplexInput::discard(AudioStream &input, int32_t numFrames) {
+
+    int32_t framesDiscarded = 0;
+    while (framesDiscarded < numFrames) {
+        const int32_t chunkFrames = std::min(kDuplexDiscardChunkFrames,
+                                             numFrames - framesDiscarded);
+        const int32_t framesRead = input.read(mDiscardBuffer, chunkFrames, 0);
+        if (framesRead <= 0) break;
+        framesDiscarded += framesRead;
+    }
+    return framesDiscarded;
+}
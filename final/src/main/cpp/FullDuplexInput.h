@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_FULLDUPLEXINPUT_H
+#define WAVEMAKER2_FULLDUPLEXINPUT_H
+
+#include <cstdint>
+#include <atomic>
+
+#include "AudioBackend.h"
+
+// Callbacks spent draining the input before its frames are used, so that whatever built up while
+// the streams were starting doesn't become permanent latency.
+constexpr int32_t kDuplexPrimingCallbacks = 4;
+constexpr int32_t kDuplexDiscardChunkFrames = 256;
+
+/**
+ * Pulls mono float input from inside the output callback with non-blocking reads.
+ *
+ * The input and output clocks drift apart. If the input runs slow the missing frames are padded
+ * with silence. If it runs fast the backlog grows, so once more than one callback's worth of
+ * frames is left unread after a read, the oldest frames are dropped to bring it back down to half
+ * of that.
+ */
+class FullDuplexInput {
+
+public:
+    // Call before the output stream starts.
+    void reset();
+
+    /**
+     * Fill buffer with numFrames of input, padding with zeros if there isn't enough.
+     *
+     * @return the number of frames of real input in the buffer
+     */
+    int32_t read(AudioStream &input, float *buffer, int32_t numFrames);
+
+    int64_t getUnderflowCount() const { return mUnderflowCount; };
+    int64_t getPaddedFrameCount() const { return mPaddedFrameCount; };
+    int64_t getDroppedFrameCount() const { return mDroppedFrameCount; };
+
+private:
+    int32_t mPrimingCallbacksRemaining = kDuplexPrimingCallbacks;
+    float mDiscardBuffer[kDuplexDiscardChunkFrames];
+    std::atomic<int64_t> mUnderflowCount { 0 };
+    std::atomic<int64_t> mPaddedFrameCount { 0 };
+    std::atomic<int64_t> mDroppedFrameCount { 0 };
+
+    int32_t discard(AudioStream &input, int32_t numFrames);
+};
+
+#endif //WAVEMAKER2_FULLDUPLEXINPUT_H
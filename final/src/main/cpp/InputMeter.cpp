@@ -0,0 +1,44 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "InputMeter.h"
+
+void InputMeter::add(const SignalLevels &levels) {
+
+    mWindow.peak = std::max(mWindow.peak, levels.peak);
+    mWindow.sumOfSquares += levels.sumOfSquares;
+    mWindow.clipCount += levels.clipCount;
+    mWindow.numSamples += levels.numSamples;
+    mTotalClipCount += levels.clipCount;
+    mFramePosition += levels.numSamples;
+    if (mWindow.numSamples < kMeterWindowFrames) return;
+
+    MeterReading &reading = mReadings.getBackBuffer();
+    reading.peak = mWindow.peak;
+    reading.rms = sqrtf(mWindow.sumOfSquares / mWindow.numSamples);
+    reading.clipCount = mWindow.clipCount;
+    reading.totalClipCount = mTotalClipCount;
+    reading.framePosition = mFramePosition;
+    mReadings.publish();
+    mWindow = SignalLevels();
+}
+
+MeterReading InputMeter::read() {
+    std::lock_guard<std::mutex> lock(mReadLock);
+    return mReadings.read();
+}
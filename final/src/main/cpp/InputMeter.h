@@ -0,0 +1,61 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WAVEMAKER2_INPUTMETER_H
+#define WAVEMAKER2_INPUTMETER_H
+
+#include <cstdint>
+#include <mutex>
+
+#include "SoundRecordingUtilities.h"
+#include "TripleBuffer.h"
+
+// Long enough that a display polling at 60Hz misses little, ~21ms @ 48kHz.
+constexpr int32_t kMeterWindowFrames = 1024;
+
+struct MeterReading {
+    // Linear levels over the most recent complete window.
+    float peak = 0;
+    float rms = 0;
+    int32_t clipCount = 0;
+    // Clipped samples since the engine was created, so that no clip goes unseen however rarely
+    // the meter is read.
+    int64_t totalClipCount = 0;
+    // Input frames measured since the engine was created, up to the end of the window.
+    int64_t framePosition = 0;
+};
+
+/**
+ * Collects the levels the recording callback measures into fixed windows and publishes each one
+ * as it completes. Reading never blocks the callback.
+ */
+class InputMeter {
+
+public:
+    // Recording callback only.
+    void add(const SignalLevels &levels);
+    // Safe to call from any thread apart from the audio callbacks.
+    MeterReading read();
+
+private:
+    SignalLevels mWindow;
+    int64_t mTotalClipCount = 0;
+    int64_t mFramePosition = 0;
+    TripleBuffer<MeterReading> mReadings;
+    // The triple buffer has a single reader, so callers take turns.
+    std::mutex mReadLock;
+};
+
+#endif //WAVEMAKER2_INPUTMETER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+#include "LatencyAnalyzer.h"
+
+namespace {
+
+using Complex = std::complex<double>;
+
+// In-place iterative radix-2 FFT. The size of data must be a power of two.
+void fft(std::vector<Complex> &data, bool isInverse) {
+
+    const size_t size = data.size();
+    for (size_t i = 1, j = 0; i < size; ++i) {
+        size_t bit = size >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+
+    for (size_t length = 2; length <= size; length <<= 1) {
+        const double angle = 2 * M_PI / length * (isInverse ? 1 : -1);
+        const Complex step(cos(angle), sin(angle));
+        for (size_t start = 0; start < size; start += length) {
+            Complex twiddle(1);
+            for (size_t k = 0; k < length / 2; ++k) {
+                const Complex even = data[start + k];
+                const Complex odd = data[start + k + length / 2] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + length / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+
+    if (isInverse) {
+        for (Complex &value : data) value /= static_cast<double>(size);
+    }
+}
+
+size_t nextPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) power <<= 1;
+    return power;
+}
+
+} // namespace
+
+std::vector<float> generateMls(int32_t order, float amplitude) {
+
+    // Feedback taps of a primitive polynomial for each order, from Xilinx XAPP 052.
+    static const uint32_t kTaps[][4] = {
+            {10, 7, 0, 0},
+            {11, 9, 0, 0},
+            {12, 6, 4, 1},
+            {13, 4, 3, 1},
+            {14, 5, 3, 1},
+            {15, 14, 0, 0},
+            {16, 15, 13, 4},
+    };
+    order = std::max(10, std::min(order, 16));
+    const uint32_t *taps = kTaps[order - 10];
+
+    const int32_t length = (1 << order) - 1;
+    std::vector<float> sequence(length);
+    uint32_t state = 1;
+    for (int32_t i = 0; i < length; ++i) {
+        sequence[i] = (state & 1) ? amplitude : -amplitude;
+        uint32_t feedback = 0;
+        for (int tap = 0; tap < 4 && taps[tap] != 0; ++tap) {
+            feedback ^= state >> (order - taps[tap]);
+        }
+        state = (state >> 1) | ((feedback & 1) << (order - 1));
+    }
+    return sequence;
+}
+
+std::vector<float> generateImpulse(int32_t numSamples, float amplitude) {
+
+    std::vector<float> impulse(std::max(numSamples, 1), 0.0f);
+    impulse[0] = amplitude;
+    return impulse;
+}
+
+LatencyResult findDelay(const float *signal, int32_t signalLength,
+                        const float *recording, int32_t recordingLength,
+                        int32_t sampleRate) {
+
+    LatencyResult result;
+    if (signalLength <= 0 || recordingLength < signalLength || sampleRate <= 0) return result;
+
+    // Correlate in the frequency domain: corr = IFFT(FFT(recording) * conj(FFT(signal))). Padding
+    // to at least the sum of the lengths stops the correlation wrapping around.
+    const size_t size = nextPowerOfTwo(static_cast<size_t>(signalLength) + recordingLength);
+    std::vector<Complex> recordingSpectrum(size);
+    std::vector<Complex> signalSpectrum(size);
+    std::copy(recording, recording + recordingLength, recordingSpectrum.begin());
+    std::copy(signal, signal + signalLength, signalSpectrum.begin());
+    fft(recordingSpectrum, false);
+    fft(signalSpectrum, false);
+    for (size_t i = 0; i < size; ++i) {
+        recordingSpectrum[i] *= std::conj(signalSpectrum[i]);
+    }
+    fft(recordingSpectrum, true);
+
+    const int32_t maxDelay = recordingLength - signalLength;
+    int32_t bestDelay = 0;
+    double bestCorrelation = 0;
+    for (int32_t delay = 0; delay <= maxDelay; ++delay) {
+        const double correlation = std::abs(recordingSpectrum[delay].real());
+        if (correlation > bestCorrelation) {
+            bestCorrelation = correlation;
+            bestDelay = delay;
+        }
+    }
+
+    // Normalise by the energy of the signal and of the part of the recording it lines up with.
+    double signalEnergy = 0;
+    for (int32_t i = 0; i < signalLength; ++i) signalEnergy += signal[i] * signal[i];
+    double recordingEnergy = 0;
+    for (int32_t i = 0; i < signalLength; ++i) {
+        recordingEnergy += recording[bestDelay + i] * recording[bestDelay + i];
+    }
+    const double norm = sqrt(signalEnergy * recordingEnergy);
+
+    result.isValid = norm > 0;
+    result.latencyFrames = bestDelay;
+    result.latencyMillis = bestDelay * 1000.0 / sampleRate;
+    result.confidence = result.isValid ? std::min(1.0, bestCorrelation / norm) : 0;
+    return result;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_LATENCYANALYZER_H
+#define WAVEMAKER2_LATENCYANALYZER_H
+
+#include <cstdint>
+#include <vector>
+
+enum class LatencySignal { Impulse, Mls };
+
+struct LatencyResult {
+    bool isValid = false;
+    int32_t latencyFrames = 0;
+    double latencyMillis = 0;
+    // The normalised cross-correlation at the detected delay: 1 means the recording contains an
+    // exact (scaled) copy of the test signal, values near 0 mean it wasn't found.
+    double confidence = 0;
+};
+
+/**
+ * A maximum-length sequence of +/-amplitude with 2^order - 1 samples. order must be between 10
+ * and 16.
+ */
+std::vector<float> generateMls(int32_t order, float amplitude);
+
+// A single full scale sample followed by silence, numSamples long in total.
+std::vector<float> generateImpulse(int32_t numSamples, float amplitude);
+
+/**
+ * Find where the test signal starts in a recording of it using FFT-based cross-correlation.
+ * Only delays at which the whole signal fits inside the recording are considered.
+ */
+LatencyResult findDelay(const float *signal, int32_t signalLength,
+                        const float *recording, int32_t recordingLength,
+                        int32_t sampleRate);
+
+#endif //WAVEMAKER2_LATENCYANALYZER_H
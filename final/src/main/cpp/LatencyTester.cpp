@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "LatencyTester.h"
+#include "Logging.h"
+
+namespace {
+
+// 8191 samples, about 170ms at 48kHz. Long enough to stand out from room noise.
+constexpr int32_t kMlsOrder = 13;
+constexpr float kMlsAmplitude = 0.5f;
+constexpr float kImpulseAmplitude = 0.9f;
+// The impulse is correlated together with the silence after it, so that noise in the recording
+// lowers the confidence.
+constexpr int32_t kImpulseLengthMillis = 100;
+
+} // namespace
+
+bool LatencyTester::prepare(LatencySignal signal, int32_t sampleRate) {
+
+    const int32_t state = mState.load(std::memory_order_acquire);
+    if (state == kStateRunning || state == kStateCaptured || sampleRate <= 0) return false;
+
+    mSignal = (signal == LatencySignal::Mls) ?
+              generateMls(kMlsOrder, kMlsAmplitude) :
+              generateImpulse(sampleRate * kImpulseLengthMillis / 1000, kImpulseAmplitude);
+    mCapture.assign(mSignal.size() + sampleRate * kMaxMeasuredLatencyMillis / 1000, 0.0f);
+    mSignalPosition = 0;
+    mCapturePosition = 0;
+    mSampleRate = sampleRate;
+    mIsSignalStarted.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mResultLock);
+        mResult = LatencyResult();
+    }
+
+    // Publishes the buffers to the audio callbacks.
+    mState.store(kStateRunning, std::memory_order_release);
+    return true;
+}
+
+void LatencyTester::cancel() {
+
+    int32_t expected = kStateRunning;
+    if (!mState.compare_exchange_strong(expected, kStateIdle)) {
+        expected = kStateCaptured;
+        mState.compare_exchange_strong(expected, kStateIdle);
+    }
+}
+
+void LatencyTester::renderSignal(float *audioData, int32_t numFrames) {
+
+    const int32_t signalLength = static_cast<int32_t>(mSignal.size());
+    const int32_t framesToCopy = std::max(0, std::min(numFrames, signalLength - mSignalPosition));
+    memcpy(audioData, &mSignal[mSignalPosition], framesToCopy * sizeof(float));
+    memset(&audioData[framesToCopy], 0, (numFrames - framesToCopy) * sizeof(float));
+    mSignalPosition += framesToCopy;
+
+    // Capturing starts with the first input to arrive after the signal has been handed over.
+    mIsSignalStarted.store(true, std::memory_order_release);
+}
+
+bool LatencyTester::capture(const float *audioData, int32_t numFrames) {
+
+    if (!mIsSignalStarted.load(std::memory_order_acquire)) return false;
+
+    const int32_t captureLength = static_cast<int32_t>(mCapture.size());
+    const int32_t framesToCopy = std::min(numFrames, captureLength - mCapturePosition);
+    memcpy(&mCapture[mCapturePosition], audioData, framesToCopy * sizeof(float));
+    mCapturePosition += framesToCopy;
+    if (mCapturePosition < captureLength) return false;
+
+    int32_t expected = kStateRunning;
+    return mState.compare_exchange_strong(expected, kStateCaptured, std::memory_order_acq_rel);
+}
+
+void LatencyTester::analyse() {
+
+    if (!isCaptureComplete()) return;
+
+    LatencyResult result = findDelay(mSignal.data(), static_cast<int32_t>(mSignal.size()),
+                                     mCapture.data(), static_cast<int32_t>(mCapture.size()),
+                                     mSampleRate);
+    LOGD("Round-trip latency %.2f ms, confidence %.3f", result.latencyMillis, result.confidence);
+    {
+        std::lock_guard<std::mutex> lock(mResultLock);
+        mResult = result;
+    }
+    mState.store(kStateDone, std::memory_order_release);
+}
+
+bool LatencyTester::getResult(LatencyResult &result) const {
+
+    if (mState.load(std::memory_order_acquire) != kStateDone) return false;
+    std::lock_guard<std::mutex> lock(mResultLock);
+    result = mResult;
+    return true;
+}
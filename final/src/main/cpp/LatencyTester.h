@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_LATENCYTESTER_H
+#define WAVEMAKER2_LATENCYTESTER_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "LatencyAnalyzer.h"
+
+// Longest round trip we look for. Anything later than this is reported as not found.
+constexpr int32_t kMaxMeasuredLatencyMillis = 500;
+
+/**
+ * Measures round-trip latency by playing a test signal and finding it in the input. The playback
+ * callback renders the signal and the recording callback captures everything that arrives from
+ * then on, so the result is the delay between the two callbacks as the app sees it: output
+ * buffering, the acoustic or loopback path and input buffering.
+ *
+ * prepare() and analyse() allocate and must be called off the audio thread. renderSignal() and
+ * capture() are real-time safe.
+ */
+class LatencyTester {
+
+public:
+    // Returns false if a measurement is already in progress.
+    bool prepare(LatencySignal signal, int32_t sampleRate);
+    void cancel();
+
+    bool isRunning() const { return mState.load(std::memory_order_acquire) == kStateRunning; };
+    bool isCaptureComplete() const {
+        return mState.load(std::memory_order_acquire) == kStateCaptured;
+    };
+
+    // Writes the next numFrames of the signal, followed by silence once it has all been played.
+    void renderSignal(float *audioData, int32_t numFrames);
+    // Returns true when the capture buffer has just been filled and analyse() should be called.
+    bool capture(const float *audioData, int32_t numFrames);
+    void analyse();
+
+    // Returns false if no measurement has finished since the last prepare().
+    bool getResult(LatencyResult &result) const;
+
+private:
+    enum State : int32_t { kStateIdle, kStateRunning, kStateCaptured, kStateDone };
+
+    std::atomic<int32_t> mState { kStateIdle };
+    std::atomic<bool> mIsSignalStarted { false };
+    std::vector<float> mSignal;
+    std::vector<float> mCapture;
+    int32_t mSignalPosition = 0;
+    int32_t mCapturePosition = 0;
+    int32_t mSampleRate = 0;
+
+    mutable std::mutex mResultLock;
+    LatencyResult mResult;
+};
+
+#endif //WAVEMAKER2_LATENCYTESTER_H
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "LatencyTuner.h"
+
+void LatencyTuner::reset(AudioStream &stream) {
+
+    const int32_t framesPerBurst = std::max(1, stream.getFramesPerBurst());
+    int32_t capacity = stream.getBufferCapacityInFrames();
+    if (capacity <= 0) capacity = stream.getBufferSizeInFrames();
+    mFramesPerBurst = framesPerBurst;
+    mCapacity = capacity;
+    mMaxBufferSize = (mPolicy.maxBursts > 0) ?
+                     std::min(capacity, mPolicy.maxBursts * framesPerBurst) : capacity;
+    mMinBufferSize = std::min(framesPerBurst, mMaxBufferSize);
+    mLastXRunCount = stream.getXRunCount();
+    mPendingXRuns = 0;
+    mCallbacksSinceChange = 0;
+    mGlitchFreeCallbacks = 0;
+    mIsShrunk = false;
+    mXRunCount = 0;
+    mGrowCount = 0;
+    mShrinkCount = 0;
+    setBufferSize(stream, mMinBufferSize);
+}
+
+void LatencyTuner::tune(AudioStream &stream) {
+
+    const int32_t xRunCount = stream.getXRunCount();
+    const int32_t newXRuns = xRunCount - mLastXRunCount;
+    mLastXRunCount = xRunCount;
+    mXRunCount.fetch_add(newXRuns, std::memory_order_relaxed);
+
+    // Anything during the hold comes from the glitch we've already reacted to.
+    if (++mCallbacksSinceChange <= mPolicy.holdCallbacks) return;
+
+    const int32_t framesPerBurst = mFramesPerBurst.load(std::memory_order_relaxed);
+    const int32_t bufferSize = mBufferSize.load(std::memory_order_relaxed);
+    mPendingXRuns += newXRuns;
+    if (mPendingXRuns >= std::max(1, mPolicy.xRunThreshold)) {
+        if (bufferSize < mMaxBufferSize) {
+            // A size we shrank back to has glitched again, so don't go back down to it.
+            if (mIsShrunk) mMinBufferSize = std::min(bufferSize + framesPerBurst, mMaxBufferSize);
+            setBufferSize(stream, std::min(bufferSize + framesPerBurst, mMaxBufferSize));
+            mGrowCount.fetch_add(1, std::memory_order_relaxed);
+            mIsShrunk = false;
+        }
+        mPendingXRuns = 0;
+        mGlitchFreeCallbacks = 0;
+        mCallbacksSinceChange = 0;
+    } else if (newXRuns > 0) {
+        // Not enough to grow, but the spell isn't glitch-free any more.
+        mGlitchFreeCallbacks = 0;
+    } else if (mPolicy.shrinkAfterCallbacks > 0 &&
+               ++mGlitchFreeCallbacks >= mPolicy.shrinkAfterCallbacks) {
+        if (bufferSize - framesPerBurst >= mMinBufferSize) {
+            setBufferSize(stream, bufferSize - framesPerBurst);
+            mShrinkCount.fetch_add(1, std::memory_order_relaxed);
+            mCallbacksSinceChange = 0;
+            mIsShrunk = true;
+        }
+        mPendingXRuns = 0;
+        mGlitchFreeCallbacks = 0;
+    }
+}
+
+LatencyTunerState LatencyTuner::getState() const {
+
+    // Each value is read separately so they may be from different callbacks.
+    LatencyTunerState state;
+    state.bufferSizeInFrames = mBufferSize.load(std::memory_order_relaxed);
+    state.framesPerBurst = mFramesPerBurst.load(std::memory_order_relaxed);
+    state.capacityInFrames = mCapacity.load(std::memory_order_relaxed);
+    state.xRunCount = mXRunCount.load(std::memory_order_relaxed);
+    state.growCount = mGrowCount.load(std::memory_order_relaxed);
+    state.shrinkCount = mShrinkCount.load(std::memory_order_relaxed);
+    return state;
+}
+
+void LatencyTuner::setBufferSize(AudioStream &stream, int32_t numFrames) {
+
+    // Keep whatever the stream was using if it refuses the new size.
+    const int32_t result = stream.setBufferSizeInFrames(numFrames);
+    mBufferSize.store((result > 0) ? result : stream.getBufferSizeInFrames(),
+                      std::memory_order_relaxed);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_LATENCYTUNER_H
+#define WAVEMAKER2_LATENCYTUNER_H
+
+#include <cstdint>
+#include <atomic>
+#include "AudioBackend.h"
+
+struct LatencyTunerPolicy {
+    bool isEnabled = true;
+    // The largest buffer to grow to, in bursts. 0 means up to the stream's capacity.
+    int32_t maxBursts = 0;
+    // How many new xruns it takes to grow the buffer by a burst.
+    int32_t xRunThreshold = 1;
+    // Callbacks to wait after a change before looking at xruns again. A single glitch often
+    // produces several xruns in a row and they shouldn't each grow the buffer.
+    int32_t holdCallbacks = 32;
+    // Glitch-free callbacks after which the buffer shrinks by a burst. 0 means never shrink.
+    int32_t shrinkAfterCallbacks = 0;
+};
+
+struct LatencyTunerState {
+    int32_t bufferSizeInFrames = 0;
+    int32_t framesPerBurst = 0;
+    int32_t capacityInFrames = 0;
+    int32_t xRunCount = 0;
+    int32_t growCount = 0;
+    int32_t shrinkCount = 0;
+};
+
+/**
+ * Keeps an output stream's buffer as small as it can be without glitching. The buffer starts at
+ * a single burst and grows a burst at a time when xruns are reported. With shrinking enabled it
+ * also comes back down after a quiet spell, so a one-off spike doesn't cost latency for good. A
+ * size it shrinks back to and which glitches again is never returned to, so it settles instead of
+ * oscillating.
+ *
+ * reset() must be called before the stream is started. tune() is called from the stream's data
+ * callback and is real-time safe. getState() can be called from any thread.
+ */
+class LatencyTuner {
+
+public:
+    // Only call this while no stream is being tuned.
+    void setPolicy(const LatencyTunerPolicy &policy) { mPolicy = policy; };
+    const LatencyTunerPolicy &getPolicy() const { return mPolicy; };
+
+    void reset(AudioStream &stream);
+    void tune(AudioStream &stream);
+    LatencyTunerState getState() const;
+
+private:
+    LatencyTunerPolicy mPolicy;
+    std::atomic<int32_t> mFramesPerBurst { 0 };
+    int32_t mMinBufferSize = 0;
+    int32_t mMaxBufferSize = 0;
+    int32_t mLastXRunCount = 0;
+    int32_t mPendingXRuns = 0;
+    int32_t mCallbacksSinceChange = 0;
+    int32_t mGlitchFreeCallbacks = 0;
+    // Whether the buffer got to its current size by shrinking.
+    bool mIsShrunk = false;
+
+    std::atomic<int32_t> mBufferSize { 0 };
+    std::atomic<int32_t> mCapacity { 0 };
+    std::atomic<int32_t> mXRunCount { 0 };
+    std::atomic<int32_t> mGrowCount { 0 };
+    std::atomic<int32_t> mShrinkCount { 0 };
+
+    void setBufferSize(AudioStream &stream, int32_t numFrames);
+};
+
+#endif //WAVEMAKER2_LATENCYTUNER_H
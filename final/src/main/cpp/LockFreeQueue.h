@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_LOCKFREEQUEUE_H
+#define WAVEMAKER2_LOCKFREEQUEUE_H
+
+#include <cstdint>
+#include <atomic>
+
+/**
+ * A lock-free, wait-free queue for a single producer thread and a single consumer thread.
+ *
+ * CAPACITY must be a power of two. The read and write counters are allowed to wrap around, the
+ * difference between them is always the number of items in the queue.
+ */
+template <typename T, uint32_t CAPACITY>
+class LockFreeQueue {
+
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+
+    bool push(const T &item) {
+        const uint32_t writeCounter = mWriteCounter.load(std::memory_order_relaxed);
+        if (writeCounter - mReadCounter.load(std::memory_order_acquire) == CAPACITY) return false;
+        mBuffer[writeCounter & kMask] = item;
+        mWriteCounter.store(writeCounter + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        const uint32_t readCounter = mReadCounter.load(std::memory_order_relaxed);
+        if (readCounter == mWriteCounter.load(std::memory_order_acquire)) return false;
+        item = mBuffer[readCounter & kMask];
+        mReadCounter.store(readCounter + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size() const {
+        return mWriteCounter.load(std::memory_order_acquire) -
+               mReadCounter.load(std::memory_order_acquire);
+    }
+
+    static constexpr uint32_t capacity() { return CAPACITY; }
+
+private:
+    static constexpr uint32_t kMask = CAPACITY - 1;
+
+    T mBuffer[CAPACITY];
+    std::atomic<uint32_t> mWriteCounter { 0 };
+    std::atomic<uint32_t> mReadCounter { 0 };
+};
+
+#endif //WAVEMAKER2_LOCKFREEQUEUE_H
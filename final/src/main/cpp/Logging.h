@@ -0,0 +1,43 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_LOGGING_H
+#define WAVEMAKER2_LOGGING_H
+
+// Log using the calling function's name as the tag. On Android this goes to logcat, elsewhere
+// (for example when the engine is built on a desktop host) it goes to stderr.
+
+#ifdef __ANDROID__
+
+#include <android/log.h>
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, __func__, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, __func__, __VA_ARGS__)
+
+#else
+
+#include <cstdio>
+#define WAVEMAKER2_LOG(level, ...) \
+    do { \
+        fprintf(stderr, "%s/%s: ", level, __func__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } while (0)
+#define LOGD(...) WAVEMAKER2_LOG("D", __VA_ARGS__)
+#define LOGE(...) WAVEMAKER2_LOG("E", __VA_ARGS__)
+
+#endif
+
+#endif //WAVEMAKER2_LOGGING_H
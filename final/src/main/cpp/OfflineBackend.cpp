@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+
+#include "OfflineBackend.h"
+#include "Resampler.h"
+#include "SoundRecordingUtilities.h"
+#include "WavFileReader.h"
+
+namespace {
+
+std::string timingsToJson(const CallbackTimings &timings) {
+    char json[384];
+    snprintf(json, sizeof(json),
+             "{\"callbackCount\":%lld,\"framesProcessed\":%lld,\"totalNanos\":%lld,"
+             "\"minNanos\":%lld,\"meanNanos\":%.1f,\"maxNanos\":%lld,"
+             "\"minorPageFaults\":%lld,\"majorPageFaults\":%lld}",
+             static_cast<long long>(timings.callbackCount),
+             static_cast<long long>(timings.framesProcessed),
+             static_cast<long long>(timings.totalNanos),
+             static_cast<long long>((timings.callbackCount > 0) ? timings.minNanos : 0),
+             timings.getMeanNanos(),
+             static_cast<long long>(timings.maxNanos),
+             static_cast<long long>(timings.minorPageFaults),
+             static_cast<long long>(timings.majorPageFaults));
+    return json;
+}
+
+// Resource usage of the calling thread so far.
+rusage getThreadUsage() {
+    rusage usage {};
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage;
+}
+
+// Roughly what AAudio gives a low latency stream.
+constexpr int32_t kDefaultBufferSizeInBursts = 2;
+constexpr int32_t kBufferCapacityInBursts = 16;
+
+} // namespace
+
+class OfflineStream : public AudioStream {
+
+public:
+    OfflineStream(OfflineBackend &backend, const StreamParameters &parameters,
+                  int32_t sampleRate, int32_t framesPerBurst, double clockScale)
+            : mBackend(backend), mParameters(parameters), mSampleRate(sampleRate),
+              mFramesPerBurst(framesPerBurst), mClockScale(clockScale) {
+        if (mParameters.channelCount == kUnspecified) mParameters.channelCount = 2;
+        mBuffer.resize(framesPerBurst * mParameters.channelCount *
+                       getBytesPerSample(mParameters.format));
+        mBackend.mStreams.push_back(this);
+    }
+
+    ~OfflineStream() override {
+        auto &streams = mBackend.mStreams;
+        streams.erase(std::remove(streams.begin(), streams.end(), this), streams.end());
+    }
+
+    bool requestStart() override { mIsStarted = true; return true; }
+    bool requestStop() override { mIsStarted = false; return true; }
+    SampleFormat getFormat() const override { return mParameters.format; }
+    int32_t getChannelCount() const override { return mParameters.channelCount; }
+    int32_t getSampleRate() const override { return mSampleRate; }
+    int32_t getDeviceId() const override { return kUnspecified; }
+    int32_t getFramesPerBurst() const override { return mFramesPerBurst; }
+    int32_t getBufferSizeInFrames() const override { return mBufferSizeInFrames; }
+    int32_t setBufferSizeInFrames(int32_t numFrames) override {
+        mBufferSizeInFrames = std::max(1, std::min(numFrames, getBufferCapacityInFrames()));
+        return mBufferSizeInFrames;
+    }
+    int32_t getBufferCapacityInFrames() const override {
+        return mFramesPerBurst * kBufferCapacityInBursts;
+    }
+    int32_t getXRunCount() const override { return mXRunCount; }
+
+    int32_t read(void *buffer, int32_t numFrames, int64_t /*timeoutNanos*/) override {
+        // Nothing arrives while we wait, so the timeout makes no difference.
+        if (mParameters.direction != StreamDirection::Input || !mIsStarted) return -1;
+        numFrames = std::min(numFrames, getFramesAvailable());
+        mBackend.fillInput(*this, buffer, numFrames);
+        mFramesRead += numFrames;
+        return numFrames;
+    }
+
+    int32_t getFramesAvailable() const override {
+        return static_cast<int32_t>(mFramePosition - mFramesRead);
+    }
+
+    const StreamParameters &getParameters() const { return mParameters; }
+    bool isStarted() const { return mIsStarted; }
+    void *getBuffer() { return mBuffer.data(); }
+    int64_t getFramePosition() const { return mFramePosition; }
+    void advance() { mFramePosition += mFramesPerBurst; }
+    void addXRun() { mXRunCount++; }
+    void setEndPosition(int64_t endPosition) { mEndPosition = endPosition; }
+    bool isFinished() const { return mFramePosition >= mEndPosition; }
+    double getClockScale() const { return mClockScale; }
+    double getTime() const {
+        return static_cast<double>(mFramePosition) / (mSampleRate * mClockScale);
+    }
+
+private:
+    OfflineBackend &mBackend;
+    StreamParameters mParameters;
+    int32_t mSampleRate;
+    int32_t mFramesPerBurst;
+    double mClockScale;
+    bool mIsStarted = false;
+    int32_t mBufferSizeInFrames = mFramesPerBurst * kDefaultBufferSizeInBursts;
+    int32_t mXRunCount = 0;
+    int64_t mFramePosition = 0;
+    int64_t mFramesRead = 0;
+    int64_t mEndPosition = 0;
+    std::vector<uint8_t> mBuffer;
+};
+
+std::unique_ptr<AudioStream> OfflineBackend::openStream(const StreamParameters &parameters) {
+
+    const bool isInput = parameters.direction == StreamDirection::Input;
+    if (parameters.dataCallback == nullptr && !isInput) return nullptr;
+    int32_t sampleRate = (parameters.sampleRate != kUnspecified) ?
+                         parameters.sampleRate : mConfig.sampleRate;
+    if (isInput && mConfig.inputSampleRate != kUnspecified) sampleRate = mConfig.inputSampleRate;
+    const int32_t framesPerBurst = isInput ?
+                                   mConfig.inputFramesPerBurst : mConfig.outputFramesPerBurst;
+    const double clockScale = isInput ? mConfig.inputClockScale : 1.0;
+    StreamParameters streamParameters = parameters;
+    if (!isInput && mConfig.outputChannelCount != kUnspecified) {
+        streamParameters.channelCount = mConfig.outputChannelCount;
+    }
+    return std::unique_ptr<AudioStream>(
+            new OfflineStream(*this, streamParameters, sampleRate, framesPerBurst, clockScale));
+}
+
+void OfflineBackend::setInputSamples(std::vector<float> monoSamples) {
+    mInputSamples = std::move(monoSamples);
+    mInputPosition = 0;
+}
+
+void OfflineBackend::setInputSine(float frequency, float amplitude) {
+    mInputSamples.clear();
+    mInputPosition = 0;
+    mSineFrequency = frequency;
+    mSineAmplitude = amplitude;
+}
+
+bool OfflineBackend::loadInputFile(const char *path) {
+
+    WavFileReader file;
+    if (!file.open(path)) return false;
+    const WavInfo &info = file.getInfo();
+    std::vector<float> samples(static_cast<size_t>(info.getNumFrames()));
+    file.readMono(samples.data(), static_cast<int32_t>(samples.size()));
+
+    const int32_t inputRate = (mConfig.inputSampleRate != kUnspecified) ?
+                              mConfig.inputSampleRate : mConfig.sampleRate;
+    if (static_cast<int32_t>(info.sampleRate) != inputRate) {
+        samples = resampleBuffer(samples.data(), static_cast<int32_t>(samples.size()),
+                                 info.sampleRate, inputRate);
+    }
+    setInputSamples(std::move(samples));
+    return true;
+}
+
+OfflineReport OfflineBackend::run(int64_t numFrames) {
+
+    using Clock = std::chrono::steady_clock;
+    OfflineReport report;
+    const Clock::time_point runStart = Clock::now();
+
+    // numFrames is at the configured rate, streams at other rates or on a drifting clock run for
+    // the same time.
+    for (OfflineStream *stream : mStreams) {
+        stream->setEndPosition(stream->getFramePosition() + static_cast<int64_t>(std::llround(
+                numFrames * stream->getClockScale() * stream->getSampleRate() / mConfig.sampleRate)));
+    }
+
+    for (;;) {
+        // Call back whichever started stream is furthest behind. Input streams go first on a tie
+        // so that a burst is recorded before the burst played at the same time.
+        OfflineStream *next = nullptr;
+        for (OfflineStream *stream : mStreams) {
+            if (!stream->isStarted() || stream->isFinished()) continue;
+            if (next == nullptr || stream->getTime() < next->getTime() ||
+                (stream->getTime() == next->getTime() &&
+                 stream->getParameters().direction == StreamDirection::Input)) {
+                next = stream;
+            }
+        }
+        if (next == nullptr) break;
+
+        const StreamParameters &parameters = next->getParameters();
+        const bool isInput = parameters.direction == StreamDirection::Input;
+        const int32_t framesPerBurst = next->getFramesPerBurst();
+
+        // A stream without a callback just makes another burst available to read().
+        if (parameters.dataCallback == nullptr) {
+            next->advance();
+            continue;
+        }
+        if (isInput) {
+            fillInput(*next, next->getBuffer(), framesPerBurst);
+        } else if (next->getBufferSizeInFrames() < mConfig.minimumGlitchFreeBufferFrames) {
+            next->addXRun();
+        }
+
+        // Usage is read outside the timed part, as it's a system call.
+        const rusage usageBefore = getThreadUsage();
+        const Clock::time_point callbackStart = Clock::now();
+        CallbackResult result = parameters.dataCallback(next, parameters.userData,
+                                                        next->getBuffer(), framesPerBurst);
+        const int64_t callbackNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - callbackStart).count();
+        const rusage usageAfter = getThreadUsage();
+
+        CallbackTimings &timings = isInput ? report.input : report.output;
+        timings.callbackCount++;
+        timings.framesProcessed += framesPerBurst;
+        timings.totalNanos += callbackNanos;
+        timings.minNanos = std::min(timings.minNanos, callbackNanos);
+        timings.maxNanos = std::max(timings.maxNanos, callbackNanos);
+        timings.minorPageFaults += usageAfter.ru_minflt - usageBefore.ru_minflt;
+        timings.majorPageFaults += usageAfter.ru_majflt - usageBefore.ru_majflt;
+
+        if (!isInput && mConfig.captureOutput) captureOutput(*next, framesPerBurst);
+        next->advance();
+        if (result == CallbackResult::Stop) next->requestStop();
+    }
+
+    report.wallClockNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - runStart).count();
+    report.streamNanos = numFrames * 1000000000LL / mConfig.sampleRate;
+    return report;
+}
+
+void OfflineBackend::fillInput(OfflineStream &stream, void *buffer, int32_t numFrames) {
+
+    const int32_t channelCount = stream.getChannelCount();
+    const bool isI16 = stream.getFormat() == SampleFormat::I16;
+    for (int32_t frame = 0; frame < numFrames; ++frame) {
+        float sample;
+        if (!mInputSamples.empty()) {
+            sample = mInputSamples[mInputPosition % mInputSamples.size()];
+        } else {
+            const double phase = 2.0 * M_PI * mSineFrequency * mInputPosition /
+                                 stream.getSampleRate();
+            sample = mSineAmplitude * static_cast<float>(sin(phase));
+        }
+        mInputPosition++;
+        for (int32_t channel = 0; channel < channelCount; ++channel) {
+            const int32_t index = frame * channelCount + channel;
+            if (isI16) {
+                static_cast<int16_t *>(buffer)[index] = convertFloatToInt16(sample);
+            } else {
+                static_cast<float *>(buffer)[index] = sample;
+            }
+        }
+    }
+}
+
+void OfflineBackend::captureOutput(OfflineStream &stream, int32_t numFrames) {
+
+    const int32_t numSamples = numFrames * stream.getChannelCount();
+    const size_t start = mCapturedOutput.size();
+    mCapturedOutput.resize(start + numSamples);
+    if (stream.getFormat() == SampleFormat::I16) {
+        convertArrayInt16ToFloat(static_cast<const int16_t *>(stream.getBuffer()),
+                                 &mCapturedOutput[start], numSamples);
+    } else {
+        memcpy(&mCapturedOutput[start], stream.getBuffer(), numSamples * sizeof(float));
+    }
+}
+
+std::string OfflineReport::toJson() const {
+
+    char totals[128];
+    snprintf(totals, sizeof(totals),
+             "\"streamNanos\":%lld,\"wallClockNanos\":%lld,\"realtimeFactor\":%.3f",
+             static_cast<long long>(streamNanos), static_cast<long long>(wallClockNanos),
+             getRealtimeFactor());
+    return std::string("{") + totals + ",\"input\":" + timingsToJson(input) +
+           ",\"output\":" + timingsToJson(output) + "}";
+}
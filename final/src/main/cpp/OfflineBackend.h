@@ -0,0 +1,123 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_OFFLINEBACKEND_H
+#define WAVEMAKER2_OFFLINEBACKEND_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "AudioBackend.h"
+
+class OfflineStream;
+
+struct OfflineConfig {
+    int32_t sampleRate = 48000;
+    int32_t inputFramesPerBurst = 192;
+    int32_t outputFramesPerBurst = 192;
+    bool captureOutput = false;
+    // How fast input streams' clocks run relative to output streams', to simulate drift between
+    // two devices. 1.0001 means the input captures 100 ppm more frames than the output plays.
+    double inputClockScale = 1.0;
+    // Open input streams at this rate whatever was asked for, like a device which can't match the
+    // output's rate. Unspecified means honour the request.
+    int32_t inputSampleRate = kUnspecified;
+    // Output streams count an xrun on every callback while their buffer is smaller than this, to
+    // simulate a device which can't keep up with a small buffer.
+    int32_t minimumGlitchFreeBufferFrames = 0;
+    // Open output streams with this many channels whatever was asked for. Unspecified means
+    // honour the request.
+    int32_t outputChannelCount = kUnspecified;
+};
+
+struct CallbackTimings {
+    int64_t callbackCount = 0;
+    int64_t framesProcessed = 0;
+    int64_t totalNanos = 0;
+    int64_t minNanos = std::numeric_limits<int64_t>::max();
+    int64_t maxNanos = 0;
+    // Page faults taken by the callbacks. Even minor ones stall the callback while the kernel maps
+    // a page in, so a callback which touches memory for the first time is as bad as one which
+    // takes a lock.
+    int64_t minorPageFaults = 0;
+    int64_t majorPageFaults = 0;
+
+    double getMeanNanos() const {
+        return (callbackCount > 0) ? static_cast<double>(totalNanos) / callbackCount : 0;
+    }
+};
+
+struct OfflineReport {
+    CallbackTimings input;
+    CallbackTimings output;
+    int64_t streamNanos = 0; // How long the rendered audio would have taken to play
+    int64_t wallClockNanos = 0; // How long it actually took
+
+    double getRealtimeFactor() const {
+        return (wallClockNanos > 0) ? static_cast<double>(streamNanos) / wallClockNanos : 0;
+    }
+
+    // The report as a single line JSON object, for tools which track performance across builds.
+    std::string toJson() const;
+};
+
+/**
+ * A backend with no audio hardware. run() calls the data callbacks of every started stream back
+ * to back, in the order they would be called in real time, and times each call. Input streams are
+ * fed from a WAV file, a buffer of samples or a sine wave.
+ *
+ * Everything happens on the thread that calls run(), so the results are deterministic for a given
+ * config and input.
+ */
+class OfflineBackend : public AudioBackend {
+
+public:
+    explicit OfflineBackend(const OfflineConfig &config = OfflineConfig()) : mConfig(config) {};
+    std::unique_ptr<AudioStream> openStream(const StreamParameters &parameters) override;
+
+    // The input source is looped if it's shorter than the run.
+    void setInputSamples(std::vector<float> monoSamples);
+    void setInputSine(float frequency, float amplitude);
+    // Loads a WAV file, mixing it down to mono and resampling it to the input streams' rate.
+    // Returns false if it can't be read.
+    bool loadInputFile(const char *path);
+
+    /**
+     * Run the started streams for a further numFrames frames of stream time, as fast as possible.
+     */
+    OfflineReport run(int64_t numFrames);
+
+    // Interleaved float output from every output stream, if config.captureOutput is set.
+    const std::vector<float> &getCapturedOutput() const { return mCapturedOutput; };
+
+private:
+    friend class OfflineStream;
+
+    OfflineConfig mConfig;
+    std::vector<OfflineStream *> mStreams;
+    std::vector<float> mInputSamples;
+    int64_t mInputPosition = 0;
+    float mSineFrequency = 440.0f;
+    float mSineAmplitude = 0.5f;
+    std::vector<float> mCapturedOutput;
+
+    void fillInput(OfflineStream &stream, void *buffer, int32_t numFrames);
+    void captureOutput(OfflineStream &stream, int32_t numFrames);
+};
+
+#endif //WAVEMAKER2_OFFLINEBACKEND_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstring>
+#include "OnsetGate.h"
+
+// An onset is at least this many times the background energy, ~6dB above it.
+constexpr float kOnsetRiseRatio = 4.0f;
+// How quickly the background follows the input, per hop. ~27ms to settle @ 48kHz.
+constexpr float kBackgroundSmoothing = 0.05f;
+
+void OnsetGate::configure(bool isEnabled, float threshold, int32_t preRollFrames) {
+    mIsEnabled = isEnabled;
+    mThreshold = std::max(0.0f, threshold);
+    mPreRollFrames = std::min(std::max(0, preRollFrames), kMaxPreRollFrames);
+    mPreRoll.assign(static_cast<size_t>(mPreRollFrames + kOnsetHopFrames), 0.0f);
+    mIsWaiting = false;
+}
+
+void OnsetGate::arm() {
+    mHopLevels = SignalLevels();
+    mBackgroundEnergy = 0;
+    mPreRollWriteIndex = 0;
+    mPreRollCount = 0;
+    mIsWaiting.store(mIsEnabled, std::memory_order_release);
+}
+
+bool OnsetGate::findOnset(const float *input, int32_t numFrames, int32_t &onset) {
+
+    const float thresholdEnergy = mThreshold * mThreshold;
+    int32_t start = 0;
+    while (start < numFrames) {
+        const int32_t length = std::min(numFrames - start,
+                                        kOnsetHopFrames - mHopLevels.numSamples);
+        measureArrayLevels(&input[start], length, mHopLevels);
+        start += length;
+        if (mHopLevels.numSamples < kOnsetHopFrames) break;
+
+        const float energy = mHopLevels.sumOfSquares / kOnsetHopFrames;
+        mHopLevels = SignalLevels();
+        if (energy >= thresholdEnergy && energy >= kOnsetRiseRatio * mBackgroundEnergy) {
+            // Start from the first sample in the hop which reaches the threshold. Any part of the
+            // hop from earlier blocks is at the end of the ring.
+            const auto capacity = static_cast<int32_t>(mPreRoll.size());
+            auto getSample = [&](int32_t index) {
+                return (index >= 0) ? input[index]
+                                    : mPreRoll[(mPreRollWriteIndex + index + capacity) % capacity];
+            };
+            onset = std::max(start - kOnsetHopFrames, -mPreRollCount);
+            while (onset < start - 1 && fabsf(getSample(onset)) < mThreshold) onset++;
+            return true;
+        }
+        mBackgroundEnergy += kBackgroundSmoothing * (energy - mBackgroundEnergy);
+    }
+    return false;
+}
+
+void OnsetGate::pushPreRoll(const float *input, int32_t numFrames) {
+
+    const auto capacity = static_cast<int32_t>(mPreRoll.size());
+    if (capacity == 0 || numFrames == 0) return;
+
+    // Only the most recent frames can end up in the ring.
+    if (numFrames > capacity) {
+        input += numFrames - capacity;
+        numFrames = capacity;
+    }
+    const int32_t firstPart = std::min(numFrames, capacity - mPreRollWriteIndex);
+    memcpy(&mPreRoll[mPreRollWriteIndex], input, firstPart * sizeof(float));
+    memcpy(&mPreRoll[0], &input[firstPart], (numFrames - firstPart) * sizeof(float));
+    mPreRollWriteIndex = (mPreRollWriteIndex + numFrames) % capacity;
+    mPreRollCount = std::min(capacity, mPreRollCount + numFrames);
+}
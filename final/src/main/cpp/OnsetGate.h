@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WAVEMAKER2_ONSETGATE_H
+#define WAVEMAKER2_ONSETGATE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "SoundRecordingUtilities.h"
+
+// The detector looks at the input's energy over hops of this many frames, ~1.3ms @ 48kHz.
+constexpr int32_t kOnsetHopFrames = 64;
+constexpr int32_t kMaxPreRollFrames = 48000; // 1s @ 48kHz
+
+/**
+ * Holds back recorded input until the player starts, so that takes don't begin with silence.
+ *
+ * Once armed, each hop's energy is compared with the threshold and with the background level
+ * measured since arming. Until both are exceeded the input only goes into a short pre-roll ring.
+ * At the onset, the pre-roll is committed so that the attack isn't lost, followed by the input
+ * from the onset on, and the gate then stays open until it's armed again.
+ *
+ * Has no dependency on a stream, so it can be driven directly with test signals.
+ */
+class OnsetGate {
+
+public:
+    /**
+     * threshold is the RMS level, linear, which a hop must reach to count as an onset. The
+     * pre-roll is allocated here, so this mustn't be called while process() might be running.
+     */
+    void configure(bool isEnabled, float threshold, int32_t preRollFrames);
+    bool isEnabled() const { return mIsEnabled; };
+    float getThreshold() const { return mThreshold; };
+    int32_t getPreRollFrames() const { return mPreRollFrames; };
+
+    // Start waiting for an onset. Mustn't be called while process() might be running.
+    void arm();
+    // Safe to call from any thread.
+    bool isWaitingForOnset() const { return mIsWaiting.load(std::memory_order_acquire); };
+
+    /**
+     * Pass a block of input through the gate, calling commit(const float *frames,
+     * int32_t numFrames) for each run of frames which should be recorded, in order. Never
+     * allocates or blocks.
+     */
+    template <typename Commit>
+    void process(const float *input, int32_t numFrames, Commit &&commit);
+
+private:
+    bool mIsEnabled = false;
+    float mThreshold = 0;
+    std::atomic<bool> mIsWaiting { false };
+    SignalLevels mHopLevels;
+    // The mean square level of the input while waiting, from hop to hop.
+    float mBackgroundEnergy = 0;
+    int32_t mPreRollFrames = 0;
+    // Holds the pre-roll and one hop more, for the start of a hop which began in an earlier block.
+    std::vector<float> mPreRoll;
+    int32_t mPreRollWriteIndex = 0;
+    int32_t mPreRollCount = 0;
+
+    /**
+     * Returns true at an onset, setting onset to its index in input. It's negative if the onset
+     * was in an earlier block, when it's that many frames back from the end of the ring.
+     */
+    bool findOnset(const float *input, int32_t numFrames, int32_t &onset);
+    void pushPreRoll(const float *input, int32_t numFrames);
+};
+
+template <typename Commit>
+void OnsetGate::process(const float *input, int32_t numFrames, Commit &&commit) {
+
+    if (!mIsWaiting.load(std::memory_order_relaxed)) {
+        commit(input, numFrames);
+        return;
+    }
+
+    int32_t onset;
+    if (!findOnset(input, numFrames, onset)) {
+        pushPreRoll(input, numFrames);
+        return;
+    }
+
+    // The ring now ends with the frames just before the onset, or with the frames of the onset
+    // hop from earlier blocks. Commit the pre-roll before the onset along with those.
+    pushPreRoll(input, std::max(0, onset));
+    const int32_t count = std::min(mPreRollCount, mPreRollFrames + std::max(0, -onset));
+    const auto capacity = static_cast<int32_t>(mPreRoll.size());
+    if (count > 0) {
+        const int32_t readIndex = (mPreRollWriteIndex - count + capacity) % capacity;
+        const int32_t firstPart = std::min(count, capacity - readIndex);
+        commit(&mPreRoll[readIndex], firstPart);
+        if (count > firstPart) commit(&mPreRoll[0], count - firstPart);
+    }
+    mIsWaiting.store(false, std::memory_order_release);
+    onset = std::max(0, onset);
+    if (onset < numFrames) commit(&input[onset], numFrames - onset);
+}
+
+#endif //WAVEMAKER2_ONSETGATE_H
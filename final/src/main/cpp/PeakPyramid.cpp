@@ -0,0 +1,182 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "PeakPyramid.h"
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+void PeakPyramid::append(const float *samples, int32_t numSamples) {
+
+    // If the pool runs dry the summary stops where it got to, as the recording itself does.
+    int32_t index = 0;
+    while (index < numSamples && !mIsFull) {
+        const int32_t length = std::min(numSamples - index, kPeakBinSamples - mPartialSamples);
+        float minimum = mPartialMin;
+        float maximum = mPartialMax;
+        float sumOfSquares = mPartialSumOfSquares;
+        for (int32_t i = index; i < index + length; ++i) {
+            minimum = std::min(minimum, samples[i]);
+            maximum = std::max(maximum, samples[i]);
+            sumOfSquares += samples[i] * samples[i];
+        }
+        mPartialMin = minimum;
+        mPartialMax = maximum;
+        mPartialSumOfSquares = sumOfSquares;
+        mPartialSamples += length;
+        index += length;
+        if (mPartialSamples == kPeakBinSamples && !completeBin()) mIsFull = true;
+    }
+}
+
+bool PeakPyramid::completeBin() {
+
+    StoredBin bin { mPartialMin, mPartialMax, mPartialSumOfSquares / kPeakBinSamples };
+    mPartialMin = kInfinity;
+    mPartialMax = -kInfinity;
+    mPartialSumOfSquares = 0;
+    mPartialSamples = 0;
+    if (!storeBin(bin)) return false;
+
+    // Fold the bin into the level above, and so on up for as long as that completes a bin.
+    for (int32_t level = 1; level < kPeakLevelCount; ++level) {
+        StoredBin &partial = mPartialBins[level];
+        int32_t &count = mPartialBinCounts[level];
+        if (count == 0) {
+            partial = bin;
+        } else {
+            partial.min = std::min(partial.min, bin.min);
+            partial.max = std::max(partial.max, bin.max);
+            partial.meanSquare += bin.meanSquare;
+        }
+        if (++count < kPeakLevelFactor) break;
+        count = 0;
+        bin = { partial.min, partial.max, partial.meanSquare / kPeakLevelFactor };
+        if (!storeBin(bin)) return false;
+    }
+
+    // Only publish the finest bin once every coarser bin it completes is stored too.
+    mCompleteBinCount.store(mCompleteBinCount.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_release);
+    return true;
+}
+
+bool PeakPyramid::storeBin(const StoredBin &bin) {
+
+    const int32_t blockIndex = mStoredBinCount / kBinsPerBlock;
+    if (blockIndex == kMaxBlocks) return false;
+    if (mBlocks[blockIndex] == nullptr) {
+        uint8_t *block = mBlockPool.claimBlock();
+        if (block == nullptr) return false;
+        mBlocks[blockIndex] = reinterpret_cast<StoredBin *>(block);
+    }
+    mBlocks[blockIndex][mStoredBinCount % kBinsPerBlock] = bin;
+    mStoredBinCount++;
+    return true;
+}
+
+const PeakPyramid::StoredBin &PeakPyramid::getBin(int32_t level, int32_t index) const {
+
+    // A bin is stored straight after the finest bin which completes it, and after the bins it
+    // completes on the levels in between. Every finest bin is preceded by the coarser bins which
+    // completed before it.
+    int32_t levelLength = 1;
+    for (int32_t i = 0; i < level; ++i) levelLength *= kPeakLevelFactor;
+    const int32_t lastFinestBin = (index + 1) * levelLength - 1;
+    int32_t position = lastFinestBin + level;
+    int32_t coarserLength = kPeakLevelFactor;
+    for (int32_t i = 1; i < kPeakLevelCount; ++i) {
+        position += lastFinestBin / coarserLength;
+        coarserLength *= kPeakLevelFactor;
+    }
+    return mBlocks[position / kBinsPerBlock][position % kBinsPerBlock];
+}
+
+int32_t PeakPyramid::getPeaks(int32_t startSample, int32_t endSample, int32_t numBins,
+                              PeakBin *bins) const {
+
+    const int32_t completeBinCount = mCompleteBinCount.load(std::memory_order_acquire);
+    const int64_t span = endSample - startSample;
+    int32_t binsWritten = 0;
+    for (; binsWritten < numBins; ++binsWritten) {
+        // Edges in finest bins.
+        const auto first = static_cast<int32_t>(
+                (startSample + span * binsWritten / numBins + kPeakBinSamples / 2) /
+                kPeakBinSamples);
+        // The last bin may run past the end of what's summarised so far.
+        const auto last = std::min(completeBinCount, static_cast<int32_t>(
+                (startSample + span * (binsWritten + 1) / numBins + kPeakBinSamples / 2) /
+                kPeakBinSamples));
+        if (last <= first) break;
+
+        // Cover the range with the coarsest bins which fit, so the cost per output bin is
+        // bounded by the number of levels rather than the number of samples.
+        float minimum = kInfinity;
+        float maximum = -kInfinity;
+        double sumOfSquares = 0;
+        int32_t position = first;
+        while (position < last) {
+            int32_t level = 0;
+            int32_t length = 1;
+            while (level + 1 < kPeakLevelCount &&
+                   position % (length * kPeakLevelFactor) == 0 &&
+                   position + length * kPeakLevelFactor <= last) {
+                level++;
+                length *= kPeakLevelFactor;
+            }
+            const StoredBin &bin = getBin(level, position / length);
+            minimum = std::min(minimum, bin.min);
+            maximum = std::max(maximum, bin.max);
+            sumOfSquares += static_cast<double>(bin.meanSquare) * length;
+            position += length;
+        }
+        bins[binsWritten].min = minimum;
+        bins[binsWritten].max = maximum;
+        bins[binsWritten].rms = static_cast<float>(sqrt(sumOfSquares / (last - first)));
+    }
+    return binsWritten;
+}
+
+void PeakPyramid::clear() {
+
+    mCompleteBinCount = 0;
+    mStoredBinCount = 0;
+    mIsFull = false;
+    mPartialMin = kInfinity;
+    mPartialMax = -kInfinity;
+    mPartialSumOfSquares = 0;
+    mPartialSamples = 0;
+    mPartialBinCounts.fill(0);
+}
+
+void PeakPyramid::releaseBlocks() {
+
+    for (StoredBin *&block : mBlocks) {
+        SampleBlockPool::releaseBlock(reinterpret_cast<uint8_t *>(block));
+        block = nullptr;
+    }
+    clear();
+}
+
+int32_t PeakPyramid::getBlocksNeeded(int64_t numSamples) {
+
+    // Each level has a quarter of the bins of the one below, a third as many again in total.
+    const int64_t finestBins = numSamples / kPeakBinSamples;
+    const int64_t totalBins = finestBins + finestBins / (kPeakLevelFactor - 1) + kPeakLevelCount;
+    return static_cast<int32_t>((totalBins + kBinsPerBlock - 1) / kBinsPerBlock);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_PEAKPYRAMID_H
+#define WAVEMAKER2_PEAKPYRAMID_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <limits>
+
+#include "SampleBlockPool.h"
+
+// One bin of a waveform overview.
+struct PeakBin {
+    float min;
+    float max;
+    float rms;
+};
+
+constexpr int32_t kPeakBinSamples = 256; // ~5.3ms @ 48kHz at the finest level
+constexpr int32_t kPeakLevelFactor = 4; // Each level's bins summarise this many of the level below
+constexpr int32_t kPeakLevelCount = 9; // The coarsest bins cover ~6 minutes @ 48kHz
+
+/**
+ * A multi-resolution min, max and RMS summary of a recording, for drawing its waveform at any
+ * zoom without touching the samples.
+ *
+ * append() is called from the recording callback and costs the same per sample whatever the
+ * length of the recording. Higher levels are only updated when a bin below them completes. Every
+ * level is stored in one chain of blocks from the SampleBlockPool, in the order the bins
+ * complete, so a short recording only uses one block.
+ *
+ * getPeaks() can be called from any thread, but not at the same time as clear() or
+ * releaseBlocks().
+ */
+class PeakPyramid {
+
+public:
+    explicit PeakPyramid(SampleBlockPool &blockPool) : mBlockPool(blockPool) {};
+    ~PeakPyramid() { releaseBlocks(); };
+
+    // Recording callback only.
+    void append(const float *samples, int32_t numSamples);
+
+    /**
+     * Summarise samples [startSample, endSample) into numBins bins, each at least
+     * kPeakBinSamples long. Bin edges are rounded to the nearest finest-level bin. Returns the
+     * number of bins written, which is fewer than numBins if the range runs past the samples
+     * summarised so far.
+     */
+    int32_t getPeaks(int32_t startSample, int32_t endSample, int32_t numBins,
+                     PeakBin *bins) const;
+    // Samples covered by complete finest-level bins.
+    int32_t getSummarisedLength() const {
+        return mCompleteBinCount.load(std::memory_order_acquire) * kPeakBinSamples;
+    };
+
+    // Must not be called while the recording callback is appending. Blocks are kept for reuse.
+    void clear();
+    void releaseBlocks();
+
+    // The number of pool blocks needed to summarise numSamples.
+    static int32_t getBlocksNeeded(int64_t numSamples);
+
+private:
+    // Stored bins keep the mean square rather than the RMS so that they can be combined.
+    struct StoredBin {
+        float min;
+        float max;
+        float meanSquare;
+    };
+
+    static constexpr int32_t kBinsPerBlock = kBlockSizeInBytes / sizeof(StoredBin);
+    // The longest recordings are 16-bit ones, 2 bytes per sample.
+    static constexpr int32_t kMaxFinestBins =
+            kMaxBlocksPerRecording * (kBlockSizeInBytes / 2) / kPeakBinSamples;
+    static constexpr int32_t kMaxBlocks =
+            (kMaxFinestBins + kMaxFinestBins / (kPeakLevelFactor - 1) + kBinsPerBlock - 1) /
+            kBinsPerBlock + 1;
+
+    SampleBlockPool &mBlockPool;
+    // Only the recording callback adds blocks, and a block is always in place before the bin
+    // count that covers it is published.
+    std::array<StoredBin *, kMaxBlocks> mBlocks {};
+    std::atomic<int32_t> mCompleteBinCount { 0 };
+
+    // Recording callback only.
+    int32_t mStoredBinCount = 0;
+    bool mIsFull = false;
+    float mPartialMin = std::numeric_limits<float>::infinity();
+    float mPartialMax = -std::numeric_limits<float>::infinity();
+    float mPartialSumOfSquares = 0;
+    int32_t mPartialSamples = 0;
+    // The incomplete bin at each level above the finest, and how many bins it summarises so far.
+    // Index 0 is unused.
+    std::array<StoredBin, kPeakLevelCount> mPartialBins;
+    std::array<int32_t, kPeakLevelCount> mPartialBinCounts {};
+
+    bool completeBin();
+    bool storeBin(const StoredBin &bin);
+    const StoredBin &getBin(int32_t level, int32_t index) const;
+};
+
+#endif //WAVEMAKER2_PEAKPYRAMID_H
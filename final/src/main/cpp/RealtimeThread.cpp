@@ -0,0 +1,140 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Logging.h"
+#include "RealtimeThread.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+constexpr int32_t kMaxCpus = 64;
+
+// Sets flush-to-zero, and denormals-are-zero where it's separate, for the calling thread.
+bool flushDenormals() {
+#if defined(__aarch64__)
+    // FPCR.FZ flushes both denormal inputs and results.
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr |= (1ULL << 24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+    return true;
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    fpscr |= (1U << 24);
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+    return true;
+#elif defined(__SSE__)
+    // MXCSR.FTZ is bit 15 and MXCSR.DAZ bit 6.
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool setAffinity(uint64_t cpuMask) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int32_t cpu = 0; cpu < kMaxCpus; ++cpu) {
+        if (cpuMask & (1ULL << cpu)) CPU_SET(cpu, &cpus);
+    }
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+} // namespace
+
+void RealtimeThreadSetup::reset(uint64_t cpuMask) {
+    mCpuMask = cpuMask;
+    mIsApplied = false;
+    mIsInfoReady.store(false, std::memory_order_release);
+    mIsInfoLogged = false;
+}
+
+void RealtimeThreadSetup::apply() {
+
+    mIsApplied = true;
+    mInfo = RealtimeThreadInfo();
+    mInfo.isFlushingDenormals = flushDenormals();
+    if (mCpuMask != 0) mInfo.isAffinitySet = setAffinity(mCpuMask);
+
+    mInfo.threadId = static_cast<int32_t>(syscall(SYS_gettid));
+    mInfo.schedulingPolicy = sched_getscheduler(0);
+    if (mInfo.schedulingPolicy == SCHED_FIFO || mInfo.schedulingPolicy == SCHED_RR) {
+        sched_param parameters {};
+        if (sched_getparam(0, &parameters) == 0) mInfo.priority = parameters.sched_priority;
+    } else {
+        // On Linux this is the calling thread's nice value rather than the whole process's.
+        mInfo.priority = getpriority(PRIO_PROCESS, 0);
+    }
+    mInfo.cpu = sched_getcpu();
+    mIsInfoReady.store(true, std::memory_order_release);
+}
+
+bool RealtimeThreadSetup::getInfo(RealtimeThreadInfo &info) const {
+    if (!mIsInfoReady.load(std::memory_order_acquire)) return false;
+    info = mInfo;
+    return true;
+}
+
+bool RealtimeThreadSetup::logInfo(const char *streamName) {
+
+    RealtimeThreadInfo info;
+    if (mIsInfoLogged || !getInfo(info)) return mIsInfoLogged;
+    LOGD("%s callback thread %d: policy %d, priority %d, CPU %d", streamName, info.threadId,
+         info.schedulingPolicy, info.priority, info.cpu);
+    mIsInfoLogged = true;
+    return true;
+}
+
+uint64_t RealtimeThreadSetup::findFastestCpus() {
+
+    int64_t maxFrequencies[kMaxCpus] = {};
+    int64_t fastest = 0;
+    int64_t slowest = INT64_MAX;
+    for (int32_t cpu = 0; cpu < kMaxCpus; ++cpu) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+                 cpu);
+        FILE *file = fopen(path, "r");
+        if (file == nullptr) continue;
+        long long frequency = 0;
+        if (fscanf(file, "%lld", &frequency) == 1 && frequency > 0) {
+            maxFrequencies[cpu] = frequency;
+            fastest = std::max<int64_t>(fastest, frequency);
+            slowest = std::min<int64_t>(slowest, frequency);
+        }
+        fclose(file);
+    }
+
+    // Every core is the same, or we couldn't read them, so there's nothing to prefer.
+    if (fastest == 0 || fastest == slowest) return 0;
+
+    uint64_t cpuMask = 0;
+    for (int32_t cpu = 0; cpu < kMaxCpus; ++cpu) {
+        if (maxFrequencies[cpu] == fastest) cpuMask |= (1ULL << cpu);
+    }
+    return cpuMask;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WAVEMAKER2_REALTIMETHREAD_H
+#define WAVEMAKER2_REALTIMETHREAD_H
+
+#include <cstdint>
+#include <atomic>
+
+// What the setup found and did on the callback thread, for diagnostics.
+struct RealtimeThreadInfo {
+    int32_t threadId = 0;
+    // SCHED_FIFO, SCHED_RR or SCHED_OTHER. Callback threads which didn't get real-time
+    // scheduling run as SCHED_OTHER and are much more likely to glitch.
+    int32_t schedulingPolicy = 0;
+    // sched_priority for the real-time policies, the nice value for SCHED_OTHER.
+    int32_t priority = 0;
+    // The CPU the thread was running on when it was set up.
+    int32_t cpu = -1;
+    bool isFlushingDenormals = false;
+    bool isAffinitySet = false;
+};
+
+/**
+ * Prepares an audio callback thread the first time a stream calls back on it: it flushes
+ * denormals to zero so that decaying signals can't make the DSP suddenly many times slower,
+ * optionally restricts the thread to a set of CPUs, and records how the thread is scheduled.
+ *
+ * applyOnce() is called at the top of every callback and only does any work on the first.
+ * reset() must be called, while the stream isn't running, before each new stream uses it.
+ */
+class RealtimeThreadSetup {
+
+public:
+    // cpuMask has bit n set for CPU n. 0 leaves the thread free to run anywhere.
+    void reset(uint64_t cpuMask);
+    void applyOnce() {
+        if (!mIsApplied) apply();
+    }
+    // Returns false until the stream's first callback has run.
+    bool getInfo(RealtimeThreadInfo &info) const;
+    /**
+     * Logs the info once it's ready, which the callback doesn't do itself so as not to block.
+     * Returns true once it has been logged since the last reset(). Not safe to call at the same
+     * time as reset().
+     */
+    bool logInfo(const char *streamName);
+
+    /**
+     * The CPUs with the highest maximum frequency, which are the big cores on a big.LITTLE
+     * device, or 0 if they can't be told apart. Reads sysfs, so don't call it from a callback.
+     */
+    static uint64_t findFastestCpus();
+
+private:
+    uint64_t mCpuMask = 0;
+    // Only touched by the callback thread, apart from in reset().
+    bool mIsApplied = false;
+    RealtimeThreadInfo mInfo;
+    std::atomic<bool> mIsInfoReady { false };
+    bool mIsInfoLogged = false;
+
+    void apply();
+};
+
+#endif //WAVEMAKER2_REALTIMETHREAD_H
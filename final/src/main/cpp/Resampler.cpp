@@ -0,0 +1,180 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Resampler.h"
+#include "SoundRecordingUtilities.h"
+
+namespace {
+
+// Input is copied into the history this many frames at a time.
+constexpr int32_t kBlockFrames = 256;
+
+struct QualitySettings {
+    int32_t tapsPerPhase;
+    // Passband edge as a fraction of the lower of the two Nyquist frequencies.
+    double passband;
+    // Kaiser window shape. Higher values trade transition width for stopband attenuation.
+    double beta;
+};
+
+QualitySettings getQualitySettings(ResamplerQuality quality) {
+    switch (quality) {
+        case ResamplerQuality::Low: return { 16, 0.85, 6.0 };
+        case ResamplerQuality::High: return { 64, 0.95, 10.0 };
+        case ResamplerQuality::Medium:
+        default: return { 32, 0.91, 8.0 };
+    }
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+double besselI0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+int32_t greatestCommonDivisor(int32_t a, int32_t b) {
+    while (b != 0) {
+        const int32_t remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+} // namespace
+
+Resampler::Resampler(int32_t inputRate, int32_t outputRate, ResamplerQuality quality)
+        : mInputRate(inputRate), mOutputRate(outputRate) {
+
+    const QualitySettings settings = getQualitySettings(quality);
+    mTapsPerPhase = settings.tapsPerPhase;
+
+    const int32_t divisor = greatestCommonDivisor(inputRate, outputRate);
+    mPhaseCount = outputRate / divisor;
+    mStep = inputRate / divisor;
+    // For unusual rate pairs the position is still tracked exactly but each output frame uses the
+    // phase in the table just before it, which is less than 1/1024 of a frame out.
+    mTablePhaseCount = std::min(mPhaseCount, kResamplerMaxPhases);
+
+    // When downsampling the cutoff has to come down to the output's Nyquist frequency.
+    const double cutoff = settings.passband *
+                          std::min(1.0, static_cast<double>(mPhaseCount) / mStep);
+    const double halfLength = mTapsPerPhase / 2.0;
+    const double windowScale = 1.0 / besselI0(settings.beta);
+
+    mCoefficients.resize(mTablePhaseCount * mTapsPerPhase);
+    for (int32_t phase = 0; phase < mTablePhaseCount; ++phase) {
+        float *coefficients = &mCoefficients[phase * mTapsPerPhase];
+        const double fraction = static_cast<double>(phase) / mTablePhaseCount;
+        double sum = 0;
+        for (int32_t tap = 0; tap < mTapsPerPhase; ++tap) {
+            // Distance from the output time to the input frame this tap is applied to.
+            const double distance = fraction + halfLength - 1 - tap;
+            const double x = cutoff * distance;
+            const double sinc = (x == 0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            const double position = distance / halfLength;
+            const double window = (fabs(position) < 1) ?
+                    besselI0(settings.beta * sqrt(1 - position * position)) * windowScale : 0;
+            coefficients[tap] = static_cast<float>(cutoff * sinc * window);
+            sum += coefficients[tap];
+        }
+        // Normalise each phase so that there's no ripple at DC as the phase changes.
+        for (int32_t tap = 0; tap < mTapsPerPhase; ++tap) {
+            coefficients[tap] = static_cast<float>(coefficients[tap] / sum);
+        }
+    }
+
+    mHistory.resize(mTapsPerPhase - 1 + kBlockFrames);
+    reset();
+}
+
+void Resampler::reset() {
+
+    std::fill(mHistory.begin(), mHistory.end(), 0.0f);
+    // The first input frame goes in at mTapsPerPhase - 1. The first output frame lines up with it
+    // so has to wait for half a filter's worth of input after it.
+    mPosition = mTapsPerPhase - 1 + mTapsPerPhase / 2;
+    mPhase = 0;
+}
+
+int32_t Resampler::getMaxOutputFrames(int32_t numInputFrames) const {
+    return static_cast<int32_t>(
+            (static_cast<int64_t>(numInputFrames) * mPhaseCount + mStep - 1) / mStep) + 1;
+}
+
+int32_t Resampler::getMaxInputFrames(int32_t numOutputFrames) const {
+    if (numOutputFrames <= 1) return 0;
+    return static_cast<int32_t>(
+            static_cast<int64_t>(numOutputFrames - 1) * mStep / mPhaseCount);
+}
+
+int32_t Resampler::process(const float *input, int32_t numInputFrames, float *output) {
+
+    const int32_t historyFrames = mTapsPerPhase - 1;
+    int32_t framesWritten = 0;
+    for (int32_t start = 0; start < numInputFrames; start += kBlockFrames) {
+        const int32_t blockFrames = std::min(kBlockFrames, numInputFrames - start);
+        memcpy(&mHistory[historyFrames], &input[start], blockFrames * sizeof(float));
+        const int32_t available = historyFrames + blockFrames;
+
+        while (mPosition < available) {
+            const int32_t tablePhase = (mTablePhaseCount == mPhaseCount) ? mPhase :
+                    static_cast<int32_t>(static_cast<int64_t>(mPhase) * mTablePhaseCount /
+                                         mPhaseCount);
+            output[framesWritten++] = dotProduct(&mHistory[mPosition - historyFrames],
+                                                 &mCoefficients[tablePhase * mTapsPerPhase],
+                                                 mTapsPerPhase);
+            mPhase += mStep;
+            mPosition += mPhase / mPhaseCount;
+            mPhase %= mPhaseCount;
+        }
+
+        // Keep the frames the next block's first outputs will need.
+        memmove(mHistory.data(), &mHistory[blockFrames], historyFrames * sizeof(float));
+        mPosition -= blockFrames;
+    }
+    return framesWritten;
+}
+
+std::vector<float> resampleBuffer(const float *input, int32_t numFrames,
+                                  int32_t inputRate, int32_t outputRate,
+                                  ResamplerQuality quality) {
+
+    if (inputRate == outputRate) return std::vector<float>(input, input + numFrames);
+
+    Resampler resampler(inputRate, outputRate, quality);
+    std::vector<float> output(resampler.getMaxOutputFrames(numFrames + kBlockFrames));
+    int32_t framesWritten = resampler.process(input, numFrames, output.data());
+
+    // Flush the frames still waiting for input after them with silence.
+    const std::vector<float> silence(kBlockFrames, 0.0f);
+    framesWritten += resampler.process(silence.data(), kBlockFrames, &output[framesWritten]);
+
+    const int64_t expectedFrames =
+            (static_cast<int64_t>(numFrames) * outputRate + inputRate - 1) / inputRate;
+    output.resize(std::min<int64_t>(framesWritten, expectedFrames));
+    return output;
+}
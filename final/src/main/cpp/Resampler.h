@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_RESAMPLER_H
+#define WAVEMAKER2_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+// More taps give a steeper anti-aliasing filter and a wider passband at a higher cost per frame.
+enum class ResamplerQuality { Low, Medium, High };
+
+// The most filter phases we precompute. Rate pairs which need more share them.
+constexpr int32_t kResamplerMaxPhases = 1024;
+
+/**
+ * A streaming polyphase resampler for mono audio. The windowed-sinc coefficients for every phase
+ * are computed in the constructor, so process() doesn't allocate and is safe to call from an
+ * audio callback.
+ *
+ * Output frame n lines up with input time n * inputRate / outputRate. Because the filter needs
+ * input on both sides of that time, each output frame is only produced once half the filter's
+ * taps beyond it have arrived.
+ */
+class Resampler {
+
+public:
+    Resampler(int32_t inputRate, int32_t outputRate,
+              ResamplerQuality quality = ResamplerQuality::Medium);
+
+    int32_t getInputRate() const { return mInputRate; };
+    int32_t getOutputRate() const { return mOutputRate; };
+    // Output lags input by half this many frames, so flushing needs at least that much silence.
+    int32_t getTapsPerPhase() const { return mTapsPerPhase; };
+
+    // The most frames process() can write for numInputFrames of input.
+    int32_t getMaxOutputFrames(int32_t numInputFrames) const;
+    // The most input frames which are guaranteed to fit in numOutputFrames of output.
+    int32_t getMaxInputFrames(int32_t numOutputFrames) const;
+
+    /**
+     * Resample the next numInputFrames frames. output must have room for
+     * getMaxOutputFrames(numInputFrames) frames.
+     *
+     * @return the number of frames written to output
+     */
+    int32_t process(const float *input, int32_t numInputFrames, float *output);
+    void reset();
+
+private:
+    int32_t mInputRate;
+    int32_t mOutputRate;
+    int32_t mTapsPerPhase;
+    // The output rate is inputRate * mPhaseCount / mStep.
+    int32_t mPhaseCount;
+    int32_t mStep;
+    // Phases in the coefficient table, at most kResamplerMaxPhases.
+    int32_t mTablePhaseCount;
+    // mTapsPerPhase coefficients for each phase, reversed so that they line up with the history.
+    std::vector<float> mCoefficients;
+    // The last mTapsPerPhase - 1 input frames followed by the block being processed.
+    std::vector<float> mHistory;
+    // The newest history frame the next output frame needs, and how far past it that frame is
+    // in units of 1 / mPhaseCount frames.
+    int32_t mPosition = 0;
+    int32_t mPhase = 0;
+};
+
+// Resample a whole buffer at once, for example when importing a file recorded at another rate.
+std::vector<float> resampleBuffer(const float *input, int32_t numFrames,
+                                  int32_t inputRate, int32_t outputRate,
+                                  ResamplerQuality quality = ResamplerQuality::High);
+
+#endif //WAVEMAKER2_RESAMPLER_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <sys/mman.h>
+#include "Logging.h"
+#include "SampleBlockPool.h"
+
+// A block lasts ~340ms so checking every 20ms leaves plenty of time to top the pool back up.
+constexpr auto kRefillInterval = std::chrono::milliseconds(20);
+
+SampleBlockPool::~SampleBlockPool() {
+
+    stopRefilling();
+    uint8_t *block = nullptr;
+    while (mReadyBlocks.pop(block)) releaseBlock(block);
+}
+
+void SampleBlockPool::startRefilling() {
+
+    if (mIsRefilling.exchange(true)) return;
+
+    // Fill the pool before returning so that a take started straight away has blocks to use.
+    refill();
+    mRefillThread = std::thread([this](){
+        while (mIsRefilling) {
+            refill();
+            std::this_thread::sleep_for(kRefillInterval);
+        }
+    });
+}
+
+void SampleBlockPool::stopRefilling() {
+
+    mIsRefilling = false;
+    if (mRefillThread.joinable()) mRefillThread.join();
+}
+
+bool SampleBlockPool::reserve(int32_t numBlocks) {
+
+    {
+        // The memory lock limit may have been raised, or blocks holding locked memory freed.
+        std::lock_guard<std::mutex> lock(mRefillLock);
+        mReservedBlocks = static_cast<uint32_t>(std::max(0, std::min(numBlocks,
+                static_cast<int32_t>(kBlockPoolCapacity))));
+        mClaimedBlocks = 0;
+        mIsLockingAllowed = true;
+    }
+    return refill();
+}
+
+void SampleBlockPool::releaseReadyBlocks() {
+
+    std::lock_guard<std::mutex> lock(mRefillLock);
+    mReservedBlocks = 0;
+    mClaimedBlocks = 0;
+    uint8_t *block = nullptr;
+    while (mReadyBlocks.pop(block)) releaseBlock(block);
+}
+
+uint8_t *SampleBlockPool::claimBlock() {
+
+    uint8_t *block = nullptr;
+    if (mReadyBlocks.pop(block)) mClaimedBlocks.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void SampleBlockPool::releaseBlock(uint8_t *block) {
+
+    // Unlocking memory which was never locked does nothing.
+    if (block != nullptr) munlock(block, kBlockSizeInBytes);
+    delete[] block;
+}
+
+bool SampleBlockPool::refill() {
+
+    std::lock_guard<std::mutex> lock(mRefillLock);
+    // Blocks which have already been claimed hold takes, so they aren't replaced beyond the low
+    // watermark.
+    const uint32_t reservedBlocks = mReservedBlocks;
+    const uint32_t claimedBlocks = mClaimedBlocks.load(std::memory_order_relaxed);
+    const uint32_t unclaimedBlocks = (reservedBlocks > claimedBlocks) ?
+                                     reservedBlocks - claimedBlocks : 0;
+    const uint32_t targetBlocks = std::max(kBlockPoolLowWatermark, unclaimedBlocks);
+    while (mReadyBlocks.size() < targetBlocks) {
+        // Value-initialising the block touches every page here rather than on the audio thread.
+        uint8_t *block = new uint8_t[kBlockSizeInBytes]();
+        if (reservedBlocks > 0 && mIsLockingAllowed && mlock(block, kBlockSizeInBytes) != 0) {
+            // Apps usually have a small RLIMIT_MEMLOCK, so once it's been hit don't keep trying
+            // until the next reservation.
+            LOGD("Couldn't lock recording memory, it's prefaulted but may be paged out");
+            mIsLockingAllowed = false;
+        }
+        if (!mReadyBlocks.push(block)) {
+            releaseBlock(block);
+            break;
+        }
+    }
+    return reservedBlocks == 0 || mIsLockingAllowed;
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_SAMPLEBLOCKPOOL_H
+#define WAVEMAKER2_SAMPLEBLOCKPOOL_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "LockFreeQueue.h"
+
+// Blocks are raw storage so that recordings can pack samples in whichever format they use.
+constexpr int32_t kBlockSizeInBytes = 65536; // ~340ms of float audio data @ 48kHz
+constexpr int32_t kMaxBlocksPerRecording = 2048; // ~11.6 minutes of float audio @ 48kHz
+constexpr uint32_t kBlockPoolCapacity = 2048; // Enough for the longest recording
+constexpr uint32_t kBlockPoolLowWatermark = 8; // ~2.7s of headroom @ 48kHz
+
+/**
+ * A pool of preallocated sample blocks. The recording callback claims blocks without allocating,
+ * and a background thread allocates new blocks whenever the number of ready blocks drops below
+ * the low watermark, or below what's left of the reservation if one has been made.
+ *
+ * Every block is written to when it's allocated so that its pages are already mapped when the
+ * audio thread first touches them. Reserved blocks are also locked into memory where the system
+ * allows it, so that they can't be paged out again before they're used.
+ */
+class SampleBlockPool {
+
+public:
+    ~SampleBlockPool();
+    void startRefilling();
+    void stopRefilling();
+
+    /**
+     * Have numBlocks ready, allocating them before returning. Blocks claimed after this count
+     * against the reservation and only the low watermark is kept up beyond it, so the pool doesn't
+     * grow by a whole reservation after every take. Returns false if the blocks couldn't all be
+     * locked into memory, in which case they're still prefaulted and locking is tried again on
+     * the next call.
+     */
+    bool reserve(int32_t numBlocks);
+    // Frees every ready block and drops the reservation. Must not be called while the recording
+    // callback may be claiming blocks.
+    void releaseReadyBlocks();
+    int32_t getReadyBlockCount() const { return static_cast<int32_t>(mReadyBlocks.size()); };
+
+    // Called from the audio thread. Returns nullptr if no block is ready.
+    uint8_t *claimBlock();
+    static void releaseBlock(uint8_t *block);
+
+private:
+    LockFreeQueue<uint8_t *, kBlockPoolCapacity> mReadyBlocks;
+    std::atomic<bool> mIsRefilling { false };
+    std::thread mRefillThread;
+    // The ready queue has a single producer, so refills from reserve() and from the refill thread
+    // take turns.
+    std::mutex mRefillLock;
+    std::atomic<uint32_t> mReservedBlocks { 0 };
+    // Blocks claimed since the reservation was made.
+    std::atomic<uint32_t> mClaimedBlocks { 0 };
+    // Cleared when locking fails, until the next reservation. Guarded by mRefillLock.
+    bool mIsLockingAllowed = true;
+
+    bool refill();
+};
+
+#endif //WAVEMAKER2_SAMPLEBLOCKPOOL_H
@@ -14,28 +14,181 @@
  * limitations under the License.
  */
 
-#include <android/log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "SoundRecording.h"
 
-int32_t SoundRecording::write(const float *sourceData, int32_t numSamples) {
+SoundRecording::SoundRecording(SampleBlockPool &blockPool, StorageFormat format,
+                               int32_t bytesPerSample, bool isDecodedInPlace)
+        : mBlockPool(blockPool),
+          mFormat(format),
+          mBytesPerSample(bytesPerSample),
+          mSamplesPerBlock(kBlockSizeInBytes / bytesPerSample),
+          mMaxSamples(mSamplesPerBlock * kMaxBlocksPerRecording),
+          mMaxSegmentSamples(isDecodedInPlace ? mSamplesPerBlock : kDecodeChunkSamples),
+          mPeaks(blockPool) {
+}
+
+int32_t SoundRecording::write(const float *sourceData, int32_t numSamples,
+                              SignalLevels *levels) {
+
+    // Only the recording callback moves the write index forward so we can read it without
+    // synchronisation. It's published with release semantics once the samples have been copied
+    // so that the playback callback never sees an index ahead of the data.
+    const int32_t startIndex = mWriteIndex.load(std::memory_order_relaxed);
 
     // Check that data will fit, if it doesn't just write as much as we can.
-    if (mWriteIndex + numSamples > kMaxSamples) {
-        numSamples = kMaxSamples - mWriteIndex;
+    if (startIndex + numSamples > mMaxSamples) {
+        numSamples = mMaxSamples - startIndex;
     }
 
-    for (int i = 0; i < numSamples; ++i) {
-        mData[mWriteIndex++] = sourceData[i];
+    // Encode one segment per block, claiming a new block from the pool when we cross into it. If
+    // the pool has run dry we stop short and report how much was written.
+    int32_t writeIndex = startIndex;
+    const int32_t endIndex = startIndex + numSamples;
+    while (writeIndex < endIndex) {
+        const int32_t blockIndex = writeIndex / mSamplesPerBlock;
+        const int32_t blockOffset = writeIndex % mSamplesPerBlock;
+        if (mBlocks[blockIndex] == nullptr) {
+            mBlocks[blockIndex] = mBlockPool.claimBlock();
+            if (mBlocks[blockIndex] == nullptr) break;
+        }
+        const int32_t segmentLength = std::min(endIndex - writeIndex,
+                                               mSamplesPerBlock - blockOffset);
+        encode(&sourceData[writeIndex - startIndex],
+               &mBlocks[blockIndex][blockOffset * mBytesPerSample], segmentLength, levels);
+        writeIndex += segmentLength;
     }
-    return numSamples;
+    mPeaks.append(sourceData, writeIndex - startIndex);
+    mWriteIndex.store(writeIndex, std::memory_order_release);
+    return writeIndex - startIndex;
 }
 
 int32_t SoundRecording::read(float *targetData, int32_t numSamples){
 
-    int32_t framesRead = 0;
-    while (framesRead < numSamples && mReadIndex < mWriteIndex){
-        targetData[framesRead++] = mData[mReadIndex++];
-        if (mIsLooping && mReadIndex == mWriteIndex) mReadIndex = 0;
+    return readSegments(numSamples, [targetData](const float *samples, int32_t offset,
+                                                 int32_t length){
+        memcpy(&targetData[offset], samples, length * sizeof(float));
+    });
+}
+
+int32_t SoundRecording::skip(int32_t numSamples) {
+
+    // Same as reading but without touching, or decoding, the samples.
+    const int32_t length = getReadableLength();
+    const bool isLooping = mIsLooping.load(std::memory_order_relaxed);
+    int32_t readIndex = wrapReadIndex(mReadIndex.load(std::memory_order_relaxed), length,
+                                      isLooping);
+    int32_t samplesSkipped = 0;
+    while (samplesSkipped < numSamples && readIndex < length) {
+        const int32_t segmentLength = std::min(numSamples - samplesSkipped, length - readIndex);
+        samplesSkipped += segmentLength;
+        readIndex += segmentLength;
+        if (isLooping && readIndex == length) readIndex = 0;
+    }
+    mReadIndex.store(readIndex, std::memory_order_release);
+    return samplesSkipped;
+}
+
+void SoundRecording::setLoopLength(int32_t numSamples) {
+
+    mLoopLength = numSamples;
+
+    // The playback callback may be reading, in which case it wraps the position itself. Only
+    // replace the position it last stored, so that a newer one is never overwritten.
+    const int32_t length = getReadableLength();
+    const bool isLooping = mIsLooping.load(std::memory_order_relaxed);
+    int32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    while (wrapReadIndex(readIndex, length, isLooping) != readIndex &&
+           !mReadIndex.compare_exchange_weak(readIndex,
+                                             wrapReadIndex(readIndex, length, isLooping))) {
+    }
+}
+
+void SoundRecording::pin(RecordingSnapshot &snapshot) {
+
+    pin();
+    snapshot.format = mFormat;
+    snapshot.bytesPerSample = mBytesPerSample;
+    snapshot.samplesPerBlock = mSamplesPerBlock;
+    snapshot.numSamples = mWriteIndex.load(std::memory_order_acquire);
+    const int32_t numBlocks = (snapshot.numSamples + mSamplesPerBlock - 1) / mSamplesPerBlock;
+    snapshot.blocks.assign(mBlocks.begin(), mBlocks.begin() + numBlocks);
+}
+
+void SoundRecording::releaseBlocks() {
+
+    mWriteIndex = 0;
+    mReadIndex = 0;
+    for (uint8_t *&block : mBlocks) {
+        SampleBlockPool::releaseBlock(block);
+        block = nullptr;
+    }
+    mPeaks.releaseBlocks();
+}
+
+int32_t SoundRecording::getPeaks(int32_t startSample, int32_t endSample, int32_t numBins,
+                                 PeakBin *bins) {
+
+    if (numBins <= 0 || startSample < 0 || endSample <= startSample) return 0;
+    const int64_t span = endSample - startSample;
+    if (span >= static_cast<int64_t>(numBins) * kPeakBinSamples) {
+        return mPeaks.getPeaks(startSample, endSample, numBins, bins);
+    }
+
+    // Each bin covers fewer samples than a summary bin, so it's as cheap to read them.
+    const int32_t length = mWriteIndex.load(std::memory_order_acquire);
+    std::array<float, kPeakBinSamples> samples;
+    int32_t binsWritten = 0;
+    for (; binsWritten < numBins; ++binsWritten) {
+        const auto first = static_cast<int32_t>(startSample + span * binsWritten / numBins);
+        const auto last = std::max(first + 1, static_cast<int32_t>(
+                startSample + span * (binsWritten + 1) / numBins));
+        if (last > length) break;
+        copySamples(first, samples.data(), last - first);
+        float minimum = samples[0];
+        float maximum = samples[0];
+        float sumOfSquares = 0;
+        for (int32_t i = 0; i < last - first; ++i) {
+            minimum = std::min(minimum, samples[i]);
+            maximum = std::max(maximum, samples[i]);
+            sumOfSquares += samples[i] * samples[i];
+        }
+        bins[binsWritten].min = minimum;
+        bins[binsWritten].max = maximum;
+        bins[binsWritten].rms = sqrtf(sumOfSquares / (last - first));
     }
-    return framesRead;
-}
\ No newline at end of file
+    return binsWritten;
+}
+
+void SoundRecording::copySamples(int32_t position, float *target, int32_t numSamples) {
+
+    int32_t samplesCopied = 0;
+    while (samplesCopied < numSamples) {
+        const int32_t blockIndex = position / mSamplesPerBlock;
+        const int32_t blockOffset = position % mSamplesPerBlock;
+        const int32_t segmentLength = std::min(numSamples - samplesCopied,
+                                               mSamplesPerBlock - blockOffset);
+        const float *samples = decode(&mBlocks[blockIndex][blockOffset * mBytesPerSample],
+                                      &target[samplesCopied], segmentLength);
+        if (samples != &target[samplesCopied]) {
+            memcpy(&target[samplesCopied], samples, segmentLength * sizeof(float));
+        }
+        samplesCopied += segmentLength;
+        position += segmentLength;
+    }
+}
+
+std::unique_ptr<SoundRecording> createSoundRecording(StorageFormat format,
+                                                     SampleBlockPool &blockPool) {
+    switch (format) {
+        case StorageFormat::I16:
+            return std::unique_ptr<SoundRecording>(new Int16SoundRecording(blockPool));
+        case StorageFormat::Packed24:
+            return std::unique_ptr<SoundRecording>(new Packed24SoundRecording(blockPool));
+        case StorageFormat::Float:
+        default:
+            return std::unique_ptr<SoundRecording>(new FloatSoundRecording(blockPool));
+    }
+}
@@ -17,31 +17,289 @@
 #ifndef WAVEMAKER2_SAMPLE_H
 #define WAVEMAKER2_SAMPLE_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <array>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 #include "Definitions.h"
+#include "PeakPyramid.h"
+#include "SampleBlockPool.h"
+#include "SoundRecordingUtilities.h"
 
-constexpr int kMaxSamples = 480000; // 10s of audio data @ 48kHz
+// Compact formats are decoded into a buffer this many samples at a time as they're read.
+constexpr int32_t kDecodeChunkSamples = 256;
 
+// How a recording stores its samples. The smaller formats fit 2 or 4/3 times as much audio into
+// the same memory, at the cost of converting on every write and read.
+enum class StorageFormat : int32_t { Float, I16, Packed24 };
+
+inline int32_t getBytesPerSample(StorageFormat format) {
+    switch (format) {
+        case StorageFormat::I16: return sizeof(int16_t);
+        case StorageFormat::Packed24: return 3;
+        case StorageFormat::Float:
+        default: return sizeof(float);
+    }
+}
+
+/**
+ * A read-only view of the samples a recording held when it was pinned. Samples are stored in the
+ * recording's format, packed into blocks of samplesPerBlock, the last of which may be partly
+ * filled. The blocks stay valid until the recording is unpinned.
+ */
+struct RecordingSnapshot {
+    StorageFormat format;
+    int32_t bytesPerSample;
+    int32_t samplesPerBlock;
+    int32_t numSamples;
+    std::vector<const uint8_t *> blocks;
+};
+
+/**
+ * Single-producer, single-consumer sample store. write() must only be called from the recording
+ * callback and read() only from the playback callback.
+ *
+ * Samples are stored in fixed-size blocks claimed from a SampleBlockPool as the recording grows.
+ * Blocks are kept when the recording is cleared so that the next take can reuse them.
+ *
+ * This class handles the blocks and positions. BasicSoundRecording fills in how samples are
+ * encoded, and createSoundRecording() picks one at run time.
+ */
 class SoundRecording {
 
 public:
-    int32_t write(const float *sourceData, int32_t numSamples);
+    virtual ~SoundRecording() { releaseBlocks(); };
+    /**
+     * Append up to numSamples, returning how many were stored. If levels isn't nullptr the stored
+     * samples are also measured into it, in the same pass as the copy for float recordings.
+     */
+    int32_t write(const float *sourceData, int32_t numSamples, SignalLevels *levels = nullptr);
     int32_t read(float *targetData, int32_t numSamples);
-    bool isFull() const { return (mWriteIndex == kMaxSamples); };
+
+    /**
+     * Read up to numSamples by passing each contiguous run of stored samples to
+     * visitSegment(const float *samples, int32_t offset, int32_t length), where offset is the
+     * position of the run in the output. Float recordings are passed in place, other formats are
+     * decoded a chunk at a time first. Returns the number of samples read.
+     */
+    template <typename SegmentVisitor>
+    int32_t readSegments(int32_t numSamples, SegmentVisitor &&visitSegment);
+
+    // Advance the read position as if numSamples had been read. Returns the number skipped.
+    int32_t skip(int32_t numSamples);
+    bool isFull() const { return (mWriteIndex == mMaxSamples); };
     void setReadPositionToStart() { mReadIndex = 0; };
-    void clear() { mWriteIndex = 0; };
+    // Playback callback only. Positions outside the recording, or its loop, wrap round.
+    int32_t getReadPosition() const { return mReadIndex.load(std::memory_order_relaxed); };
+    void setReadPosition(int64_t position) {
+        const int32_t length = getReadableLength();
+        const int64_t wrapped = (length > 0) ? position % length : 0;
+        mReadIndex = static_cast<int32_t>((wrapped < 0) ? wrapped + length : wrapped);
+    };
+    void clear() { mWriteIndex = 0; mPeaks.clear(); };
     void setLooping(bool isLooping) { mIsLooping = isLooping; };
+    // Loop over the first numSamples of the recording rather than all of it. 0 means all of it.
+    // If the loop now ends before the read position, reading carries on from the same place in
+    // the shorter loop.
+    void setLoopLength(int32_t numSamples);
     int32_t getLength() const { return mWriteIndex; };
-    static const int32_t getMaxSamples() { return kMaxSamples; };
+    // Samples left to read before the end of the recording, or of its loop. Playback callback only.
+    int32_t getSamplesUntilEnd() const {
+        const int32_t length = getReadableLength();
+        return std::max(0, length - wrapReadIndex(mReadIndex.load(std::memory_order_relaxed),
+                                                  length, mIsLooping));
+    };
+    int32_t getMaxSamples() const { return mMaxSamples; };
+    // Memory held by the blocks which the recorded samples occupy.
+    int64_t getStorageBytes() const {
+        const int32_t numBlocks = (mWriteIndex + mSamplesPerBlock - 1) / mSamplesPerBlock;
+        return static_cast<int64_t>(numBlocks) * kBlockSizeInBytes;
+    };
+    StorageFormat getStorageFormat() const { return mFormat; };
+
+    /**
+     * Summarise samples [startSample, endSample) into numBins min, max and RMS bins for drawing
+     * the waveform. Zoomed out, the bins come from a summary which write() keeps up to date.
+     * Zoomed in to fewer than kPeakBinSamples per bin, the samples are read directly. Either way
+     * the cost is proportional to numBins.
+     *
+     * Safe to call from any thread while the recording is being written or read, but not at the
+     * same time as clear() or releaseBlocks(). Returns the number of bins written, which is fewer
+     * than numBins if the range runs past what has been recorded.
+     */
+    int32_t getPeaks(int32_t startSample, int32_t endSample, int32_t numBins, PeakBin *bins);
+
+    /**
+     * Snapshot the samples recorded so far, which later writes never touch. Recording can carry
+     * on while the recording is pinned, but the owner must neither clear nor destroy it until
+     * every pin has been released with unpin(). Not safe to call from the audio callbacks.
+     */
+    void pin(RecordingSnapshot &snapshot);
+    // Pin without taking a snapshot, to keep the recording while something else is writing it.
+    void pin() { mPinCount++; };
+    void unpin() { mPinCount--; };
+    bool isPinned() const { return mPinCount > 0; };
+
+    // Must not be called while either callback is running.
+    void releaseBlocks();
+
+protected:
+    SoundRecording(SampleBlockPool &blockPool, StorageFormat format, int32_t bytesPerSample,
+                   bool isDecodedInPlace);
 
 private:
+    SampleBlockPool &mBlockPool;
+    const StorageFormat mFormat;
+    const int32_t mBytesPerSample;
+    const int32_t mSamplesPerBlock;
+    const int32_t mMaxSamples;
+    const int32_t mMaxSegmentSamples;
     std::atomic<int32_t> mWriteIndex { 0 };
     std::atomic<int32_t> mReadIndex { 0 };
     std::atomic<bool> mIsLooping { false };
-    std::array<float,kMaxSamples> mData { 0 };
+    std::atomic<int32_t> mLoopLength { 0 };
+    std::atomic<int32_t> mPinCount { 0 };
+
+    // Only the recording callback adds blocks, and a block is always in place before the write
+    // index that covers it is published.
+    std::array<uint8_t *, kMaxBlocksPerRecording> mBlocks {};
+    // Playback callback only.
+    std::array<float, kDecodeChunkSamples> mDecodeBuffer;
+    PeakPyramid mPeaks;
+
+    int32_t getReadableLength() const {
+        const int32_t writeIndex = mWriteIndex.load(std::memory_order_acquire);
+        const int32_t loopLength = mLoopLength.load(std::memory_order_relaxed);
+        return (loopLength > 0) ? std::min(loopLength, writeIndex) : writeIndex;
+    }
+
+    // A looping read position which a shortened loop has left behind wraps into the loop.
+    static int32_t wrapReadIndex(int32_t readIndex, int32_t length, bool isLooping) {
+        return (isLooping && length > 0 && readIndex >= length) ? readIndex % length : readIndex;
+    }
+
+    // Decodes samples below the write index into target. Doesn't move the read position.
+    void copySamples(int32_t position, float *target, int32_t numSamples);
+
+    virtual void encode(const float *source, uint8_t *target, int32_t numSamples,
+                        SignalLevels *levels) = 0;
+    // Returns the decoded samples, which are either in target or, for float, still in source.
+    virtual const float *decode(const uint8_t *source, float *target, int32_t numSamples) = 0;
+};
+
+template <typename SegmentVisitor>
+int32_t SoundRecording::readSegments(int32_t numSamples, SegmentVisitor &&visitSegment) {
+
+    // Load the shared state once per callback rather than once per sample.
+    const int32_t length = getReadableLength();
+    const bool isLooping = mIsLooping.load(std::memory_order_relaxed);
+    int32_t readIndex = wrapReadIndex(mReadIndex.load(std::memory_order_relaxed), length,
+                                      isLooping);
+
+    // Visit contiguous segments up to the end of each block or the end of the recording, wrapping
+    // back to the start if we're looping. Every block below the write index is already in place
+    // so this never waits on the recording callback.
+    int32_t samplesRead = 0;
+    while (samplesRead < numSamples && readIndex < length){
+        const int32_t blockIndex = readIndex / mSamplesPerBlock;
+        const int32_t blockOffset = readIndex % mSamplesPerBlock;
+        const int32_t segmentLength = std::min({numSamples - samplesRead, length - readIndex,
+                                                mSamplesPerBlock - blockOffset,
+                                                mMaxSegmentSamples});
+        const float *samples = decode(&mBlocks[blockIndex][blockOffset * mBytesPerSample],
+                                      mDecodeBuffer.data(), segmentLength);
+        visitSegment(samples, samplesRead, segmentLength);
+        samplesRead += segmentLength;
+        readIndex += segmentLength;
+        if (isLooping && readIndex == length) readIndex = 0;
+    }
+    mReadIndex.store(readIndex, std::memory_order_release);
+    return samplesRead;
+}
+
+/**
+ * A recording whose sample format is fixed at compile time. CODEC provides kFormat,
+ * kBytesPerSample, kIsDecodedInPlace and static encode() and decode() functions with the same
+ * signatures as SoundRecording's.
+ */
+template <typename CODEC>
+class BasicSoundRecording final : public SoundRecording {
+
+public:
+    explicit BasicSoundRecording(SampleBlockPool &blockPool)
+            : SoundRecording(blockPool, CODEC::kFormat, CODEC::kBytesPerSample,
+                             CODEC::kIsDecodedInPlace) {};
+
+private:
+    void encode(const float *source, uint8_t *target, int32_t numSamples,
+                SignalLevels *levels) override {
+        CODEC::encode(source, target, numSamples, levels);
+    }
+    const float *decode(const uint8_t *source, float *target, int32_t numSamples) override {
+        return CODEC::decode(source, target, numSamples);
+    }
+};
+
+struct FloatCodec {
+    static constexpr StorageFormat kFormat = StorageFormat::Float;
+    static constexpr int32_t kBytesPerSample = sizeof(float);
+    static constexpr bool kIsDecodedInPlace = true;
+
+    static void encode(const float *source, uint8_t *target, int32_t numSamples,
+                       SignalLevels *levels) {
+        if (levels == nullptr) {
+            memcpy(target, source, numSamples * sizeof(float));
+        } else {
+            copyArrayWithLevels(source, reinterpret_cast<float *>(target), numSamples, *levels);
+        }
+    }
+    static const float *decode(const uint8_t *source, float *, int32_t) {
+        return reinterpret_cast<const float *>(source);
+    }
+};
+
+struct Int16Codec {
+    static constexpr StorageFormat kFormat = StorageFormat::I16;
+    static constexpr int32_t kBytesPerSample = sizeof(int16_t);
+    static constexpr bool kIsDecodedInPlace = false;
+
+    static void encode(const float *source, uint8_t *target, int32_t numSamples,
+                       SignalLevels *levels) {
+        // The segment is still in cache when it's converted straight after being measured.
+        if (levels != nullptr) measureArrayLevels(source, numSamples, *levels);
+        convertArrayFloatToInt16(source, reinterpret_cast<int16_t *>(target), numSamples);
+    }
+    static const float *decode(const uint8_t *source, float *target, int32_t numSamples) {
+        convertArrayInt16ToFloat(reinterpret_cast<const int16_t *>(source), target, numSamples);
+        return target;
+    }
 };
 
+struct Packed24Codec {
+    static constexpr StorageFormat kFormat = StorageFormat::Packed24;
+    static constexpr int32_t kBytesPerSample = 3;
+    static constexpr bool kIsDecodedInPlace = false;
+
+    static void encode(const float *source, uint8_t *target, int32_t numSamples,
+                       SignalLevels *levels) {
+        if (levels != nullptr) measureArrayLevels(source, numSamples, *levels);
+        convertArrayFloatToPacked24(source, target, numSamples);
+    }
+    static const float *decode(const uint8_t *source, float *target, int32_t numSamples) {
+        convertArrayPacked24ToFloat(source, target, numSamples);
+        return target;
+    }
+};
+
+using FloatSoundRecording = BasicSoundRecording<FloatCodec>;
+using Int16SoundRecording = BasicSoundRecording<Int16Codec>;
+using Packed24SoundRecording = BasicSoundRecording<Packed24Codec>;
+
+std::unique_ptr<SoundRecording> createSoundRecording(StorageFormat format,
+                                                     SampleBlockPool &blockPool);
+
 #endif //WAVEMAKER2_SAMPLE_H
@@ -14,43 +14,803 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include "SoundRecordingUtilities.h"
 
-float convertInt16ToFloat(int16_t intValue){
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// We use asymmetrical conversion (different calculation for positive and negative values)
+// because int16 has a range of -32768 to +32767 and we should preserve the minimum and
+// maximum values. -32768 => -1, 0 => 0, 32767 => 1
+// More info here: http://blog.bjornroche.com/2009/12/linearity-and-dynamic-range-in-int.html
+constexpr float kNegativeMultiplier = -1.0f/INT16_MIN;
+constexpr float kPositiveMultiplier = 1.0f/INT16_MAX;
+constexpr int32_t kInt24Min = -8388608;
+constexpr int32_t kInt24Max = 8388607;
+constexpr float kNegativeMultiplier24 = -1.0f/kInt24Min;
+constexpr float kPositiveMultiplier24 = 1.0f/kInt24Max;
+// Samples at or beyond full scale will be clipped when they're stored as integers.
+constexpr float kClipLevel = 1.0f;
+
+// Clip to -1 to 1 the way the SIMD min and max instructions do, taking the limit whenever the
+// comparison fails, so that NaN comes out as full scale from every implementation.
+inline float clampToFullScale(float value) {
+    value = (value < 1.0f) ? value : 1.0f;
+    return (value > -1.0f) ? value : -1.0f;
+}
 
-    // We use asymmetrical conversion (different calculation for positive and negative values)
-    // because int16 has a range of -32768 to +32767 and we should preserve the minimum and
-    // maximum values. -32768 => -1, 0 => 0, 32767 => 1
-    // More info here: http://blog.bjornroche.com/2009/12/linearity-and-dynamic-range-in-int.html
-    const float negative_multiplier = -1.0f/INT16_MIN;
-    const float positive_multiplier = 1.0f/INT16_MAX;
+float convertInt16ToFloat(int16_t intValue){
 
     float floatValue = 0;
 
     if (intValue < 0){
-        floatValue = intValue * negative_multiplier;
+        floatValue = intValue * kNegativeMultiplier;
     } else if (intValue > 0){
-        floatValue = intValue * positive_multiplier;
+        floatValue = intValue * kPositiveMultiplier;
     }
     return floatValue;
 }
 
-void convertArrayInt16ToFloat(int16_t *source, float *target, int32_t length){
+int16_t convertFloatToInt16(float floatValue){
+
+    // The inverse of convertInt16ToFloat. Values outside -1 to 1 are clipped and the result is
+    // rounded to the nearest integer.
+    floatValue = clampToFullScale(floatValue);
+    const float scaledValue = floatValue * ((floatValue < 0) ? -INT16_MIN : INT16_MAX);
+    return static_cast<int16_t>(lrintf(scaledValue));
+}
+
+namespace {
+
+struct ArrayKernels {
+    const char *name;
+    void (*int16ToFloat)(const int16_t *, float *, int32_t);
+    void (*floatToInt16)(const float *, int16_t *, int32_t);
+    void (*packed24ToFloat)(const uint8_t *, float *, int32_t);
+    void (*floatToPacked24)(const float *, uint8_t *, int32_t);
+    void (*monoToStereo)(float *, int32_t);
+    void (*interleave)(const float *, const float *, float *, int32_t);
+    void (*deinterleave)(const float *, float *, float *, int32_t);
+    void (*mixWithGain)(const float *, float *, float, int32_t);
+    float (*dotProduct)(const float *, const float *, int32_t);
+    // target may be nullptr to only measure.
+    void (*copyWithLevels)(const float *, float *, int32_t, SignalLevels &);
+};
 
+// Scalar implementations. These are the reference output for all the others, which use them to
+// handle whatever samples don't fill a whole vector.
+
+void int16ToFloatScalar(const int16_t *source, float *target, int32_t length) {
     for (int i = 0; i < length; ++i) {
         target[i] = convertInt16ToFloat(source[i]);
     }
 }
 
-void fillArrayWithZeros(float *data, int32_t length) {
-    memset(data, 0, length * sizeof(float));
+void floatToInt16Scalar(const float *source, int16_t *target, int32_t length) {
+    for (int i = 0; i < length; ++i) {
+        target[i] = convertFloatToInt16(source[i]);
+    }
 }
 
-void convertArrayMonoToStereo(float *data, int32_t numFrames) {
+void packed24ToFloatScalar(const uint8_t *source, float *target, int32_t length) {
+    for (int i = 0; i < length; ++i) {
+        // Put the sample in the top three bytes of an int32, then shift it down to sign extend.
+        const uint32_t bits = (static_cast<uint32_t>(source[i*3]) << 8) |
+                              (static_cast<uint32_t>(source[(i*3)+1]) << 16) |
+                              (static_cast<uint32_t>(source[(i*3)+2]) << 24);
+        const int32_t value = static_cast<int32_t>(bits) >> 8;
+        target[i] = value * ((value < 0) ? kNegativeMultiplier24 : kPositiveMultiplier24);
+    }
+}
 
+void floatToPacked24Scalar(const float *source, uint8_t *target, int32_t length) {
+    for (int i = 0; i < length; ++i) {
+        const float value = clampToFullScale(source[i]);
+        const auto scaled = static_cast<int32_t>(
+                lrintf(value * ((value < 0) ? -kInt24Min : kInt24Max)));
+        target[i*3] = static_cast<uint8_t>(scaled);
+        target[(i*3)+1] = static_cast<uint8_t>(scaled >> 8);
+        target[(i*3)+2] = static_cast<uint8_t>(scaled >> 16);
+    }
+}
+
+void monoToStereoScalar(float *data, int32_t numFrames) {
+    // Work backwards so that the stereo frames don't overwrite mono samples we haven't read yet.
     for (int i = numFrames - 1; i >= 0; i--) {
         data[i*2] = data[i];
         data[(i*2)+1] = data[i];
     }
-}
\ No newline at end of file
+}
+
+void interleaveScalar(const float *left, const float *right, float *target, int32_t numFrames) {
+    for (int i = 0; i < numFrames; ++i) {
+        target[i*2] = left[i];
+        target[(i*2)+1] = right[i];
+    }
+}
+
+void deinterleaveScalar(const float *source, float *left, float *right, int32_t numFrames) {
+    for (int i = 0; i < numFrames; ++i) {
+        left[i] = source[i*2];
+        right[i] = source[(i*2)+1];
+    }
+}
+
+void mixWithGainScalar(const float *source, float *target, float gain, int32_t length) {
+    for (int i = 0; i < length; ++i) {
+        target[i] += source[i] * gain;
+    }
+}
+
+float dotProductScalar(const float *a, const float *b, int32_t length) {
+    float sum = 0;
+    for (int i = 0; i < length; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void copyWithLevelsScalar(const float *source, float *target, int32_t length,
+                          SignalLevels &levels) {
+    float peak = levels.peak;
+    float sumOfSquares = 0;
+    int32_t clipCount = 0;
+    for (int i = 0; i < length; ++i) {
+        const float value = source[i];
+        if (target != nullptr) target[i] = value;
+        const float magnitude = fabsf(value);
+        peak = std::max(peak, magnitude);
+        sumOfSquares += value * value;
+        if (magnitude >= kClipLevel) clipCount++;
+    }
+    levels.peak = peak;
+    levels.sumOfSquares += sumOfSquares;
+    levels.clipCount += clipCount;
+    levels.numSamples += length;
+}
+
+constexpr ArrayKernels kScalarKernels = {
+        "scalar",
+        int16ToFloatScalar,
+        floatToInt16Scalar,
+        packed24ToFloatScalar,
+        floatToPacked24Scalar,
+        monoToStereoScalar,
+        interleaveScalar,
+        deinterleaveScalar,
+        mixWithGainScalar,
+        dotProductScalar,
+        copyWithLevelsScalar
+};
+
+#if defined(__aarch64__)
+
+void int16ToFloatNeon(const int16_t *source, float *target, int32_t length) {
+    const float32x4_t negative = vdupq_n_f32(kNegativeMultiplier);
+    const float32x4_t positive = vdupq_n_f32(kPositiveMultiplier);
+    const float32x4_t zero = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const int16x8_t in = vld1q_s16(&source[i]);
+        const float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(in)));
+        const float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(in)));
+        vst1q_f32(&target[i], vmulq_f32(low, vbslq_f32(vcltq_f32(low, zero), negative, positive)));
+        vst1q_f32(&target[i+4], vmulq_f32(high, vbslq_f32(vcltq_f32(high, zero), negative, positive)));
+    }
+    int16ToFloatScalar(&source[i], &target[i], length - i);
+}
+
+void floatToInt16Neon(const float *source, int16_t *target, int32_t length) {
+    const float32x4_t negative = vdupq_n_f32(-INT16_MIN);
+    const float32x4_t positive = vdupq_n_f32(INT16_MAX);
+    const float32x4_t zero = vdupq_n_f32(0);
+    const float32x4_t minimum = vdupq_n_f32(-1.0f);
+    const float32x4_t maximum = vdupq_n_f32(1.0f);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        // The "nm" versions return the limit rather than NaN, like clampToFullScale().
+        float32x4_t low = vmaxnmq_f32(vminnmq_f32(vld1q_f32(&source[i]), maximum), minimum);
+        float32x4_t high = vmaxnmq_f32(vminnmq_f32(vld1q_f32(&source[i+4]), maximum), minimum);
+        low = vmulq_f32(low, vbslq_f32(vcltq_f32(low, zero), negative, positive));
+        high = vmulq_f32(high, vbslq_f32(vcltq_f32(high, zero), negative, positive));
+        vst1q_s16(&target[i], vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(low)),
+                                            vqmovn_s32(vcvtnq_s32_f32(high))));
+    }
+    floatToInt16Scalar(&source[i], &target[i], length - i);
+}
+
+void packed24ToFloatNeon(const uint8_t *source, float *target, int32_t length) {
+    const float32x4_t negative = vdupq_n_f32(kNegativeMultiplier24);
+    const float32x4_t positive = vdupq_n_f32(kPositiveMultiplier24);
+    const float32x4_t zero = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        // De-interleave the bytes of 8 samples, then build each sample in the top three bytes of
+        // an int32 and shift it down to sign extend.
+        const uint8x8x3_t in = vld3_u8(&source[i*3]);
+        const uint16x8_t low = vshll_n_u8(in.val[0], 8);
+        const uint16x8_t high = vorrq_u16(vmovl_u8(in.val[1]), vshll_n_u8(in.val[2], 8));
+        const uint32x4_t first = vorrq_u32(vshll_n_u16(vget_low_u16(high), 16),
+                                           vmovl_u16(vget_low_u16(low)));
+        const uint32x4_t second = vorrq_u32(vshll_n_u16(vget_high_u16(high), 16),
+                                            vmovl_u16(vget_high_u16(low)));
+        const float32x4_t a = vcvtq_f32_s32(vshrq_n_s32(vreinterpretq_s32_u32(first), 8));
+        const float32x4_t b = vcvtq_f32_s32(vshrq_n_s32(vreinterpretq_s32_u32(second), 8));
+        vst1q_f32(&target[i], vmulq_f32(a, vbslq_f32(vcltq_f32(a, zero), negative, positive)));
+        vst1q_f32(&target[i+4], vmulq_f32(b, vbslq_f32(vcltq_f32(b, zero), negative, positive)));
+    }
+    packed24ToFloatScalar(&source[i*3], &target[i], length - i);
+}
+
+void floatToPacked24Neon(const float *source, uint8_t *target, int32_t length) {
+    const float32x4_t negative = vdupq_n_f32(-kInt24Min);
+    const float32x4_t positive = vdupq_n_f32(kInt24Max);
+    const float32x4_t zero = vdupq_n_f32(0);
+    const float32x4_t minimum = vdupq_n_f32(-1.0f);
+    const float32x4_t maximum = vdupq_n_f32(1.0f);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        // The "nm" versions return the limit rather than NaN, like clampToFullScale().
+        float32x4_t low = vmaxnmq_f32(vminnmq_f32(vld1q_f32(&source[i]), maximum), minimum);
+        float32x4_t high = vmaxnmq_f32(vminnmq_f32(vld1q_f32(&source[i+4]), maximum), minimum);
+        low = vmulq_f32(low, vbslq_f32(vcltq_f32(low, zero), negative, positive));
+        high = vmulq_f32(high, vbslq_f32(vcltq_f32(high, zero), negative, positive));
+        const uint32x4_t a = vreinterpretq_u32_s32(vcvtnq_s32_f32(low));
+        const uint32x4_t b = vreinterpretq_u32_s32(vcvtnq_s32_f32(high));
+        // Narrowing keeps the low byte, so shift each of the three bytes down in turn.
+        uint8x8x3_t out;
+        out.val[0] = vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b)));
+        out.val[1] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(a, 8)),
+                                            vmovn_u32(vshrq_n_u32(b, 8))));
+        out.val[2] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(a, 16)),
+                                            vmovn_u32(vshrq_n_u32(b, 16))));
+        vst3_u8(&target[i*3], out);
+    }
+    floatToPacked24Scalar(&source[i], &target[i*3], length - i);
+}
+
+void monoToStereoNeon(float *data, int32_t numFrames) {
+    // Do the frames which don't fill a vector first, then work backwards through the rest.
+    const int32_t vectorFrames = numFrames & ~3;
+    for (int i = numFrames - 1; i >= vectorFrames; i--) {
+        data[i*2] = data[i];
+        data[(i*2)+1] = data[i];
+    }
+    for (int i = vectorFrames - 4; i >= 0; i -= 4) {
+        const float32x4_t in = vld1q_f32(&data[i]);
+        vst2q_f32(&data[i*2], (float32x4x2_t {{ in, in }}));
+    }
+}
+
+void interleaveNeon(const float *left, const float *right, float *target, int32_t numFrames) {
+    int i = 0;
+    for (; i + 4 <= numFrames; i += 4) {
+        vst2q_f32(&target[i*2], (float32x4x2_t {{ vld1q_f32(&left[i]), vld1q_f32(&right[i]) }}));
+    }
+    interleaveScalar(&left[i], &right[i], &target[i*2], numFrames - i);
+}
+
+void deinterleaveNeon(const float *source, float *left, float *right, int32_t numFrames) {
+    int i = 0;
+    for (; i + 4 <= numFrames; i += 4) {
+        const float32x4x2_t in = vld2q_f32(&source[i*2]);
+        vst1q_f32(&left[i], in.val[0]);
+        vst1q_f32(&right[i], in.val[1]);
+    }
+    deinterleaveScalar(&source[i*2], &left[i], &right[i], numFrames - i);
+}
+
+void mixWithGainNeon(const float *source, float *target, float gain, int32_t length) {
+    const float32x4_t gains = vdupq_n_f32(gain);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const float32x4_t low = vmulq_f32(vld1q_f32(&source[i]), gains);
+        const float32x4_t high = vmulq_f32(vld1q_f32(&source[i+4]), gains);
+        vst1q_f32(&target[i], vaddq_f32(vld1q_f32(&target[i]), low));
+        vst1q_f32(&target[i+4], vaddq_f32(vld1q_f32(&target[i+4]), high));
+    }
+    mixWithGainScalar(&source[i], &target[i], gain, length - i);
+}
+
+float dotProductNeon(const float *a, const float *b, int32_t length) {
+    float32x4_t low = vdupq_n_f32(0);
+    float32x4_t high = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        low = vfmaq_f32(low, vld1q_f32(&a[i]), vld1q_f32(&b[i]));
+        high = vfmaq_f32(high, vld1q_f32(&a[i+4]), vld1q_f32(&b[i+4]));
+    }
+    return vaddvq_f32(vaddq_f32(low, high)) + dotProductScalar(&a[i], &b[i], length - i);
+}
+
+void copyWithLevelsNeon(const float *source, float *target, int32_t length,
+                        SignalLevels &levels) {
+    const float32x4_t clipLevel = vdupq_n_f32(kClipLevel);
+    float32x4_t peaks = vdupq_n_f32(0);
+    float32x4_t sums = vdupq_n_f32(0);
+    uint32x4_t clipCounts = vdupq_n_u32(0);
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        const float32x4_t in = vld1q_f32(&source[i]);
+        if (target != nullptr) vst1q_f32(&target[i], in);
+        const float32x4_t magnitudes = vabsq_f32(in);
+        peaks = vmaxq_f32(peaks, magnitudes);
+        sums = vfmaq_f32(sums, in, in);
+        // Comparisons give all ones, which is -1, for each clipped sample.
+        clipCounts = vsubq_u32(clipCounts, vcgeq_f32(magnitudes, clipLevel));
+    }
+    levels.peak = std::max(levels.peak, vmaxvq_f32(peaks));
+    levels.sumOfSquares += vaddvq_f32(sums);
+    levels.clipCount += static_cast<int32_t>(vaddvq_u32(clipCounts));
+    levels.numSamples += i;
+    copyWithLevelsScalar(&source[i], (target != nullptr) ? &target[i] : nullptr, length - i,
+                         levels);
+}
+
+constexpr ArrayKernels kNeonKernels = {
+        "neon",
+        int16ToFloatNeon,
+        floatToInt16Neon,
+        packed24ToFloatNeon,
+        floatToPacked24Neon,
+        monoToStereoNeon,
+        interleaveNeon,
+        deinterleaveNeon,
+        mixWithGainNeon,
+        dotProductNeon,
+        copyWithLevelsNeon
+};
+
+#elif defined(__SSE2__)
+
+inline __m128 selectMultiplier(__m128 value, __m128 negative, __m128 positive) {
+    const __m128 isNegative = _mm_cmplt_ps(value, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(isNegative, negative), _mm_andnot_ps(isNegative, positive));
+}
+
+void int16ToFloatSse2(const int16_t *source, float *target, int32_t length) {
+    const __m128 negative = _mm_set1_ps(kNegativeMultiplier);
+    const __m128 positive = _mm_set1_ps(kPositiveMultiplier);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[i]));
+        // Sign extend each int16 by moving it to the top of an int32 and shifting it back down.
+        const __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+        const __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+        _mm_storeu_ps(&target[i], _mm_mul_ps(low, selectMultiplier(low, negative, positive)));
+        _mm_storeu_ps(&target[i+4], _mm_mul_ps(high, selectMultiplier(high, negative, positive)));
+    }
+    int16ToFloatScalar(&source[i], &target[i], length - i);
+}
+
+void floatToInt16Sse2(const float *source, int16_t *target, int32_t length) {
+    const __m128 negative = _mm_set1_ps(-INT16_MIN);
+    const __m128 positive = _mm_set1_ps(INT16_MAX);
+    const __m128 minimum = _mm_set1_ps(-1.0f);
+    const __m128 maximum = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 low = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&source[i]), maximum), minimum);
+        __m128 high = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&source[i+4]), maximum), minimum);
+        low = _mm_mul_ps(low, selectMultiplier(low, negative, positive));
+        high = _mm_mul_ps(high, selectMultiplier(high, negative, positive));
+        const __m128i out = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&target[i]), out);
+    }
+    floatToInt16Scalar(&source[i], &target[i], length - i);
+}
+
+void monoToStereoSse2(float *data, int32_t numFrames) {
+    // Do the frames which don't fill a vector first, then work backwards through the rest.
+    const int32_t vectorFrames = numFrames & ~3;
+    for (int i = numFrames - 1; i >= vectorFrames; i--) {
+        data[i*2] = data[i];
+        data[(i*2)+1] = data[i];
+    }
+    for (int i = vectorFrames - 4; i >= 0; i -= 4) {
+        const __m128 in = _mm_loadu_ps(&data[i]);
+        _mm_storeu_ps(&data[i*2], _mm_unpacklo_ps(in, in));
+        _mm_storeu_ps(&data[(i*2)+4], _mm_unpackhi_ps(in, in));
+    }
+}
+
+void interleaveSse2(const float *left, const float *right, float *target, int32_t numFrames) {
+    int i = 0;
+    for (; i + 4 <= numFrames; i += 4) {
+        const __m128 l = _mm_loadu_ps(&left[i]);
+        const __m128 r = _mm_loadu_ps(&right[i]);
+        _mm_storeu_ps(&target[i*2], _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(&target[(i*2)+4], _mm_unpackhi_ps(l, r));
+    }
+    interleaveScalar(&left[i], &right[i], &target[i*2], numFrames - i);
+}
+
+void deinterleaveSse2(const float *source, float *left, float *right, int32_t numFrames) {
+    int i = 0;
+    for (; i + 4 <= numFrames; i += 4) {
+        const __m128 a = _mm_loadu_ps(&source[i*2]);
+        const __m128 b = _mm_loadu_ps(&source[(i*2)+4]);
+        _mm_storeu_ps(&left[i], _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(&right[i], _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    deinterleaveScalar(&source[i*2], &left[i], &right[i], numFrames - i);
+}
+
+void mixWithGainSse2(const float *source, float *target, float gain, int32_t length) {
+    const __m128 gains = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m128 low = _mm_mul_ps(_mm_loadu_ps(&source[i]), gains);
+        const __m128 high = _mm_mul_ps(_mm_loadu_ps(&source[i+4]), gains);
+        _mm_storeu_ps(&target[i], _mm_add_ps(_mm_loadu_ps(&target[i]), low));
+        _mm_storeu_ps(&target[i+4], _mm_add_ps(_mm_loadu_ps(&target[i+4]), high));
+    }
+    mixWithGainScalar(&source[i], &target[i], gain, length - i);
+}
+
+float dotProductSse2(const float *a, const float *b, int32_t length) {
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+        high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(&a[i+4]), _mm_loadu_ps(&b[i+4])));
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, _mm_add_ps(low, high));
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]) +
+           dotProductScalar(&a[i], &b[i], length - i);
+}
+
+void copyWithLevelsSse2(const float *source, float *target, int32_t length,
+                        SignalLevels &levels) {
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 clipLevel = _mm_set1_ps(kClipLevel);
+    __m128 peaks = _mm_setzero_ps();
+    __m128 sums = _mm_setzero_ps();
+    __m128i clipCounts = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        const __m128 in = _mm_loadu_ps(&source[i]);
+        if (target != nullptr) _mm_storeu_ps(&target[i], in);
+        const __m128 magnitudes = _mm_andnot_ps(signBit, in);
+        peaks = _mm_max_ps(peaks, magnitudes);
+        sums = _mm_add_ps(sums, _mm_mul_ps(in, in));
+        // Comparisons give all ones, which is -1, for each clipped sample.
+        clipCounts = _mm_sub_epi32(clipCounts,
+                                   _mm_castps_si128(_mm_cmpge_ps(magnitudes, clipLevel)));
+    }
+    float peakLanes[4];
+    float sumLanes[4];
+    int32_t clipLanes[4];
+    _mm_storeu_ps(peakLanes, peaks);
+    _mm_storeu_ps(sumLanes, sums);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(clipLanes), clipCounts);
+    levels.peak = std::max({levels.peak, peakLanes[0], peakLanes[1], peakLanes[2], peakLanes[3]});
+    levels.sumOfSquares += (sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3]);
+    levels.clipCount += clipLanes[0] + clipLanes[1] + clipLanes[2] + clipLanes[3];
+    levels.numSamples += i;
+    copyWithLevelsScalar(&source[i], (target != nullptr) ? &target[i] : nullptr, length - i,
+                         levels);
+}
+
+constexpr ArrayKernels kSse2Kernels = {
+        "sse2",
+        int16ToFloatSse2,
+        floatToInt16Sse2,
+        // SSE2 has no byte shuffle, which is what makes packing 24-bit samples worthwhile.
+        packed24ToFloatScalar,
+        floatToPacked24Scalar,
+        monoToStereoSse2,
+        interleaveSse2,
+        deinterleaveSse2,
+        mixWithGainSse2,
+        dotProductSse2,
+        copyWithLevelsSse2
+};
+
+// The AVX2 versions are compiled for AVX2 regardless of the build flags, and only used if the CPU
+// reports that it supports it.
+#define WAVEMAKER2_AVX2 __attribute__((target("avx2")))
+
+WAVEMAKER2_AVX2 inline __m256 selectMultiplier(__m256 value, __m256 negative, __m256 positive) {
+    return _mm256_blendv_ps(positive, negative, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_LT_OQ));
+}
+
+WAVEMAKER2_AVX2 void int16ToFloatAvx2(const int16_t *source, float *target, int32_t length) {
+    const __m256 negative = _mm256_set1_ps(kNegativeMultiplier);
+    const __m256 positive = _mm256_set1_ps(kPositiveMultiplier);
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&source[i]));
+        const __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(in)));
+        const __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(in, 1)));
+        _mm256_storeu_ps(&target[i], _mm256_mul_ps(low, selectMultiplier(low, negative, positive)));
+        _mm256_storeu_ps(&target[i+8], _mm256_mul_ps(high, selectMultiplier(high, negative, positive)));
+    }
+    int16ToFloatScalar(&source[i], &target[i], length - i);
+}
+
+WAVEMAKER2_AVX2 void floatToInt16Avx2(const float *source, int16_t *target, int32_t length) {
+    const __m256 negative = _mm256_set1_ps(-INT16_MIN);
+    const __m256 positive = _mm256_set1_ps(INT16_MAX);
+    const __m256 minimum = _mm256_set1_ps(-1.0f);
+    const __m256 maximum = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256 in = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&source[i]), maximum), minimum);
+        in = _mm256_mul_ps(in, selectMultiplier(in, negative, positive));
+        const __m256i out = _mm256_cvtps_epi32(in);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&target[i]),
+                         _mm_packs_epi32(_mm256_castsi256_si128(out),
+                                         _mm256_extracti128_si256(out, 1)));
+    }
+    floatToInt16Scalar(&source[i], &target[i], length - i);
+}
+
+WAVEMAKER2_AVX2 void packed24ToFloatAvx2(const uint8_t *source, float *target, int32_t length) {
+    const __m256 negative = _mm256_set1_ps(kNegativeMultiplier24);
+    const __m256 positive = _mm256_set1_ps(kPositiveMultiplier24);
+    // Moves each lane's four samples into the top three bytes of an int32.
+    const __m256i order = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                           -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    int i = 0;
+    // Each pair of loads reads 28 bytes for 24 bytes of samples, so leave room for the extra 4.
+    for (; i + 10 <= length; i += 8) {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[i*3]));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[(i*3)+12]));
+        const __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        const __m256 values = _mm256_cvtepi32_ps(
+                _mm256_srai_epi32(_mm256_shuffle_epi8(in, order), 8));
+        _mm256_storeu_ps(&target[i], _mm256_mul_ps(values,
+                                                   selectMultiplier(values, negative, positive)));
+    }
+    packed24ToFloatScalar(&source[i*3], &target[i], length - i);
+}
+
+WAVEMAKER2_AVX2 void floatToPacked24Avx2(const float *source, uint8_t *target, int32_t length) {
+    const __m256 negative = _mm256_set1_ps(-kInt24Min);
+    const __m256 positive = _mm256_set1_ps(kInt24Max);
+    const __m256 minimum = _mm256_set1_ps(-1.0f);
+    const __m256 maximum = _mm256_set1_ps(1.0f);
+    // Packs the low three bytes of each lane's four int32s into its first 12 bytes.
+    const __m256i order = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                           0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    // The second store's last 4 bytes are junk which the next store overwrites, so leave room
+    // for them.
+    for (; i + 10 <= length; i += 8) {
+        __m256 in = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&source[i]), maximum), minimum);
+        in = _mm256_mul_ps(in, selectMultiplier(in, negative, positive));
+        const __m256i packed = _mm256_shuffle_epi8(_mm256_cvtps_epi32(in), order);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&target[i*3]),
+                         _mm256_castsi256_si128(packed));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&target[(i*3)+12]),
+                         _mm256_extracti128_si256(packed, 1));
+    }
+    floatToPacked24Scalar(&source[i], &target[i*3], length - i);
+}
+
+WAVEMAKER2_AVX2 void monoToStereoAvx2(float *data, int32_t numFrames) {
+    // Do the frames which don't fill a vector first, then work backwards through the rest.
+    const int32_t vectorFrames = numFrames & ~7;
+    for (int i = numFrames - 1; i >= vectorFrames; i--) {
+        data[i*2] = data[i];
+        data[(i*2)+1] = data[i];
+    }
+    for (int i = vectorFrames - 8; i >= 0; i -= 8) {
+        const __m256 in = _mm256_loadu_ps(&data[i]);
+        const __m256 low = _mm256_unpacklo_ps(in, in);
+        const __m256 high = _mm256_unpackhi_ps(in, in);
+        _mm256_storeu_ps(&data[i*2], _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(&data[(i*2)+8], _mm256_permute2f128_ps(low, high, 0x31));
+    }
+}
+
+WAVEMAKER2_AVX2 void interleaveAvx2(const float *left, const float *right, float *target,
+                                    int32_t numFrames) {
+    int i = 0;
+    for (; i + 8 <= numFrames; i += 8) {
+        const __m256 l = _mm256_loadu_ps(&left[i]);
+        const __m256 r = _mm256_loadu_ps(&right[i]);
+        const __m256 low = _mm256_unpacklo_ps(l, r);
+        const __m256 high = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(&target[i*2], _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(&target[(i*2)+8], _mm256_permute2f128_ps(low, high, 0x31));
+    }
+    interleaveScalar(&left[i], &right[i], &target[i*2], numFrames - i);
+}
+
+WAVEMAKER2_AVX2 void deinterleaveAvx2(const float *source, float *left, float *right,
+                                      int32_t numFrames) {
+    int i = 0;
+    for (; i + 8 <= numFrames; i += 8) {
+        const __m256 a = _mm256_loadu_ps(&source[i*2]);
+        const __m256 b = _mm256_loadu_ps(&source[(i*2)+8]);
+        // Shuffling within each 128-bit lane leaves the frames in the order 0 1 4 5 2 3 6 7.
+        const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+        const __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm256_storeu_ps(&left[i], _mm256_permutevar8x32_ps(l, order));
+        _mm256_storeu_ps(&right[i], _mm256_permutevar8x32_ps(r, order));
+    }
+    deinterleaveScalar(&source[i*2], &left[i], &right[i], numFrames - i);
+}
+
+WAVEMAKER2_AVX2 void mixWithGainAvx2(const float *source, float *target, float gain,
+                                     int32_t length) {
+    const __m256 gains = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m256 low = _mm256_mul_ps(_mm256_loadu_ps(&source[i]), gains);
+        const __m256 high = _mm256_mul_ps(_mm256_loadu_ps(&source[i+8]), gains);
+        _mm256_storeu_ps(&target[i], _mm256_add_ps(_mm256_loadu_ps(&target[i]), low));
+        _mm256_storeu_ps(&target[i+8], _mm256_add_ps(_mm256_loadu_ps(&target[i+8]), high));
+    }
+    mixWithGainScalar(&source[i], &target[i], gain, length - i);
+}
+
+WAVEMAKER2_AVX2 float dotProductAvx2(const float *a, const float *b, int32_t length) {
+    __m256 low = _mm256_setzero_ps();
+    __m256 high = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        low = _mm256_add_ps(low, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+        high = _mm256_add_ps(high, _mm256_mul_ps(_mm256_loadu_ps(&a[i+8]),
+                                                 _mm256_loadu_ps(&b[i+8])));
+    }
+    const __m256 sum = _mm256_add_ps(low, high);
+    const __m128 halves = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    float sums[4];
+    _mm_storeu_ps(sums, halves);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]) +
+           dotProductScalar(&a[i], &b[i], length - i);
+}
+
+WAVEMAKER2_AVX2 void copyWithLevelsAvx2(const float *source, float *target, int32_t length,
+                                         SignalLevels &levels) {
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256 clipLevel = _mm256_set1_ps(kClipLevel);
+    __m256 peaks = _mm256_setzero_ps();
+    __m256 sums = _mm256_setzero_ps();
+    __m256i clipCounts = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const __m256 in = _mm256_loadu_ps(&source[i]);
+        if (target != nullptr) _mm256_storeu_ps(&target[i], in);
+        const __m256 magnitudes = _mm256_andnot_ps(signBit, in);
+        peaks = _mm256_max_ps(peaks, magnitudes);
+        sums = _mm256_add_ps(sums, _mm256_mul_ps(in, in));
+        // Comparisons give all ones, which is -1, for each clipped sample.
+        clipCounts = _mm256_sub_epi32(clipCounts, _mm256_castps_si256(
+                _mm256_cmp_ps(magnitudes, clipLevel, _CMP_GE_OQ)));
+    }
+    const __m128 peakHalves = _mm_max_ps(_mm256_castps256_ps128(peaks),
+                                         _mm256_extractf128_ps(peaks, 1));
+    const __m128 sumHalves = _mm_add_ps(_mm256_castps256_ps128(sums),
+                                        _mm256_extractf128_ps(sums, 1));
+    const __m128i clipHalves = _mm_add_epi32(_mm256_castsi256_si128(clipCounts),
+                                             _mm256_extracti128_si256(clipCounts, 1));
+    float peakLanes[4];
+    float sumLanes[4];
+    int32_t clipLanes[4];
+    _mm_storeu_ps(peakLanes, peakHalves);
+    _mm_storeu_ps(sumLanes, sumHalves);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(clipLanes), clipHalves);
+    levels.peak = std::max({levels.peak, peakLanes[0], peakLanes[1], peakLanes[2], peakLanes[3]});
+    levels.sumOfSquares += (sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3]);
+    levels.clipCount += clipLanes[0] + clipLanes[1] + clipLanes[2] + clipLanes[3];
+    levels.numSamples += i;
+    copyWithLevelsScalar(&source[i], (target != nullptr) ? &target[i] : nullptr, length - i,
+                         levels);
+}
+
+constexpr ArrayKernels kAvx2Kernels = {
+        "avx2",
+        int16ToFloatAvx2,
+        floatToInt16Avx2,
+        packed24ToFloatAvx2,
+        floatToPacked24Avx2,
+        monoToStereoAvx2,
+        interleaveAvx2,
+        deinterleaveAvx2,
+        mixWithGainAvx2,
+        dotProductAvx2,
+        copyWithLevelsAvx2
+};
+
+#endif
+
+const ArrayKernels &selectKernels() {
+#if defined(__aarch64__)
+    return kNeonKernels;
+#elif defined(__SSE2__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return kAvx2Kernels;
+    return kSse2Kernels;
+#else
+    return kScalarKernels;
+#endif
+}
+
+// Chosen once when the library is loaded so there's no check on each call.
+const ArrayKernels *gKernels = &selectKernels();
+
+} // namespace
+
+void convertArrayInt16ToFloat(const int16_t *source, float *target, int32_t length){
+    gKernels->int16ToFloat(source, target, length);
+}
+
+void convertArrayFloatToInt16(const float *source, int16_t *target, int32_t length){
+    gKernels->floatToInt16(source, target, length);
+}
+
+void convertArrayPacked24ToFloat(const uint8_t *source, float *target, int32_t length) {
+    gKernels->packed24ToFloat(source, target, length);
+}
+
+void convertArrayFloatToPacked24(const float *source, uint8_t *target, int32_t length) {
+    gKernels->floatToPacked24(source, target, length);
+}
+
+void fillArrayWithZeros(float *data, int32_t length) {
+    // memset is already vectorised by the C library on every ABI we support.
+    memset(data, 0, length * sizeof(float));
+}
+
+void convertArrayMonoToStereo(float *data, int32_t numFrames) {
+    gKernels->monoToStereo(data, numFrames);
+}
+
+void interleaveStereo(const float *left, const float *right, float *target, int32_t numFrames) {
+    gKernels->interleave(left, right, target, numFrames);
+}
+
+void deinterleaveStereo(const float *source, float *left, float *right, int32_t numFrames) {
+    gKernels->deinterleave(source, left, right, numFrames);
+}
+
+void mixArrayWithGain(const float *source, float *target, float gain, int32_t length) {
+    gKernels->mixWithGain(source, target, gain, length);
+}
+
+float dotProduct(const float *a, const float *b, int32_t length) {
+    return gKernels->dotProduct(a, b, length);
+}
+
+void measureArrayLevels(const float *source, int32_t length, SignalLevels &levels) {
+    gKernels->copyWithLevels(source, nullptr, length, levels);
+}
+
+void copyArrayWithLevels(const float *source, float *target, int32_t length,
+                         SignalLevels &levels) {
+    gKernels->copyWithLevels(source, target, length, levels);
+}
+
+const char *getSimdImplementationName() {
+    return gKernels->name;
+}
+
+bool setSimdImplementation(const char *name) {
+
+    const ArrayKernels *kernels = nullptr;
+    if (strcmp(name, kScalarKernels.name) == 0) kernels = &kScalarKernels;
+#if defined(__aarch64__)
+    if (strcmp(name, kNeonKernels.name) == 0) kernels = &kNeonKernels;
+#elif defined(__SSE2__)
+    if (strcmp(name, kSse2Kernels.name) == 0) kernels = &kSse2Kernels;
+    if (strcmp(name, kAvx2Kernels.name) == 0 && __builtin_cpu_supports("avx2")) {
+        kernels = &kAvx2Kernels;
+    }
+#endif
+    if (kernels == nullptr) return false;
+    gKernels = kernels;
+    return true;
+}
@@ -17,9 +17,47 @@
 #ifndef WAVEMAKER2_SOUNDRECORDINGUTILITIES_H
 #define WAVEMAKER2_SOUNDRECORDINGUTILITIES_H
 
+#include <cstdint>
+
+// Levels of a block of samples. The level functions below add to these, so a struct can
+// accumulate several blocks.
+struct SignalLevels {
+    // The largest absolute sample value.
+    float peak = 0;
+    float sumOfSquares = 0;
+    // Samples at or beyond full scale, which would be clipped if they were stored as integers.
+    int32_t clipCount = 0;
+    int32_t numSamples = 0;
+};
+
+// The array functions below use NEON, AVX2 or SSE2 where the device supports them. The
+// implementation is picked once when the library is loaded and every version produces exactly the
+// same output as the scalar one, including for NaN and infinite input, apart from dotProduct and
+// the level functions whose sums are added in a different order.
+
 float convertInt16ToFloat(int16_t intValue);
-void convertArrayInt16ToFloat(int16_t *source, float *target, int32_t length);
+int16_t convertFloatToInt16(float floatValue);
+void convertArrayInt16ToFloat(const int16_t *source, float *target, int32_t length);
+void convertArrayFloatToInt16(const float *source, int16_t *target, int32_t length);
+// Packed 24-bit samples are 3 little-endian bytes each, scaled the same way as int16.
+void convertArrayPacked24ToFloat(const uint8_t *source, float *target, int32_t length);
+void convertArrayFloatToPacked24(const float *source, uint8_t *target, int32_t length);
 void fillArrayWithZeros(float *data, int32_t length);
 void convertArrayMonoToStereo(float *data, int32_t numFrames);
+void interleaveStereo(const float *left, const float *right, float *target, int32_t numFrames);
+void deinterleaveStereo(const float *source, float *left, float *right, int32_t numFrames);
+// Adds source * gain to target.
+void mixArrayWithGain(const float *source, float *target, float gain, int32_t length);
+float dotProduct(const float *a, const float *b, int32_t length);
+void measureArrayLevels(const float *source, int32_t length, SignalLevels &levels);
+// Copies source to target and measures it in the same pass.
+void copyArrayWithLevels(const float *source, float *target, int32_t length,
+                         SignalLevels &levels);
+
+// Returns the name of the selected implementation, e.g. "neon", for logging.
+const char *getSimdImplementationName();
+// For tests and benchmarks. Switches to the named implementation ("scalar", "neon", "sse2" or
+// "avx2"), returning false if this device can't run it. Not safe while the callbacks are running.
+bool setSimdImplementation(const char *name);
 
 #endif //WAVEMAKER2_SOUNDRECORDINGUTILITIES_H
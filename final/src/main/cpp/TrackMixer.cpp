@@ -0,0 +1,319 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "TrackMixer.h"
+
+TrackMixer::TrackMixer(SampleBlockPool &blockPool) : mBlockPool(blockPool) {
+
+    // The history always holds the current list, which starts out empty.
+    mHistory.emplace_back(new TrackList());
+    mRequestedList = mHistory[0].get();
+    mAppliedList = mHistory[0].get();
+}
+
+Track *TrackMixer::prepareTake() {
+
+    commitFinishedTake();
+    if (mTakeList != nullptr) cancelTake();
+    releaseUnusedTracks();
+
+    const TrackList &current = *mHistory[mHistoryIndex];
+    if (current.count == kMaxTracks) return nullptr;
+
+    // Every take gets a new track, since the previous ones may still be needed by the history.
+    mTracks.emplace_back(new Track(mBlockPool, mStorageFormat));
+    Track *track = mTracks.back().get();
+    mTakeList.reset(new TrackList(current));
+    mTakeList->tracks[mTakeList->count++] = track;
+    mPreparedTakeList.store(mTakeList.get(), std::memory_order_release);
+    mIsTakeOpen.store(true, std::memory_order_release);
+    return track;
+}
+
+void TrackMixer::addTake() {
+
+    if (!mIsTakeOpen.load(std::memory_order_acquire)) return;
+    const TrackList *takeList = mPreparedTakeList.load(std::memory_order_acquire);
+    Track *take = takeList->tracks[takeList->count - 1];
+    if (take->getRecording().getLength() > 0) {
+        // The take was prepared on top of the requested list, so catch up with that first. Only
+        // the take differs from it.
+        applyRequestedTracks();
+
+        // The take ends now, so it started its length ago. It's lined up with the first track so
+        // that a take started part way round the loop stays in time with it.
+        int64_t loopPosition = 0;
+        if (mActiveTracks.count > 0) loopPosition = getLoopPosition(*mActiveTracks.tracks[0]);
+        take->setLoopOffset(loopPosition - take->getRecording().getLength());
+        mActiveTracks = *takeList;
+        // Looping may have changed since the take was prepared.
+        take->getRecording().setLooping(mIsLooping);
+        moveToLoopPosition(*take, loopPosition);
+        mRequestedList.store(takeList, std::memory_order_release);
+        mAppliedList.store(takeList, std::memory_order_release);
+        mTrackCount.store(takeList->count, std::memory_order_release);
+    }
+    mIsTakeOpen.store(false, std::memory_order_release);
+}
+
+void TrackMixer::cancelTake() {
+    mIsTakeOpen = false;
+    if (mTakeList != nullptr) retireList(std::move(mTakeList));
+}
+
+void TrackMixer::commitFinishedTake() {
+
+    if (mTakeList == nullptr || mIsTakeOpen.load(std::memory_order_acquire)) return;
+    if (mRequestedList.load(std::memory_order_acquire) == mTakeList.get()) {
+        pushHistory(std::move(mTakeList));
+    } else {
+        // Nothing was recorded, so it was never mixed.
+        retireList(std::move(mTakeList));
+    }
+}
+
+bool TrackMixer::clear() {
+
+    commitFinishedTake();
+    if (mIsTakeOpen || mHistory[mHistoryIndex]->count == 0) return false;
+    pushHistory(std::unique_ptr<TrackList>(new TrackList()));
+    return requestList(mHistoryIndex);
+}
+
+bool TrackMixer::undo() {
+
+    commitFinishedTake();
+    if (mIsTakeOpen || mHistoryIndex == 0) return false;
+    return requestList(mHistoryIndex - 1);
+}
+
+bool TrackMixer::redo() {
+
+    commitFinishedTake();
+    if (mIsTakeOpen || mHistoryIndex + 1 >= mHistory.size()) return false;
+    return requestList(mHistoryIndex + 1);
+}
+
+void TrackMixer::setHistoryBudget(int64_t bytes) {
+    mHistoryBudgetBytes = std::max<int64_t>(0, bytes);
+    commitFinishedTake();
+    evictHistory();
+    releaseUnusedTracks();
+}
+
+TakeHistoryState TrackMixer::getHistoryState() {
+
+    commitFinishedTake();
+    TakeHistoryState state;
+    state.undoCount = static_cast<int32_t>(mHistoryIndex);
+    state.redoCount = static_cast<int32_t>(mHistory.size() - mHistoryIndex - 1);
+    state.historyBytes = getHistoryBytes();
+    return state;
+}
+
+void TrackMixer::pushHistory(std::unique_ptr<TrackList> list) {
+
+    // Whatever had been undone can't be redone once something new happens.
+    while (mHistory.size() > mHistoryIndex + 1) {
+        retireList(std::move(mHistory.back()));
+        mHistory.pop_back();
+    }
+    mHistory.push_back(std::move(list));
+    mHistoryIndex = mHistory.size() - 1;
+    evictHistory();
+}
+
+bool TrackMixer::requestList(size_t historyIndex) {
+
+    mHistoryIndex = historyIndex;
+    const TrackList *list = mHistory[historyIndex].get();
+    mRequestedList.store(list, std::memory_order_seq_cst);
+    mTrackCount.store(list->count, std::memory_order_release);
+    releaseUnusedTracks();
+    return true;
+}
+
+void TrackMixer::retireList(std::unique_ptr<TrackList> list) {
+    RetiredList retired;
+    retired.list = std::move(list);
+    retired.callbackCount = mCallbackCount.load(std::memory_order_seq_cst);
+    mRetiredLists.push_back(std::move(retired));
+}
+
+void TrackMixer::evictHistory() {
+
+    // The oldest history goes first, then whatever could be redone. The current list stays.
+    while (getHistoryBytes() > mHistoryBudgetBytes && mHistoryIndex > 0) {
+        retireList(std::move(mHistory.front()));
+        mHistory.erase(mHistory.begin());
+        mHistoryIndex--;
+    }
+    while (getHistoryBytes() > mHistoryBudgetBytes && mHistory.size() > mHistoryIndex + 1) {
+        retireList(std::move(mHistory.back()));
+        mHistory.pop_back();
+    }
+}
+
+int64_t TrackMixer::getHistoryBytes() const {
+
+    // Takes are shared between lists, so count each one once.
+    std::vector<Track *> tracks;
+    for (const std::unique_ptr<TrackList> &list : mHistory) {
+        tracks.insert(tracks.end(), list->tracks.begin(), list->tracks.begin() + list->count);
+    }
+    std::sort(tracks.begin(), tracks.end());
+    tracks.erase(std::unique(tracks.begin(), tracks.end()), tracks.end());
+
+    int64_t bytes = 0;
+    for (Track *track : tracks) bytes += track->getRecording().getStorageBytes();
+    return bytes;
+}
+
+void TrackMixer::releaseUnusedTracks() {
+
+    const TrackList *appliedList = mAppliedList.load(std::memory_order_acquire);
+    const uint64_t callbackCount = mCallbackCount.load(std::memory_order_seq_cst);
+    mRetiredLists.erase(std::remove_if(mRetiredLists.begin(), mRetiredLists.end(),
+                                       [appliedList, callbackCount](const RetiredList &retired) {
+                                           return retired.list.get() != appliedList &&
+                                                  callbackCount > retired.callbackCount;
+                                       }),
+                        mRetiredLists.end());
+
+    std::vector<Track *> usedTracks;
+    auto addTracks = [&usedTracks](const TrackList &list) {
+        usedTracks.insert(usedTracks.end(), list.tracks.begin(),
+                          list.tracks.begin() + list.count);
+    };
+    for (const std::unique_ptr<TrackList> &list : mHistory) addTracks(*list);
+    for (const RetiredList &retired : mRetiredLists) addTracks(*retired.list);
+    if (mTakeList != nullptr) addTracks(*mTakeList);
+    std::sort(usedTracks.begin(), usedTracks.end());
+
+    auto isUnused = [&usedTracks](const std::unique_ptr<Track> &track) {
+        return !std::binary_search(usedTracks.begin(), usedTracks.end(), track.get());
+    };
+    for (std::unique_ptr<Track> &track : mTracks) {
+        if (isUnused(track) && track->getRecording().isPinned()) {
+            mRetiredTracks.push_back(std::move(track));
+        }
+    }
+    mTracks.erase(std::remove_if(mTracks.begin(), mTracks.end(),
+                                 [&isUnused](const std::unique_ptr<Track> &track) {
+                                     return track == nullptr || isUnused(track);
+                                 }),
+                  mTracks.end());
+    mRetiredTracks.erase(std::remove_if(mRetiredTracks.begin(), mRetiredTracks.end(),
+                                        [](const std::unique_ptr<Track> &track) {
+                                            return !track->getRecording().isPinned();
+                                        }),
+                         mRetiredTracks.end());
+}
+
+Track *TrackMixer::getTrack(int32_t index) {
+    commitFinishedTake();
+    const TrackList &current = *mHistory[mHistoryIndex];
+    return (index >= 0 && index < current.count) ? current.tracks[index] : nullptr;
+}
+
+Track *TrackMixer::getCurrentTake() {
+    commitFinishedTake();
+    const TrackList &list = (mTakeList != nullptr) ? *mTakeList : *mHistory[mHistoryIndex];
+    return (list.count > 0) ? list.tracks[list.count - 1] : nullptr;
+}
+
+void TrackMixer::applyRequestedTracks() {
+
+    mCallbackCount.fetch_add(1, std::memory_order_seq_cst);
+    const TrackList *requested = mRequestedList.load(std::memory_order_seq_cst);
+    if (requested == mAppliedList.load(std::memory_order_relaxed)) return;
+    switchTracks(*requested);
+    mAppliedList.store(requested, std::memory_order_release);
+}
+
+void TrackMixer::switchTracks(const TrackList &tracks) {
+
+    auto isActive = [this](const Track *track) {
+        return std::find(mActiveTracks.tracks.begin(),
+                         mActiveTracks.tracks.begin() + mActiveTracks.count,
+                         track) != mActiveTracks.tracks.begin() + mActiveTracks.count;
+    };
+
+    // Tracks coming back from the history pick up where one that carries on playing is.
+    Track *reference = nullptr;
+    for (int32_t i = 0; i < tracks.count && reference == nullptr; ++i) {
+        if (isActive(tracks.tracks[i])) reference = tracks.tracks[i];
+    }
+    const int64_t loopPosition = (reference != nullptr) ? getLoopPosition(*reference) : 0;
+    for (int32_t i = 0; i < tracks.count; ++i) {
+        tracks.tracks[i]->getRecording().setLooping(mIsLooping);
+        if (reference != nullptr && !isActive(tracks.tracks[i])) {
+            moveToLoopPosition(*tracks.tracks[i], loopPosition);
+        }
+    }
+    mActiveTracks = tracks;
+}
+
+int64_t TrackMixer::getLoopPosition(Track &track) {
+    return track.getRecording().getReadPosition() + track.getLoopOffset();
+}
+
+void TrackMixer::moveToLoopPosition(Track &track, int64_t loopPosition) {
+    track.getRecording().setReadPosition(loopPosition - track.getLoopOffset());
+}
+
+void TrackMixer::setReadPositionToStart() {
+    for (int32_t i = 0; i < mActiveTracks.count; ++i) {
+        moveToLoopPosition(*mActiveTracks.tracks[i], 0);
+    }
+}
+
+void TrackMixer::setLooping(bool isLooping) {
+
+    // Tracks which aren't being mixed are caught up when they're switched to.
+    mIsLooping = isLooping;
+    for (int32_t i = 0; i < mActiveTracks.count; ++i) {
+        mActiveTracks.tracks[i]->getRecording().setLooping(isLooping);
+    }
+}
+
+int32_t TrackMixer::getFramesUntilLoopBoundary() const {
+    return (mActiveTracks.count > 0) ?
+           mActiveTracks.tracks[0]->getRecording().getSamplesUntilEnd() : 0;
+}
+
+int32_t TrackMixer::mix(float *mixBuffer, int32_t numFrames) {
+
+    fillArrayWithZeros(mixBuffer, numFrames);
+
+    int32_t framesMixed = 0;
+    for (int32_t i = 0; i < mActiveTracks.count; ++i) {
+        Track &track = *mActiveTracks.tracks[i];
+        const float gain = track.getGain();
+        int32_t framesRead;
+        if (track.isMuted() || gain == 0.0f) {
+            framesRead = track.getRecording().skip(numFrames);
+        } else {
+            framesRead = track.getRecording().readSegments(numFrames,
+                    [mixBuffer, gain](const float *samples, int32_t offset, int32_t length){
+                mixArrayWithGain(samples, &mixBuffer[offset], gain, length);
+            });
+        }
+        framesMixed = std::max(framesMixed, framesRead);
+    }
+    return framesMixed;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_TRACKMIXER_H
+#define WAVEMAKER2_TRACKMIXER_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "FrameRenderer.h"
+#include "SampleBlockPool.h"
+#include "SoundRecording.h"
+#include "SoundRecordingUtilities.h"
+
+constexpr int32_t kMaxTracks = 32;
+constexpr int32_t kMixBufferFrames = 1024; // Larger callbacks are mixed in chunks of this size
+
+/**
+ * One layer of the looper: a recording plus its own gain, mute and loop length.
+ */
+class Track {
+
+public:
+    Track(SampleBlockPool &blockPool, StorageFormat format)
+            : mRecording(createSoundRecording(format, blockPool)) {};
+    SoundRecording &getRecording() { return *mRecording; };
+    void setGain(float gain) { mGain = gain; };
+    float getGain() const { return mGain; };
+    void setMuted(bool isMuted) { mIsMuted = isMuted; };
+    bool isMuted() const { return mIsMuted; };
+    void setLoopLength(int32_t numSamples) { mRecording->setLoopLength(numSamples); };
+    // Playback callback only. Where the track's first sample falls in the loop, counting from the
+    // start of the first track.
+    void setLoopOffset(int64_t frames) { mLoopOffset = frames; };
+    int64_t getLoopOffset() const { return mLoopOffset; };
+
+private:
+    std::unique_ptr<SoundRecording> mRecording;
+    int64_t mLoopOffset = 0;
+    std::atomic<float> mGain { 1.0f };
+    std::atomic<bool> mIsMuted { false };
+};
+
+// Undone takes are kept until they'd take more than this, ~11.6 minutes of float audio @ 48kHz.
+constexpr int64_t kDefaultHistoryBudgetBytes = 128 * 1024 * 1024;
+
+// The tracks being mixed, in order. Never changed once the mixer has been given it.
+struct TrackList {
+    std::array<Track *, kMaxTracks> tracks {};
+    int32_t count = 0;
+};
+
+struct TakeHistoryState {
+    int32_t undoCount = 0;
+    int32_t redoCount = 0;
+    // Storage held by the current tracks and everything which can be undone or redone.
+    int64_t historyBytes = 0;
+};
+
+/**
+ * Owns the looper's tracks and mixes them in the playback callback.
+ *
+ * New takes are recorded into a track which isn't mixed until addTake() publishes it, so the
+ * existing layers keep playing while a take is being recorded.
+ *
+ * Each change to the set of tracks, adding a take or clearing them, makes a new TrackList and
+ * keeps the old ones as an undo history. Lists only hold pointers, so takes are shared between
+ * them rather than copied, and a take's samples are never written again once it's been added.
+ * Undo and redo just hand the mixer a different list, which the playback callback picks up
+ * between renders. The oldest history is dropped once the takes it holds would exceed the
+ * budget.
+ *
+ * Lists and tracks which the callback might still be using are kept until it has caught up, and
+ * tracks are only destroyed once nothing refers to them. Tracks aren't reference counted, as the
+ * callback could then drop the last reference and free a take on the audio thread. Instead the
+ * mixer owns them all and releaseUnusedTracks() finds the unused ones by scanning the lists.
+ */
+class TrackMixer {
+
+public:
+    explicit TrackMixer(SampleBlockPool &blockPool);
+
+    // Control thread only. Returns an empty track to record the next take into, or nullptr if
+    // every track is in use.
+    Track *prepareTake();
+    // Control thread only. Takes prepared from now on store their samples in this format.
+    void setStorageFormat(StorageFormat format) { mStorageFormat = format; };
+    StorageFormat getStorageFormat() const { return mStorageFormat; };
+    // Playback callback only. Starts mixing the track returned by the last call to prepareTake(),
+    // unless nothing was recorded into it.
+    void addTake();
+    // Control thread only. Drops the prepared take if addTake() will never be called for it.
+    void cancelTake();
+
+    // Control thread only. Stops mixing every track, which can be undone. These and undo() and
+    // redo() return false while a take is in progress, or if there's nothing to do.
+    bool clear();
+    bool undo();
+    bool redo();
+    // Control thread only. Drops the oldest history straight away if it's over the new budget.
+    void setHistoryBudget(int64_t bytes);
+    TakeHistoryState getHistoryState();
+    // Control thread only. Destroys tracks which nothing refers to any more. Pinned tracks are
+    // kept until they're unpinned.
+    void releaseUnusedTracks();
+
+    int32_t getTrackCount() const { return mTrackCount; };
+    // Control thread only. Tracks as of the last change, even if the callback hasn't caught up.
+    Track *getTrack(int32_t index);
+    // Control thread only. The take from prepareTake() until it's added or cancelled, otherwise
+    // the newest of the current tracks. nullptr if there's neither.
+    Track *getCurrentTake();
+
+    /**
+     * Playback callback only, or while it isn't running. Starts mixing the tracks from the last
+     * clear(), undo() or redo(). Tracks which come back are lined up with one which was already
+     * playing, if there is one.
+     */
+    void applyRequestedTracks();
+    void setReadPositionToStart();
+    void setLooping(bool isLooping);
+    // Frames until the first track, which every later take is lined up with, reaches the end of
+    // its loop. 0 if there are no tracks.
+    int32_t getFramesUntilLoopBoundary() const;
+
+    /**
+     * Mix every audible track into an interleaved buffer of CHANNEL_COUNT channels. Muted tracks
+     * and tracks with zero gain aren't read, but their positions still advance so they stay in
+     * time with the others.
+     *
+     * @return the number of frames before the last track ran out of data
+     */
+    template <int CHANNEL_COUNT, typename SampleType>
+    int32_t render(SampleType *audioData, int32_t numFrames);
+
+private:
+    SampleBlockPool &mBlockPool;
+    std::atomic<bool> mIsLooping { false };
+    std::atomic<StorageFormat> mStorageFormat { StorageFormat::Float };
+    std::array<float, kMixBufferFrames> mMixBuffer;
+
+    // Control thread state. Every track is owned here, and every list by the history, the
+    // prepared take or the retired lists.
+    std::vector<std::unique_ptr<Track>> mTracks;
+    // Tracks which nothing refers to but were pinned. Their storage is left alone.
+    std::vector<std::unique_ptr<Track>> mRetiredTracks;
+    std::vector<std::unique_ptr<TrackList>> mHistory;
+    size_t mHistoryIndex = 0;
+    int64_t mHistoryBudgetBytes = kDefaultHistoryBudgetBytes;
+    // Lists which have left the history but which the callback may still be mixing, along with
+    // the callback count when they left.
+    struct RetiredList {
+        std::unique_ptr<TrackList> list;
+        uint64_t callbackCount;
+    };
+    std::vector<RetiredList> mRetiredLists;
+    // The current tracks plus the take in progress, which addTake() switches to.
+    std::unique_ptr<TrackList> mTakeList;
+
+    // Shared with the callback.
+    std::atomic<const TrackList *> mRequestedList { nullptr };
+    std::atomic<const TrackList *> mAppliedList { nullptr };
+    std::atomic<const TrackList *> mPreparedTakeList { nullptr };
+    std::atomic<bool> mIsTakeOpen { false };
+    std::atomic<int32_t> mTrackCount { 0 };
+    // Counts calls to applyRequestedTracks(). Once it has moved on from when a list was retired,
+    // the callback can only be mixing that list if it's still the applied one.
+    std::atomic<uint64_t> mCallbackCount { 0 };
+
+    // Playback callback only. A copy of the applied list.
+    TrackList mActiveTracks;
+
+    void commitFinishedTake();
+    void pushHistory(std::unique_ptr<TrackList> list);
+    bool requestList(size_t historyIndex);
+    void retireList(std::unique_ptr<TrackList> list);
+    void evictHistory();
+    int64_t getHistoryBytes() const;
+    void switchTracks(const TrackList &tracks);
+    static int64_t getLoopPosition(Track &track);
+    static void moveToLoopPosition(Track &track, int64_t loopPosition);
+    int32_t mix(float *mixBuffer, int32_t numFrames);
+};
+
+template <int CHANNEL_COUNT, typename SampleType>
+int32_t TrackMixer::render(SampleType *audioData, int32_t numFrames) {
+
+    // With a single unity gain layer there's nothing to mix, so render it directly.
+    Track *firstTrack = mActiveTracks.tracks[0];
+    if (mActiveTracks.count == 1 && !firstTrack->isMuted() && firstTrack->getGain() == 1.0f) {
+        return renderRecording<CHANNEL_COUNT>(firstTrack->getRecording(), audioData, numFrames);
+    }
+
+    int32_t framesMixed = 0;
+    for (int32_t start = 0; start < numFrames; start += kMixBufferFrames) {
+        const int32_t chunkFrames = std::min(kMixBufferFrames, numFrames - start);
+        const int32_t chunkFramesMixed = mix(mMixBuffer.data(), chunkFrames);
+        writeMonoFrames(mMixBuffer.data(), &audioData[start * CHANNEL_COUNT], chunkFrames,
+                        std::integral_constant<int, CHANNEL_COUNT>());
+        if (chunkFramesMixed > 0) framesMixed = start + chunkFramesMixed;
+    }
+    return framesMixed;
+}
+
+#endif //WAVEMAKER2_TRACKMIXER_H
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_TRANSPORTEVENT_H
+#define WAVEMAKER2_TRANSPORTEVENT_H
+
+#include <cstdint>
+
+enum class TransportAction : int32_t {
+    StartRecording,
+    StopRecording,
+    StartPlaying,
+    StopPlaying,
+    LoopingOn,
+    LoopingOff,
+    // Starts mixing the prepared take without recording into it, once an import has something
+    // to play. Only the engine schedules this.
+    AddTrack
+};
+
+// Special frame times. Anything else is a position on the playback stream's frame timeline.
+constexpr int64_t kTransportNow = -1;
+// The next time the first track wraps around to its start, or runs out if it isn't looping.
+constexpr int64_t kTransportNextLoopBoundary = -2;
+
+constexpr uint32_t kTransportQueueCapacity = 64;
+
+struct TransportEvent {
+    TransportAction action = TransportAction::StopPlaying;
+    int64_t frameTime = kTransportNow;
+};
+
+#endif //WAVEMAKER2_TRANSPORTEVENT_H
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WAVEMAKER2_TRIPLEBUFFER_H
+#define WAVEMAKER2_TRIPLEBUFFER_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+/**
+ * Hands the latest value from a single writer thread to a single reader thread without either
+ * of them ever waiting. Values the reader doesn't get to in time are dropped, not queued.
+ *
+ * The writer fills the back buffer and publishes it by swapping it with the middle one. The
+ * reader swaps the middle buffer with the front one when there's something new in it, so each
+ * side always has a buffer of its own.
+ */
+template <typename T>
+class TripleBuffer {
+
+public:
+    // Writer only. The buffer to fill before calling publish().
+    T &getBackBuffer() { return mBuffers[mBackIndex]; }
+
+    // Writer only.
+    void publish() {
+        mBackIndex = mMiddle.exchange(mBackIndex | kIsNewBit, std::memory_order_acq_rel) &
+                     kIndexMask;
+    }
+
+    // Reader only. The latest published value, or a default constructed T before the first one.
+    const T &read() {
+        if (mMiddle.load(std::memory_order_relaxed) & kIsNewBit) {
+            mFrontIndex = mMiddle.exchange(mFrontIndex, std::memory_order_acq_rel) & kIndexMask;
+        }
+        return mBuffers[mFrontIndex];
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kIsNewBit = 0x4;
+
+    std::array<T, 3> mBuffers {};
+    uint8_t mFrontIndex = 0;
+    std::atomic<uint8_t> mMiddle { 1 };
+    uint8_t mBackIndex = 2;
+};
+
+#endif //WAVEMAKER2_TRIPLEBUFFER_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logging.h"
+#include "SoundRecordingUtilities.h"
+#include "WavFileReader.h"
+
+bool WavFileReader::open(const char *path) {
+
+    close();
+    const int file = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        LOGE("Couldn't open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    const auto size = static_cast<size_t>(status.st_size);
+
+    // The mapping keeps the file open, so we don't need the descriptor any more.
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (data == MAP_FAILED) {
+        LOGE("Couldn't map %s: %s", path, strerror(errno));
+        return false;
+    }
+    mData = static_cast<uint8_t *>(data);
+    mSize = size;
+    madvise(mData, mSize, MADV_SEQUENTIAL);
+
+    if (!parseWavHeader(mData, mSize, mInfo)) {
+        LOGE("%s isn't a WAV file we can read", path);
+        close();
+        return false;
+    }
+    mPosition = 0;
+    return true;
+}
+
+void WavFileReader::close() {
+
+    if (mData != nullptr) munmap(mData, mSize);
+    mData = nullptr;
+    mSize = 0;
+    mInfo = WavInfo();
+    mPosition = 0;
+}
+
+int32_t WavFileReader::readMono(float *target, int32_t numFrames) {
+
+    if (mData == nullptr) return 0;
+    numFrames = static_cast<int32_t>(std::min<int64_t>(numFrames,
+                                                       mInfo.getNumFrames() - mPosition));
+    if (numFrames <= 0) return 0;
+
+    const uint8_t *source = &mData[mInfo.dataOffset + mPosition * mInfo.getBytesPerFrame()];
+    const int32_t channelCount = mInfo.channelCount;
+    mPosition += numFrames;
+    if (channelCount == 1) {
+        decode(source, target, numFrames);
+        return numFrames;
+    }
+
+    mInterleaved.resize(static_cast<size_t>(numFrames) * channelCount);
+    decode(source, mInterleaved.data(), numFrames * channelCount);
+    const float scale = 1.0f / channelCount;
+    for (int32_t frame = 0; frame < numFrames; ++frame) {
+        float sum = 0;
+        for (int32_t channel = 0; channel < channelCount; ++channel) {
+            sum += mInterleaved[frame * channelCount + channel];
+        }
+        target[frame] = sum * scale;
+    }
+    return numFrames;
+}
+
+void WavFileReader::decode(const uint8_t *source, float *target, int32_t numSamples) const {
+
+    // The data chunk is always at an even offset, which is all the int16 kernel needs.
+    if (mInfo.formatTag == kWavFormatIeeeFloat) {
+        memcpy(target, source, numSamples * sizeof(float));
+    } else if (mInfo.bitsPerSample == 16) {
+        convertArrayInt16ToFloat(reinterpret_cast<const int16_t *>(source), target, numSamples);
+    } else if (mInfo.bitsPerSample == 24) {
+        convertArrayPacked24ToFloat(source, target, numSamples);
+    } else {
+        for (int32_t i = 0; i < numSamples; ++i) {
+            int32_t value;
+            memcpy(&value, &source[i * sizeof(int32_t)], sizeof(value));
+            target[i] = value * (1.0f / 2147483648.0f);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_WAVFILEREADER_H
+#define WAVEMAKER2_WAVFILEREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "WavFormat.h"
+
+/**
+ * Reads a WAV file by mapping it into memory, so that only the pages being decoded are read from
+ * storage. The samples are decoded a chunk at a time, with the vectorised conversion functions
+ * where there is one for the format, and mixed down to mono.
+ */
+class WavFileReader {
+
+public:
+    ~WavFileReader() { close(); };
+
+    // Returns false if the file can't be mapped or isn't a WAV file in a format we can read.
+    bool open(const char *path);
+    void close();
+    const WavInfo &getInfo() const { return mInfo; };
+    int64_t getPosition() const { return mPosition; };
+
+    /**
+     * Decode up to numFrames frames from the current position, averaging the channels into
+     * target. Returns the number of frames decoded, 0 at the end of the file.
+     */
+    int32_t readMono(float *target, int32_t numFrames);
+
+private:
+    uint8_t *mData = nullptr;
+    size_t mSize = 0;
+    WavInfo mInfo;
+    int64_t mPosition = 0;
+    // Interleaved samples waiting to be mixed down.
+    std::vector<float> mInterleaved;
+
+    void decode(const uint8_t *source, float *target, int32_t numSamples) const;
+};
+
+#endif //WAVEMAKER2_WAVFILEREADER_H
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include "WavFormat.h"
+
+namespace {
+
+// WAV files are little endian, as are all the ABIs we build for.
+template <typename T>
+T readLittleEndian(const uint8_t *data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void writeLittleEndian(uint8_t *data, T value) {
+    memcpy(data, &value, sizeof(T));
+}
+
+bool isChunk(const uint8_t *data, const char *id) {
+    return memcmp(data, id, 4) == 0;
+}
+
+void writeChunkId(uint8_t *data, const char *id) {
+    memcpy(data, id, 4);
+}
+
+// Sizes which don't fit in 32 bits are stored in an RF64 file's ds64 chunk instead.
+constexpr uint32_t kRf64SizePlaceholder = 0xFFFFFFFF;
+constexpr uint32_t kDs64ChunkSize = 28;
+
+} // namespace
+
+bool parseWavHeader(const uint8_t *data, size_t size, WavInfo &info) {
+
+    constexpr size_t kRiffHeaderSize = 12;
+    constexpr size_t kChunkHeaderSize = 8;
+    constexpr size_t kFormatChunkMinimumSize = 16;
+
+    if (size < kRiffHeaderSize || !(isChunk(data, "RIFF") || isChunk(data, "RF64")) ||
+        !isChunk(&data[8], "WAVE")) {
+        return false;
+    }
+
+    bool hasFormat = false;
+    uint64_t ds64DataSize = 0;
+    size_t offset = kRiffHeaderSize;
+    while (offset + kChunkHeaderSize <= size) {
+        const uint8_t *chunk = &data[offset];
+        const size_t chunkSize = readLittleEndian<uint32_t>(&chunk[4]);
+        const size_t bodyOffset = offset + kChunkHeaderSize;
+
+        if (isChunk(chunk, "ds64")) {
+            if (chunkSize < kDs64ChunkSize || bodyOffset + chunkSize > size) return false;
+            ds64DataSize = readLittleEndian<uint64_t>(&data[bodyOffset + 8]);
+        } else if (isChunk(chunk, "fmt ")) {
+            if (chunkSize < kFormatChunkMinimumSize || bodyOffset + chunkSize > size) return false;
+            const uint8_t *body = &data[bodyOffset];
+            info.formatTag = readLittleEndian<uint16_t>(&body[0]);
+            info.channelCount = readLittleEndian<uint16_t>(&body[2]);
+            info.sampleRate = readLittleEndian<uint32_t>(&body[4]);
+            info.bitsPerSample = readLittleEndian<uint16_t>(&body[14]);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format in the first two bytes of the sub
+            // format GUID.
+            constexpr size_t kExtensibleChunkSize = 40;
+            if (info.formatTag == kWavFormatExtensible && chunkSize >= kExtensibleChunkSize) {
+                info.formatTag = readLittleEndian<uint16_t>(&body[24]);
+            }
+            hasFormat = true;
+        } else if (isChunk(chunk, "data")) {
+            if (!hasFormat) return false;
+            info.dataOffset = bodyOffset;
+            const uint64_t dataSize = (chunkSize == kRf64SizePlaceholder && ds64DataSize > 0) ?
+                                      ds64DataSize : chunkSize;
+            // Streaming writers leave the size as 0 or 0xFFFFFFFF until they're closed, so take
+            // the data as running to the end of the file if it claims to be bigger than that.
+            info.dataSize = (dataSize == 0 || bodyOffset + dataSize > size) ?
+                            size - bodyOffset : dataSize;
+            break;
+        }
+        // Chunks are padded to an even number of bytes.
+        offset = bodyOffset + chunkSize + (chunkSize & 1);
+    }
+
+    if (!hasFormat || info.dataOffset == 0 || info.channelCount == 0) return false;
+
+    const bool isPcm = info.formatTag == kWavFormatPcm &&
+                       (info.bitsPerSample == 16 || info.bitsPerSample == 24 ||
+                        info.bitsPerSample == 32);
+    const bool isFloat = info.formatTag == kWavFormatIeeeFloat && info.bitsPerSample == 32;
+    return isPcm || isFloat;
+}
+
+size_t makeWavHeader(const WavInfo &info, uint8_t *header) {
+
+    const bool isFloat = info.formatTag == kWavFormatIeeeFloat;
+    // Formats other than integer PCM have a 2 byte extension size, which is 0 here.
+    const uint32_t formatChunkSize = isFloat ? 18 : 16;
+    const size_t paddingOffset = 12 + (8 + kDs64ChunkSize) + (8 + formatChunkSize);
+    const size_t dataOffset = kWavHeaderSize;
+    const uint64_t riffSize = dataOffset - 8 + info.dataSize;
+    const bool isRf64 = riffSize > kRf64SizePlaceholder - 1;
+
+    writeChunkId(&header[0], isRf64 ? "RF64" : "RIFF");
+    writeLittleEndian<uint32_t>(&header[4], isRf64 ? kRf64SizePlaceholder :
+                                            static_cast<uint32_t>(riffSize));
+    writeChunkId(&header[8], "WAVE");
+
+    writeChunkId(&header[12], isRf64 ? "ds64" : "JUNK");
+    writeLittleEndian<uint32_t>(&header[16], kDs64ChunkSize);
+    memset(&header[20], 0, kDs64ChunkSize);
+    if (isRf64) {
+        writeLittleEndian<uint64_t>(&header[20], riffSize);
+        writeLittleEndian<uint64_t>(&header[28], info.dataSize);
+        writeLittleEndian<uint64_t>(&header[36], static_cast<uint64_t>(info.getNumFrames()));
+    }
+
+    uint8_t *format = &header[12 + 8 + kDs64ChunkSize];
+    const uint16_t blockAlign = static_cast<uint16_t>(info.getBytesPerFrame());
+    writeChunkId(&format[0], "fmt ");
+    writeLittleEndian<uint32_t>(&format[4], formatChunkSize);
+    writeLittleEndian<uint16_t>(&format[8], info.formatTag);
+    writeLittleEndian<uint16_t>(&format[10], info.channelCount);
+    writeLittleEndian<uint32_t>(&format[12], info.sampleRate);
+    writeLittleEndian<uint32_t>(&format[16], info.sampleRate * blockAlign);
+    writeLittleEndian<uint16_t>(&format[20], blockAlign);
+    writeLittleEndian<uint16_t>(&format[22], info.bitsPerSample);
+    if (isFloat) writeLittleEndian<uint16_t>(&format[24], 0);
+
+    uint8_t *padding = &header[paddingOffset];
+    const size_t paddingSize = dataOffset - paddingOffset - 8 - 8;
+    writeChunkId(&padding[0], "JUNK");
+    writeLittleEndian<uint32_t>(&padding[4], static_cast<uint32_t>(paddingSize));
+    memset(&padding[8], 0, paddingSize);
+
+    uint8_t *dataChunk = &header[dataOffset - 8];
+    writeChunkId(&dataChunk[0], "data");
+    writeLittleEndian<uint32_t>(&dataChunk[4], isRf64 ? kRf64SizePlaceholder :
+                                               static_cast<uint32_t>(info.dataSize));
+    return dataOffset;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAVEMAKER2_WAVFORMAT_H
+#define WAVEMAKER2_WAVFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint16_t kWavFormatPcm = 1;
+constexpr uint16_t kWavFormatIeeeFloat = 3;
+constexpr uint16_t kWavFormatExtensible = 0xFFFE;
+
+struct WavInfo {
+    uint16_t formatTag = 0;
+    uint16_t channelCount = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    size_t dataOffset = 0;
+    uint64_t dataSize = 0;
+
+    int32_t getBytesPerFrame() const { return channelCount * (bitsPerSample / 8); }
+    int64_t getNumFrames() const { return dataSize / getBytesPerFrame(); }
+};
+
+// Headers written by makeWavHeader() are padded to this size, so that the samples start on a page
+// boundary and a writer's block-sized writes stay aligned to the file system's blocks.
+constexpr size_t kWavHeaderSize = 4096;
+
+/**
+ * Parse the header of a RIFF or RF64 WAV file held in memory. Only 16, 24 and 32-bit integer PCM
+ * and 32-bit float data are accepted.
+ *
+ * @return true if the header is valid and the data chunk was found
+ */
+bool parseWavHeader(const uint8_t *data, size_t size, WavInfo &info);
+
+/**
+ * Write the header for a file of info.dataSize bytes of samples, in info's format, to header.
+ * Files too big for RIFF's 32-bit sizes get an RF64 header. Smaller ones keep the space for its
+ * ds64 chunk as a JUNK chunk, so that the header is the same size either way and can be patched
+ * in place once a streamed file's length is known. A second JUNK chunk pads the header out to
+ * kWavHeaderSize bytes.
+ *
+ * @return the size of the header, which is where the samples start
+ */
+size_t makeWavHeader(const WavInfo &info, uint8_t *header);
+
+#endif //WAVEMAKER2_WAVFORMAT_H
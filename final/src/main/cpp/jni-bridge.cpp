@@ -14,44 +14,561 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <vector>
 #include <jni.h>
 #include <android/log.h>
 
+#include "AAudioBackend.h"
 #include "AudioEngine.h"
 
+namespace {
+
+// Java holds each engine as an opaque handle, which is the engine's address.
+AudioEngine *toEngine(jlong engineHandle) {
+    return reinterpret_cast<AudioEngine *>(engineHandle);
+}
+
+} // namespace
+
 extern "C" {
 
-static AudioEngine audioEngine;
+/**
+ * Creates an engine and returns a handle to it, which every other call takes. Any number of
+ * engines can exist at once, each with its own streams, tracks and threads. The handle must be
+ * passed to deleteEngine() when it's no longer needed.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_wavemaker2_MainActivity_createEngine(JNIEnv *env, jclass type) {
+    auto *engine = new AudioEngine(std::unique_ptr<AudioBackend>(new AAudioBackend()));
+    return reinterpret_cast<jlong>(engine);
+}
+
+// Stops the engine if it's running and frees it. The handle must not be used again.
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_deleteEngine(JNIEnv *env, jclass type,
+                                                      jlong engineHandle) {
+    delete toEngine(engineHandle);
+}
+
+/**
+ * Opens the engine's streams on particular devices, by AudioDeviceInfo id, the next time it's
+ * started. 0 for either follows the default route.
+ */
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setDeviceIds(JNIEnv *env, jobject instance,
+                                                      jlong engineHandle, jint playbackDeviceId,
+                                                      jint recordingDeviceId) {
+    toEngine(engineHandle)->setDeviceIds(playbackDeviceId, recordingDeviceId);
+}
 
 JNIEXPORT void JNICALL
 Java_com_example_wavemaker2_MainActivity_startEngine(
         JNIEnv *env,
-        jobject /* this */) {
-    audioEngine.start();
+        jobject /* this */,
+        jlong engineHandle,
+        jboolean isFullDuplex) {
+    toEngine(engineHandle)->start(isFullDuplex);
 }
 
 JNIEXPORT void JNICALL
 Java_com_example_wavemaker2_MainActivity_setRecording(JNIEnv *env, jobject instance,
-                                                                jboolean isRecording) {
+                                                      jlong engineHandle, jboolean isRecording) {
     __android_log_print(ANDROID_LOG_DEBUG, "native-lib", "Recording? %d", isRecording);
-    audioEngine.setRecording(isRecording);
+    toEngine(engineHandle)->setRecording(isRecording);
 }
 
 JNIEXPORT void JNICALL
 Java_com_example_wavemaker2_MainActivity_setPlaying(JNIEnv *env, jobject instance,
-                                                              jboolean isPlaying) {
+                                                    jlong engineHandle, jboolean isPlaying) {
     __android_log_print(ANDROID_LOG_DEBUG, "native-lib", "Playing? %d", isPlaying);
-    audioEngine.setPlaying(isPlaying);
+    toEngine(engineHandle)->setPlaying(isPlaying);
+}
+
+/**
+ * Schedules a transport change at a frame on the playback timeline. action is the ordinal of
+ * TransportAction: 0 start recording, 1 stop recording, 2 start playing, 3 stop playing,
+ * 4 looping on, 5 looping off. frameTime -1 means now and -2 the next loop boundary.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_scheduleTransportEvent(JNIEnv *env, jobject instance,
+                                                                jlong engineHandle, jint action,
+                                                                jlong frameTime) {
+    if (action < static_cast<jint>(TransportAction::StartRecording) ||
+        action > static_cast<jint>(TransportAction::LoopingOff)) {
+        return false;
+    }
+    return toEngine(engineHandle)->scheduleTransportEvent(static_cast<TransportAction>(action),
+                                                          frameTime);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_example_wavemaker2_MainActivity_getPlaybackFramePosition(JNIEnv *env, jobject instance,
+                                                                  jlong engineHandle) {
+    return toEngine(engineHandle)->getPlaybackFramePosition();
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_stopEngine(JNIEnv *env, jobject instance,
+                                                    jlong engineHandle) {
+    toEngine(engineHandle)->stop();
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setLooping(JNIEnv *env, jobject instance,
+                                                    jlong engineHandle, jboolean isOn) {
+    toEngine(engineHandle)->setLooping(isOn);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setTrackGain(JNIEnv *env, jobject instance,
+                                                      jlong engineHandle, jint trackIndex,
+                                                      jfloat gain) {
+    toEngine(engineHandle)->setTrackGain(trackIndex, gain);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setTrackMuted(JNIEnv *env, jobject instance,
+                                                       jlong engineHandle, jint trackIndex,
+                                                       jboolean isMuted) {
+    toEngine(engineHandle)->setTrackMuted(trackIndex, isMuted);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setTrackLoopLength(JNIEnv *env, jobject instance,
+                                                            jlong engineHandle, jint trackIndex,
+                                                            jint numFrames) {
+    toEngine(engineHandle)->setTrackLoopLength(trackIndex, numFrames);
+}
+
+/**
+ * Sets how new takes are stored: 0 float, 1 int16 or 2 packed 24-bit.
+ */
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setStorageFormat(JNIEnv *env, jobject instance,
+                                                          jlong engineHandle, jint format) {
+    if (format < static_cast<jint>(StorageFormat::Float) ||
+        format > static_cast<jint>(StorageFormat::Packed24)) {
+        return;
+    }
+    toEngine(engineHandle)->setStorageFormat(static_cast<StorageFormat>(format));
+}
+
+/**
+ * Loads a 16, 24 or 32-bit WAV file into a new track in the background. The track starts playing
+ * with the others as soon as its first chunk is ready. Returns false if the engine isn't running,
+ * a take is in progress or the file can't be read.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_importTrack(JNIEnv *env, jobject instance,
+                                                     jlong engineHandle, jstring path) {
+    const char *pathChars = env->GetStringUTFChars(path, nullptr);
+    if (pathChars == nullptr) return false;
+    const bool isStarted = toEngine(engineHandle)->importTrack(pathChars);
+    env->ReleaseStringUTFChars(path, pathChars);
+    return isStarted;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_isImporting(JNIEnv *env, jobject instance,
+                                                     jlong engineHandle) {
+    return toEngine(engineHandle)->isImporting();
+}
+
+/**
+ * Makes takes start when the input reaches threshold, an RMS level between 0 and 1, rather than
+ * when recording is started, keeping preRollFrames of input from before the onset. Returns false
+ * while a take is in progress.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_setOnsetGate(JNIEnv *env, jobject instance,
+                                                      jlong engineHandle, jboolean isEnabled,
+                                                      jfloat threshold, jint preRollFrames) {
+    return toEngine(engineHandle)->setOnsetGate(isEnabled, threshold, preRollFrames);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_isWaitingForOnset(JNIEnv *env, jobject instance,
+                                                           jlong engineHandle) {
+    return toEngine(engineHandle)->isWaitingForOnset();
+}
+
+/**
+ * Starts streaming the input to a WAV file at path, as 0 float, 1 16-bit or 2 24-bit samples.
+ * Returns false if the engine isn't running or the file can't be created.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_startDiskCapture(JNIEnv *env, jobject instance,
+                                                          jlong engineHandle, jstring path,
+                                                          jint format) {
+    if (format < static_cast<jint>(StorageFormat::Float) ||
+        format > static_cast<jint>(StorageFormat::Packed24)) {
+        return false;
+    }
+    const char *pathChars = env->GetStringUTFChars(path, nullptr);
+    if (pathChars == nullptr) return false;
+    const bool isStarted = toEngine(engineHandle)->startDiskCapture(
+            pathChars, static_cast<StorageFormat>(format));
+    env->ReleaseStringUTFChars(path, pathChars);
+    return isStarted;
+}
+
+// Returns false if any of the file couldn't be written.
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_stopDiskCapture(JNIEnv *env, jobject instance,
+                                                         jlong engineHandle) {
+    return toEngine(engineHandle)->stopDiskCapture();
+}
+
+/**
+ * Returns [framesWritten, overflowFrameCount, errorCount] for the current or last disk capture.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getDiskCaptureStats(JNIEnv *env, jobject instance,
+                                                             jlong engineHandle) {
+    const DiskWriterStats stats = toEngine(engineHandle)->getDiskCaptureStats();
+    const jlong values[] = { stats.framesWritten, stats.overflowFrameCount, stats.errorCount };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(kValueCount);
+    if (result != nullptr) env->SetLongArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setRecordingCapacity(JNIEnv *env, jobject instance,
+                                                              jlong engineHandle, jint seconds) {
+    toEngine(engineHandle)->setRecordingCapacity(seconds);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_example_wavemaker2_MainActivity_getTrackCount(JNIEnv *env, jobject instance,
+                                                       jlong engineHandle) {
+    return toEngine(engineHandle)->getTrackCount();
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_clearTracks(JNIEnv *env, jobject instance,
+                                                     jlong engineHandle) {
+    return static_cast<jboolean>(toEngine(engineHandle)->clearTracks());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_undoTake(JNIEnv *env, jobject instance,
+                                                  jlong engineHandle) {
+    return static_cast<jboolean>(toEngine(engineHandle)->undoTake());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_redoTake(JNIEnv *env, jobject instance,
+                                                  jlong engineHandle) {
+    return static_cast<jboolean>(toEngine(engineHandle)->redoTake());
 }
 
 JNIEXPORT void JNICALL
-Java_com_example_wavemaker2_MainActivity_stopEngine(JNIEnv *env, jobject instance) {
-    audioEngine.stop();
+Java_com_example_wavemaker2_MainActivity_setTakeHistoryBudget(JNIEnv *env, jobject instance,
+                                                              jlong engineHandle, jlong bytes) {
+    toEngine(engineHandle)->setTakeHistoryBudget(bytes);
+}
+
+// Returns the take history as [undoCount, redoCount, historyBytes].
+JNIEXPORT jlongArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getTakeHistoryState(JNIEnv *env, jobject instance,
+                                                             jlong engineHandle) {
+    const TakeHistoryState state = toEngine(engineHandle)->getTakeHistoryState();
+    const jlong values[] = { state.undoCount, state.redoCount, state.historyBytes };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(kValueCount);
+    if (result != nullptr) env->SetLongArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+/**
+ * Returns numBins bins of a track's waveform between two frames as [min0, max0, rms0, min1, ...],
+ * fewer if the range runs past the end of the track. trackIndex -1 means the take being recorded.
+ */
+JNIEXPORT jfloatArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getTrackPeaks(JNIEnv *env, jobject instance,
+                                                       jlong engineHandle, jint trackIndex,
+                                                       jint startFrame, jint endFrame,
+                                                       jint numBins) {
+    static_assert(sizeof(PeakBin) == 3 * sizeof(jfloat), "PeakBin must be three packed floats");
+    std::vector<PeakBin> bins(static_cast<size_t>(std::max(0, numBins)));
+    const int32_t binCount = toEngine(engineHandle)->getTrackPeaks(trackIndex, startFrame,
+                                                                   endFrame, numBins, bins.data());
+    jfloatArray result = env->NewFloatArray(binCount * 3);
+    if (result != nullptr) {
+        env->SetFloatArrayRegion(result, 0, binCount * 3,
+                                 reinterpret_cast<const jfloat *>(bins.data()));
+    }
+    return result;
+}
+
+/**
+ * Pins a read-only snapshot of a track's samples so far and returns a handle to it, or 0 if
+ * there's no such track. trackIndex -1 means the take being recorded. The snapshot's memory stays
+ * valid until the handle is passed to unpinSnapshot().
+ */
+JNIEXPORT jlong JNICALL
+Java_com_example_wavemaker2_MainActivity_pinSnapshot(JNIEnv *env, jobject instance,
+                                                     jlong engineHandle, jint trackIndex) {
+    return toEngine(engineHandle)->pinSnapshot(trackIndex);
+}
+
+/**
+ * Returns [storageFormat, bytesPerSample, numSamples] for a pinned snapshot, where storageFormat
+ * is 0 float, 1 16-bit or 2 packed 24-bit, or null if the handle isn't pinned.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getSnapshotInfo(JNIEnv *env, jobject instance,
+                                                         jlong engineHandle, jlong handle) {
+    RecordingSnapshot snapshot;
+    if (!toEngine(engineHandle)->getSnapshot(handle, snapshot)) return nullptr;
+
+    const jint values[] = {
+            static_cast<jint>(snapshot.format),
+            snapshot.bytesPerSample,
+            snapshot.numSamples
+    };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jintArray result = env->NewIntArray(kValueCount);
+    if (result != nullptr) env->SetIntArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+/**
+ * Returns read-only direct ByteBuffers over a pinned snapshot's samples, one per storage block in
+ * order, or null if the handle isn't pinned. The samples are in native byte order, which Java has
+ * to set with order(ByteOrder.nativeOrder()). The buffers must not be used once the snapshot has
+ * been unpinned.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getSnapshotBuffers(JNIEnv *env, jobject instance,
+                                                            jlong engineHandle, jlong handle) {
+    RecordingSnapshot snapshot;
+    if (!toEngine(engineHandle)->getSnapshot(handle, snapshot)) return nullptr;
+
+    jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
+    if (byteBufferClass == nullptr) return nullptr;
+    jmethodID asReadOnlyBuffer = env->GetMethodID(byteBufferClass, "asReadOnlyBuffer",
+                                                  "()Ljava/nio/ByteBuffer;");
+    const auto numBlocks = static_cast<jsize>(snapshot.blocks.size());
+    jobjectArray result = env->NewObjectArray(numBlocks, byteBufferClass, nullptr);
+    if (asReadOnlyBuffer == nullptr || result == nullptr) return nullptr;
+
+    for (jsize i = 0; i < numBlocks; ++i) {
+        const int32_t numSamples = std::min(snapshot.samplesPerBlock,
+                                            snapshot.numSamples - i * snapshot.samplesPerBlock);
+        // JNI has no read-only direct buffers, so wrap the block and hand out a read-only view.
+        jobject buffer = env->NewDirectByteBuffer(const_cast<uint8_t *>(snapshot.blocks[i]),
+                                                  numSamples * snapshot.bytesPerSample);
+        if (buffer == nullptr) return nullptr;
+        jobject readOnlyBuffer = env->CallObjectMethod(buffer, asReadOnlyBuffer);
+        env->DeleteLocalRef(buffer);
+        if (env->ExceptionCheck()) return nullptr;
+        env->SetObjectArrayElement(result, i, readOnlyBuffer);
+        env->DeleteLocalRef(readOnlyBuffer);
+    }
+    return result;
 }
 
 JNIEXPORT void JNICALL
-Java_com_example_wavemaker2_MainActivity_setLooping(JNIEnv *env, jobject instance, jboolean isOn) {
-    audioEngine.setLooping(isOn);
+Java_com_example_wavemaker2_MainActivity_unpinSnapshot(JNIEnv *env, jobject instance,
+                                                       jlong engineHandle, jlong handle) {
+    toEngine(engineHandle)->unpinSnapshot(handle);
+}
+
+/**
+ * Returns [peak, rms, clipCount, totalClipCount, framePosition] for the input's most recent
+ * metering window, with linear levels. Cheap enough to call on every frame of the display.
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getInputLevels(JNIEnv *env, jobject instance,
+                                                        jlong engineHandle) {
+    const MeterReading reading = toEngine(engineHandle)->getInputLevels();
+    const jdouble values[] = {
+            reading.peak,
+            reading.rms,
+            static_cast<jdouble>(reading.clipCount),
+            static_cast<jdouble>(reading.totalClipCount),
+            static_cast<jdouble>(reading.framePosition)
+    };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jdoubleArray result = env->NewDoubleArray(kValueCount);
+    if (result != nullptr) env->SetDoubleArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+/**
+ * Returns the callback stats for the playback or recording stream as
+ * [callbackCount, frameCount, totalNanos, lastNanos, maxNanos, xRunCount, bufferSizeInFrames,
+ * histogram bin 0, ..., histogram bin 23], or null if a consistent snapshot couldn't be read.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getCallbackStats(JNIEnv *env, jobject instance,
+                                                          jlong engineHandle, jboolean isPlayback) {
+    CallbackStatsSnapshot snapshot;
+    const StreamDirection direction = isPlayback ? StreamDirection::Output :
+                                                   StreamDirection::Input;
+    if (!toEngine(engineHandle)->getCallbackStats(direction, snapshot)) {
+        return nullptr;
+    }
+
+    constexpr int32_t kFieldCount = 7;
+    jlong values[kFieldCount + kCallbackHistogramBins] = {
+            snapshot.callbackCount,
+            snapshot.frameCount,
+            snapshot.totalNanos,
+            snapshot.lastNanos,
+            snapshot.maxNanos,
+            snapshot.xRunCount,
+            snapshot.bufferSizeInFrames
+    };
+    for (int32_t i = 0; i < kCallbackHistogramBins; ++i) {
+        values[kFieldCount + i] = snapshot.histogram[i];
+    }
+
+    jlongArray result = env->NewLongArray(kFieldCount + kCallbackHistogramBins);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, kFieldCount + kCallbackHistogramBins, values);
+    }
+    return result;
+}
+
+/**
+ * Restricts the callback threads to the CPUs set in cpuMask, bit n for CPU n, from the next time
+ * the engine starts. 0 lets them run anywhere.
+ */
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setCallbackCpuMask(JNIEnv *env, jobject instance,
+                                                            jlong engineHandle, jlong cpuMask) {
+    toEngine(engineHandle)->setCallbackCpuMask(static_cast<uint64_t>(cpuMask));
+}
+
+// Returns a mask of the big cores on a big.LITTLE device, or 0 if every core is the same.
+JNIEXPORT jlong JNICALL
+Java_com_example_wavemaker2_MainActivity_findFastestCpus(JNIEnv *env, jclass type) {
+    return static_cast<jlong>(RealtimeThreadSetup::findFastestCpus());
+}
+
+/**
+ * Returns [threadId, schedulingPolicy, priority, cpu, isFlushingDenormals, isAffinitySet] for the
+ * playback or recording callback thread, or null if the stream hasn't called back yet.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getCallbackThreadInfo(JNIEnv *env, jobject instance,
+                                                               jlong engineHandle,
+                                                               jboolean isPlayback) {
+    RealtimeThreadInfo info;
+    const StreamDirection direction = isPlayback ? StreamDirection::Output :
+                                                   StreamDirection::Input;
+    if (!toEngine(engineHandle)->getCallbackThreadInfo(direction, info)) return nullptr;
+
+    const jint values[] = {
+            info.threadId,
+            info.schedulingPolicy,
+            info.priority,
+            info.cpu,
+            info.isFlushingDenormals,
+            info.isAffinitySet
+    };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jintArray result = env->NewIntArray(kValueCount);
+    if (result != nullptr) env->SetIntArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+/**
+ * Returns [restartCount, lastRestartLatencyNanos] for streams restarted after a disconnect.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getRestartStats(JNIEnv *env, jobject instance,
+                                                         jlong engineHandle) {
+    const AudioEngine *engine = toEngine(engineHandle);
+    const jlong values[] = {
+            engine->getRestartCount(),
+            engine->getLastRestartLatencyNanos()
+    };
+    jlongArray result = env->NewLongArray(2);
+    if (result != nullptr) env->SetLongArrayRegion(result, 0, 2, values);
+    return result;
+}
+
+/**
+ * Sets how the playback buffer size is tuned the next time the engine starts. See
+ * LatencyTunerPolicy.
+ */
+JNIEXPORT void JNICALL
+Java_com_example_wavemaker2_MainActivity_setLatencyTunerPolicy(JNIEnv *env, jobject instance,
+                                                               jlong engineHandle,
+                                                               jboolean isEnabled, jint maxBursts,
+                                                               jint xRunThreshold,
+                                                               jint holdCallbacks,
+                                                               jint shrinkAfterCallbacks) {
+    LatencyTunerPolicy policy;
+    policy.isEnabled = isEnabled;
+    policy.maxBursts = maxBursts;
+    policy.xRunThreshold = xRunThreshold;
+    policy.holdCallbacks = holdCallbacks;
+    policy.shrinkAfterCallbacks = shrinkAfterCallbacks;
+    toEngine(engineHandle)->setLatencyTunerPolicy(policy);
+}
+
+/**
+ * Returns the tuner's policy and state as [isEnabled, maxBursts, xRunThreshold, holdCallbacks,
+ * shrinkAfterCallbacks, bufferSizeInFrames, framesPerBurst, capacityInFrames, xRunCount,
+ * growCount, shrinkCount].
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getLatencyTunerState(JNIEnv *env, jobject instance,
+                                                              jlong engineHandle) {
+    AudioEngine *engine = toEngine(engineHandle);
+    const LatencyTunerPolicy policy = engine->getLatencyTunerPolicy();
+    const LatencyTunerState state = engine->getLatencyTunerState();
+    const jint values[] = {
+            policy.isEnabled,
+            policy.maxBursts,
+            policy.xRunThreshold,
+            policy.holdCallbacks,
+            policy.shrinkAfterCallbacks,
+            state.bufferSizeInFrames,
+            state.framesPerBurst,
+            state.capacityInFrames,
+            state.xRunCount,
+            state.growCount,
+            state.shrinkCount
+    };
+    constexpr jsize kValueCount = sizeof(values) / sizeof(values[0]);
+    jintArray result = env->NewIntArray(kValueCount);
+    if (result != nullptr) env->SetIntArrayRegion(result, 0, kValueCount, values);
+    return result;
+}
+
+/**
+ * Starts measuring the round-trip latency with an impulse, or a maximum-length sequence which is
+ * more robust against noise. Returns false if the engine isn't running.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_example_wavemaker2_MainActivity_startLatencyMeasurement(JNIEnv *env, jobject instance,
+                                                                 jlong engineHandle,
+                                                                 jboolean useImpulse) {
+    return toEngine(engineHandle)->startLatencyMeasurement(useImpulse ? LatencySignal::Impulse :
+                                                                       LatencySignal::Mls);
+}
+
+/**
+ * Returns [latencyMillis, confidence] for the last latency measurement, where confidence is
+ * between 0 and 1, or null if it hasn't finished yet.
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_example_wavemaker2_MainActivity_getLatencyResult(JNIEnv *env, jobject instance,
+                                                          jlong engineHandle) {
+    LatencyResult latency;
+    if (!toEngine(engineHandle)->getLatencyResult(latency)) return nullptr;
+
+    const jdouble values[] = { latency.latencyMillis, latency.confidence };
+    jdoubleArray result = env->NewDoubleArray(2);
+    if (result != nullptr) env->SetDoubleArrayRegion(result, 0, 2, values);
+    return result;
 }
 
 }// End extern "C"
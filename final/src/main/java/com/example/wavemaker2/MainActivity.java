@@ -25,6 +25,8 @@ import android.view.View;
 import android.widget.CompoundButton;
 import android.widget.Switch;
 
+import java.nio.ByteBuffer;
+
 import static androidx.core.content.PermissionChecker.PERMISSION_GRANTED;
 import androidx.annotation.NonNull;
 import androidx.core.app.ActivityCompat;
@@ -34,12 +36,60 @@ public class MainActivity extends AppCompatActivity {
 
     private static final int WAVEMAKER2_REQUEST = 0;
     private static final String TAG = MainActivity.class.toString();
-
-    public native void startEngine();
-    public native void stopEngine();
-    public native void setRecording(boolean isRecording);
-    public native void setPlaying(boolean isPlaying);
-    private native void setLooping(boolean isOn);
+    // Record and play in a single callback rather than one per stream.
+    private static final boolean USE_FULL_DUPLEX = false;
+
+    // The native engine this activity drives. Each activity has its own.
+    private long mEngineHandle;
+
+    private static native long createEngine();
+    private static native void deleteEngine(long engineHandle);
+    private native void setDeviceIds(long engineHandle, int playbackDeviceId,
+                                     int recordingDeviceId);
+    public native void startEngine(long engineHandle, boolean isFullDuplex);
+    public native void stopEngine(long engineHandle);
+    public native void setRecording(long engineHandle, boolean isRecording);
+    public native void setPlaying(long engineHandle, boolean isPlaying);
+    private native void setLooping(long engineHandle, boolean isOn);
+    private native boolean scheduleTransportEvent(long engineHandle, int action, long frameTime);
+    private native long getPlaybackFramePosition(long engineHandle);
+    private native void setTrackGain(long engineHandle, int trackIndex, float gain);
+    private native void setTrackMuted(long engineHandle, int trackIndex, boolean isMuted);
+    private native void setTrackLoopLength(long engineHandle, int trackIndex, int numFrames);
+    private native void setStorageFormat(long engineHandle, int format);
+    private native void setRecordingCapacity(long engineHandle, int seconds);
+    private native boolean importTrack(long engineHandle, String path);
+    private native boolean isImporting(long engineHandle);
+    private native boolean setOnsetGate(long engineHandle, boolean isEnabled, float threshold,
+                                        int preRollFrames);
+    private native boolean isWaitingForOnset(long engineHandle);
+    private native boolean startDiskCapture(long engineHandle, String path, int format);
+    private native boolean stopDiskCapture(long engineHandle);
+    private native long[] getDiskCaptureStats(long engineHandle);
+    private native int getTrackCount(long engineHandle);
+    private native boolean clearTracks(long engineHandle);
+    private native boolean undoTake(long engineHandle);
+    private native boolean redoTake(long engineHandle);
+    private native void setTakeHistoryBudget(long engineHandle, long bytes);
+    private native long[] getTakeHistoryState(long engineHandle);
+    private native float[] getTrackPeaks(long engineHandle, int trackIndex, int startFrame,
+                                         int endFrame, int numBins);
+    private native long pinSnapshot(long engineHandle, int trackIndex);
+    private native int[] getSnapshotInfo(long engineHandle, long handle);
+    private native ByteBuffer[] getSnapshotBuffers(long engineHandle, long handle);
+    private native void unpinSnapshot(long engineHandle, long handle);
+    private native double[] getInputLevels(long engineHandle);
+    private native long[] getCallbackStats(long engineHandle, boolean isPlayback);
+    private native void setCallbackCpuMask(long engineHandle, long cpuMask);
+    private static native long findFastestCpus();
+    private native int[] getCallbackThreadInfo(long engineHandle, boolean isPlayback);
+    private native long[] getRestartStats(long engineHandle);
+    private native void setLatencyTunerPolicy(long engineHandle, boolean isEnabled, int maxBursts,
+                                              int xRunThreshold, int holdCallbacks,
+                                              int shrinkAfterCallbacks);
+    private native int[] getLatencyTunerState(long engineHandle);
+    private native boolean startLatencyMeasurement(long engineHandle, boolean useImpulse);
+    private native double[] getLatencyResult(long engineHandle);
 
     // Used to load the 'native-lib' library on application startup.
     static {
@@ -50,6 +100,7 @@ public class MainActivity extends AppCompatActivity {
     protected void onCreate(Bundle savedInstanceState) {
         super.onCreate(savedInstanceState);
         setContentView(R.layout.activity_main);
+        mEngineHandle = createEngine();
 
         View recordButton = findViewById(R.id.button_record);
         recordButton.setOnTouchListener(new View.OnTouchListener() {
@@ -57,10 +108,10 @@ public class MainActivity extends AppCompatActivity {
             public boolean onTouch(View view, MotionEvent motionEvent) {
                 switch(motionEvent.getAction()){
                     case MotionEvent.ACTION_DOWN:
-                        setRecording(true);
+                        setRecording(mEngineHandle, true);
                         break;
                     case MotionEvent.ACTION_UP:
-                        setRecording(false);
+                        setRecording(mEngineHandle, false);
                         break;
                 }
                 return true;
@@ -73,10 +124,10 @@ public class MainActivity extends AppCompatActivity {
             public boolean onTouch(View view, MotionEvent motionEvent) {
                 switch(motionEvent.getAction()){
                     case MotionEvent.ACTION_DOWN:
-                        setPlaying(true);
+                        setPlaying(mEngineHandle, true);
                         break;
                     case MotionEvent.ACTION_UP:
-                        setPlaying(false);
+                        setPlaying(mEngineHandle, false);
                         break;
                 }
                 return true;
@@ -87,7 +138,7 @@ public class MainActivity extends AppCompatActivity {
         loopButton.setOnCheckedChangeListener(new CompoundButton.OnCheckedChangeListener() {
             @Override
             public void onCheckedChanged(CompoundButton compoundButton, boolean b) {
-                setLooping(b);
+                setLooping(mEngineHandle, b);
             }
         });
     }
@@ -96,7 +147,7 @@ public class MainActivity extends AppCompatActivity {
     public void onResume(){
         // Check we have the record permission
         if (isRecordPermissionGranted()){
-            startEngine();
+            startEngine(mEngineHandle, USE_FULL_DUPLEX);
         } else {
             Log.d(TAG, "Requesting recording permission");
             requestRecordPermission();
@@ -106,10 +157,17 @@ public class MainActivity extends AppCompatActivity {
 
     @Override
     public void onPause() {
-        stopEngine();
+        stopEngine(mEngineHandle);
         super.onPause();
     }
 
+    @Override
+    protected void onDestroy() {
+        deleteEngine(mEngineHandle);
+        mEngineHandle = 0;
+        super.onDestroy();
+    }
+
     @Override
     public void onRequestPermissionsResult(int requestCode,
                                            @NonNull String permissions[],
@@ -118,7 +176,7 @@ public class MainActivity extends AppCompatActivity {
         if (permissions.length > 0 &&
                 permissions[0].equals(Manifest.permission.RECORD_AUDIO) &&
                 grantResults[0] == PERMISSION_GRANTED) {
-            startEngine();
+            startEngine(mEngineHandle, USE_FULL_DUPLEX);
         }
     }
 
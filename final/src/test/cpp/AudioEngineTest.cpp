@@ -0,0 +1,420 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "AudioEngine.h"
+#include "DiskWriter.h"
+#include "OfflineBackend.h"
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+
+// An engine driven by an offline backend which the test keeps hold of.
+class AudioEngineTest : public ::testing::Test {
+
+protected:
+    OfflineBackend *mBackend = new OfflineBackend(OfflineConfig());
+    AudioEngine mEngine { std::unique_ptr<AudioBackend>(mBackend) };
+
+    void SetUp() override {
+        mBackend->setInputSine(440, 0.5f);
+        mEngine.setRecordingCapacity(10);
+        mEngine.start();
+    }
+
+    // The control thread works asynchronously, so give it a moment to get to a request.
+    template <typename Condition>
+    bool waitFor(Condition condition) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+// An engine whose output is captured, with one looping take of constant input to play, so any
+// frame of output which isn't silent was played.
+class AudioEngineTransportTest : public ::testing::Test {
+
+protected:
+    OfflineBackend *mBackend = new OfflineBackend(makeConfig());
+    AudioEngine mEngine { std::unique_ptr<AudioBackend>(mBackend) };
+    int32_t mTakeFrames = 0;
+
+    static OfflineConfig makeConfig() {
+        OfflineConfig config;
+        config.captureOutput = true;
+        return config;
+    }
+
+    void SetUp() override {
+        mBackend->setInputSamples(std::vector<float>(1000, 0.5f));
+        mEngine.setRecordingCapacity(10);
+        mEngine.start();
+        mEngine.setRecording(true);
+        mBackend->run(kSampleRate / 10);
+        mEngine.setRecording(false);
+        mEngine.setLooping(true);
+        mBackend->run(kSampleRate / 100);
+        ASSERT_EQ(1, mEngine.getTrackCount());
+
+        const int64_t handle = mEngine.pinSnapshot(0);
+        RecordingSnapshot snapshot;
+        ASSERT_TRUE(mEngine.getSnapshot(handle, snapshot));
+        mTakeFrames = snapshot.numSamples;
+        mEngine.unpinSnapshot(handle);
+    }
+
+    void TearDown() override { mEngine.stop(); }
+
+    // The first and last frames of captured output which aren't silent, or -1 if all of it is.
+    void findSound(int64_t *first, int64_t *last) const {
+        const std::vector<float> &output = mBackend->getCapturedOutput();
+        const int64_t channelCount = output.size() / mEngine.getPlaybackFramePosition();
+        *first = -1;
+        *last = -1;
+        for (size_t i = 0; i < output.size(); ++i) {
+            if (output[i] == 0.0f) continue;
+            if (*first < 0) *first = i / channelCount;
+            *last = i / channelCount;
+        }
+    }
+};
+
+} // namespace
+
+TEST_F(AudioEngineTransportTest, PlaybackStartsAndStopsOnTheScheduledFrames) {
+
+    // Neither frame is on a burst boundary, so each callback has to split its buffer.
+    const int64_t now = mEngine.getPlaybackFramePosition();
+    const int64_t startFrame = now + 1000;
+    const int64_t stopFrame = startFrame + 2345;
+    ASSERT_NE(0, startFrame % OfflineConfig().outputFramesPerBurst);
+    ASSERT_NE(0, stopFrame % OfflineConfig().outputFramesPerBurst);
+    ASSERT_TRUE(mEngine.scheduleTransportEvent(TransportAction::StartPlaying, startFrame));
+    ASSERT_TRUE(mEngine.scheduleTransportEvent(TransportAction::StopPlaying, stopFrame));
+    mBackend->run(kSampleRate / 10);
+
+    int64_t first;
+    int64_t last;
+    findSound(&first, &last);
+    EXPECT_EQ(startFrame, first);
+    EXPECT_EQ(stopFrame - 1, last);
+}
+
+TEST_F(AudioEngineTransportTest, PlaybackStopsAtTheNextLoopBoundary) {
+
+    const int64_t startFrame = mEngine.getPlaybackFramePosition() + 1000;
+    ASSERT_TRUE(mEngine.scheduleTransportEvent(TransportAction::StartPlaying, startFrame));
+    mBackend->run(kSampleRate / 20);
+    ASSERT_LT(mEngine.getPlaybackFramePosition(), startFrame + mTakeFrames);
+
+    // The take would loop forever, so the only thing which can stop it at the end of its first
+    // pass is the event.
+    ASSERT_TRUE(mEngine.scheduleTransportEvent(TransportAction::StopPlaying,
+                                               kTransportNextLoopBoundary));
+    mBackend->run(kSampleRate / 5);
+
+    int64_t first;
+    int64_t last;
+    findSound(&first, &last);
+    EXPECT_EQ(startFrame, first);
+    EXPECT_EQ(startFrame + mTakeFrames - 1, last);
+}
+
+TEST_F(AudioEngineTest, TakeStoppedWhileStreamsAreClosedIsAdded) {
+
+    mEngine.setRecording(true);
+    mBackend->run(kSampleRate / 10);
+    mEngine.stop();
+
+    // Nothing is rendering to pick the stop up, so the control thread has to.
+    mEngine.setRecording(false);
+    EXPECT_TRUE(waitFor([this]() { return mEngine.getTrackCount() == 1; }));
+    EXPECT_TRUE(mEngine.clearTracks());
+}
+
+TEST_F(AudioEngineTest, TakeStartedAndStoppedWhileStreamsAreClosedEnds) {
+
+    mEngine.stop();
+    mEngine.setRecording(true);
+    mEngine.setRecording(false);
+
+    // Nothing was recorded, so there's no track, but the take is over and another can start.
+    EXPECT_TRUE(waitFor([this]() {
+        return mEngine.scheduleTransportEvent(TransportAction::StartRecording, kTransportNow);
+    }));
+    EXPECT_EQ(0, mEngine.getTrackCount());
+}
+
+TEST_F(AudioEngineTest, TransportEventsAreLeftToRunningStreams) {
+
+    mEngine.setRecording(true);
+    mBackend->run(kSampleRate / 10);
+    mEngine.setRecording(false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(0, mEngine.getTrackCount());
+
+    mBackend->run(kSampleRate / 10);
+    EXPECT_EQ(1, mEngine.getTrackCount());
+}
+
+TEST_F(AudioEngineTest, SnapshotIsCopiedOutUntilUnpinned) {
+
+    mEngine.setRecording(true);
+    mBackend->run(kSampleRate / 2);
+    mEngine.setRecording(false);
+    mBackend->run(kSampleRate / 10);
+    ASSERT_EQ(1, mEngine.getTrackCount());
+
+    const int64_t handle = mEngine.pinSnapshot(0);
+    ASSERT_NE(0, handle);
+    RecordingSnapshot snapshot;
+    ASSERT_TRUE(mEngine.getSnapshot(handle, snapshot));
+    EXPECT_GT(snapshot.numSamples, 0);
+    EXPECT_EQ((snapshot.numSamples + snapshot.samplesPerBlock - 1) / snapshot.samplesPerBlock,
+              static_cast<int32_t>(snapshot.blocks.size()));
+
+    mEngine.unpinSnapshot(handle);
+    EXPECT_FALSE(mEngine.getSnapshot(handle, snapshot));
+}
+
+TEST_F(AudioEngineTest, RecordingCallbackDoesntFaultWithReservedMemory) {
+
+    // Let the streams settle, so that the callbacks' own buffers have been touched.
+    mBackend->run(kSampleRate / 10);
+
+    // Several blocks of samples and of peaks, all claimed from the reservation made when the
+    // engine started.
+    mEngine.setRecording(true);
+    const OfflineReport report = mBackend->run(3 * kSampleRate);
+    mEngine.setRecording(false);
+    mBackend->run(kSampleRate / 10);
+    ASSERT_EQ(1, mEngine.getTrackCount());
+
+    EXPECT_EQ(0, report.input.majorPageFaults);
+    EXPECT_EQ(0, report.input.minorPageFaults);
+}
+
+TEST_F(AudioEngineTest, CurrentTakeIsNeverAFreedTrack) {
+
+    constexpr int32_t kNumBins = 10;
+    PeakBin bins[kNumBins];
+    auto getCurrentTakePeaks = [&]() {
+        return mEngine.getTrackPeaks(kCurrentTakeIndex, 0, kSampleRate / 4, kNumBins, bins);
+    };
+    EXPECT_EQ(0, getCurrentTakePeaks());
+
+    mEngine.setRecording(true);
+    mBackend->run(kSampleRate / 2);
+    EXPECT_EQ(kNumBins, getCurrentTakePeaks());
+    mEngine.setRecording(false);
+    mBackend->run(kSampleRate / 10);
+    ASSERT_EQ(1, mEngine.getTrackCount());
+    EXPECT_EQ(kNumBins, getCurrentTakePeaks());
+
+    // Dropping the history frees the take once the callback has moved on from it.
+    EXPECT_TRUE(mEngine.clearTracks());
+    mBackend->run(kSampleRate / 10);
+    mEngine.setTakeHistoryBudget(0);
+    mBackend->run(kSampleRate / 10);
+    mEngine.setTakeHistoryBudget(0);
+    EXPECT_EQ(0, mEngine.getTakeHistoryState().historyBytes);
+    EXPECT_EQ(0, getCurrentTakePeaks());
+    EXPECT_EQ(0, mEngine.pinSnapshot(kCurrentTakeIndex));
+}
+
+TEST_F(AudioEngineTest, ImportedFileBecomesTrack) {
+
+    const struct {
+        int32_t fileSampleRate;
+        int32_t fileFrames;
+    } kCases[] = {
+            { kSampleRate, 100000 },
+            { 44100, 44100 },
+    };
+
+    for (const auto &testCase : kCases) {
+        SCOPED_TRACE(testCase.fileSampleRate);
+        const std::string path = testing::TempDir() + "AudioEngineTestImport.wav";
+        std::vector<float> samples(testCase.fileFrames);
+        for (int32_t i = 0; i < testCase.fileFrames; ++i) {
+            samples[i] = 0.5f * sinf(i * 0.02f);
+        }
+        DiskWriter writer;
+        ASSERT_TRUE(writer.open(path.c_str(), testCase.fileSampleRate, kChannelCountMono,
+                                StorageFormat::Float));
+        writer.write(samples.data(), testCase.fileFrames);
+        ASSERT_TRUE(writer.close());
+
+        ASSERT_TRUE(mEngine.clearTracks() || mEngine.getTrackCount() == 0);
+        mBackend->run(kSampleRate / 100);
+        ASSERT_EQ(0, mEngine.getTrackCount());
+        ASSERT_TRUE(mEngine.importTrack(path.c_str()));
+
+        // The track is added by the playback callback once the import has started, and the
+        // import thread carries on filling it in.
+        const int32_t expectedFrames = static_cast<int32_t>(
+                static_cast<int64_t>(testCase.fileFrames) * kSampleRate /
+                testCase.fileSampleRate);
+        RecordingSnapshot snapshot;
+        EXPECT_TRUE(waitFor([&]() {
+            mBackend->run(kSampleRate / 100);
+            const int64_t handle = mEngine.pinSnapshot(0);
+            if (handle == 0) return false;
+            mEngine.getSnapshot(handle, snapshot);
+            mEngine.unpinSnapshot(handle);
+            return snapshot.numSamples == expectedFrames;
+        }));
+        unlink(path.c_str());
+
+        // At the file's own rate the samples arrive untouched.
+        if (testCase.fileSampleRate == kSampleRate) {
+            const int64_t handle = mEngine.pinSnapshot(0);
+            ASSERT_TRUE(mEngine.getSnapshot(handle, snapshot));
+            ASSERT_EQ(StorageFormat::Float, snapshot.format);
+            for (int32_t i = 0; i < snapshot.numSamples; ++i) {
+                const auto *block = reinterpret_cast<const float *>(
+                        snapshot.blocks[i / snapshot.samplesPerBlock]);
+                ASSERT_EQ(samples[i], block[i % snapshot.samplesPerBlock]) << "at frame " << i;
+            }
+            mEngine.unpinSnapshot(handle);
+        }
+
+        // Once it's finished another take can start.
+        EXPECT_TRUE(waitFor([&]() {
+            mBackend->run(kSampleRate / 100);
+            return mEngine.scheduleTransportEvent(TransportAction::StartRecording,
+                                                  kTransportNow);
+        }));
+        mEngine.setRecording(false);
+        mBackend->run(kSampleRate / 100);
+    }
+}
+
+TEST_F(AudioEngineTest, TakeCantStartWhileImportIsWriting) {
+
+    // Long enough to still be importing once the track has been added.
+    const std::string path = testing::TempDir() + "AudioEngineTestLongImport.wav";
+    std::vector<float> samples(5 * 44100);
+    for (size_t i = 0; i < samples.size(); ++i) samples[i] = 0.5f * sinf(i * 0.02f);
+    DiskWriter writer;
+    ASSERT_TRUE(writer.open(path.c_str(), 44100, kChannelCountMono, StorageFormat::Float));
+    writer.write(samples.data(), static_cast<int32_t>(samples.size()));
+    ASSERT_TRUE(writer.close());
+    ASSERT_TRUE(mEngine.importTrack(path.c_str()));
+
+    // A take accepted while the import thread is still writing would share the block pool with
+    // it and write alongside a track which is already in the history.
+    EXPECT_TRUE(waitFor([&]() {
+        mBackend->run(kSampleRate / 100);
+        return mEngine.scheduleTransportEvent(TransportAction::StartRecording, kTransportNow);
+    }));
+    EXPECT_FALSE(mEngine.isImporting());
+    EXPECT_EQ(1, mEngine.getTrackCount());
+    unlink(path.c_str());
+}
+
+TEST(AudioEngineDuplexTest, InputAtAnotherRateIsResampledWithoutGaps) {
+
+    for (int32_t inputSampleRate : { 44100, 96000 }) {
+        SCOPED_TRACE(inputSampleRate);
+        OfflineConfig config;
+        config.inputSampleRate = inputSampleRate;
+        auto *backend = new OfflineBackend(config);
+        AudioEngine engine { std::unique_ptr<AudioBackend>(backend) };
+        backend->setInputSine(440, 0.5f);
+        engine.setRecordingCapacity(10);
+        engine.start(true);
+        // Let the input settle after priming.
+        backend->run(kSampleRate / 2);
+
+        // A second of output takes a second of input, whatever rate it comes in at.
+        engine.setRecording(true);
+        backend->run(kSampleRate);
+        engine.setRecording(false);
+        backend->run(kSampleRate / 10);
+        ASSERT_EQ(1, engine.getTrackCount());
+        const int64_t handle = engine.pinSnapshot(0);
+        RecordingSnapshot snapshot;
+        ASSERT_TRUE(engine.getSnapshot(handle, snapshot));
+        EXPECT_NEAR(kSampleRate, snapshot.numSamples, 192);
+
+        // Neither padded with silence nor missing frames, so the sine carries on unbroken. It
+        // passes through zero, but never stays there.
+        int32_t zeroRunCount = 0;
+        float previous = 0;
+        float maxStep = 0;
+        for (int32_t i = 0; i < snapshot.numSamples; ++i) {
+            const float sample = reinterpret_cast<const float *>(
+                    snapshot.blocks[i / snapshot.samplesPerBlock])[i % snapshot.samplesPerBlock];
+            if (i > 0 && sample == 0.0f && previous == 0.0f) zeroRunCount++;
+            if (i > 0) maxStep = std::max(maxStep, fabsf(sample - previous));
+            previous = sample;
+        }
+        engine.unpinSnapshot(handle);
+        EXPECT_EQ(0, zeroRunCount);
+        // The steepest a 440Hz sine of 0.5 gets between two frames, plus the resampler's error.
+        EXPECT_LT(maxStep, 2 * M_PI * 440 * 0.5 / kSampleRate * 1.01);
+        engine.stop();
+    }
+}
+
+TEST(AudioEngineStressTest, EnginesCycleInParallel) {
+
+    // Engines share nothing, so each thread's engines must behave as if they were alone while
+    // the others are started, restarted and torn down around them.
+    constexpr int32_t kThreadCount = 8;
+    constexpr int32_t kCyclesPerThread = 20;
+    std::atomic<int32_t> goodCycles { 0 };
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < kThreadCount; ++t) {
+        threads.emplace_back([&goodCycles]() {
+            for (int32_t cycle = 0; cycle < kCyclesPerThread; ++cycle) {
+                auto *backend = new OfflineBackend(OfflineConfig());
+                AudioEngine engine { std::unique_ptr<AudioBackend>(backend) };
+                engine.setRecordingCapacity(1);
+                engine.start();
+                engine.setRecording(true);
+                backend->run(kSampleRate / 20);
+                engine.setRecording(false);
+                backend->run(kSampleRate / 100);
+                engine.restart();
+                engine.stop();
+                engine.start();
+                if (engine.getTrackCount() == 1 && engine.undoTake() &&
+                    engine.getTrackCount() == 0) {
+                    goodCycles++;
+                }
+                // Half the engines are destroyed while they're still running.
+                if (cycle % 2 == 0) engine.stop();
+            }
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+    EXPECT_EQ(kThreadCount * kCyclesPerThread, goodCycles.load());
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "Definitions.h"
+#include "DiskWriter.h"
+#include "WavFileReader.h"
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kCallbackFrames = 192;
+
+// A file in the test's temporary directory which is deleted afterwards.
+class DiskWriterTest : public ::testing::Test {
+
+protected:
+    std::string mPath = testing::TempDir() + "DiskWriterTest.wav";
+
+    void TearDown() override { unlink(mPath.c_str()); }
+
+    // Write numFrames of a test signal a callback's worth at a time, as the recording callback
+    // would, and return the signal.
+    std::vector<float> writeSignal(DiskWriter &writer, int32_t numFrames, int32_t channelCount) {
+        std::vector<float> signal(numFrames * channelCount);
+        for (size_t i = 0; i < signal.size(); ++i) signal[i] = 0.8f * sinf(i * 0.01f);
+        for (int32_t start = 0; start < numFrames; start += kCallbackFrames) {
+            const int32_t chunkFrames = std::min(kCallbackFrames, numFrames - start);
+            EXPECT_EQ(chunkFrames, writer.write(&signal[start * channelCount], chunkFrames));
+        }
+        return signal;
+    }
+
+    std::vector<float> readMono(WavInfo *info) {
+        WavFileReader reader;
+        EXPECT_TRUE(reader.open(mPath.c_str()));
+        *info = reader.getInfo();
+        std::vector<float> samples(static_cast<size_t>(info->getNumFrames()));
+        EXPECT_EQ(static_cast<int32_t>(samples.size()),
+                  reader.readMono(samples.data(), static_cast<int32_t>(samples.size())));
+        return samples;
+    }
+};
+
+} // namespace
+
+TEST_F(DiskWriterTest, FileHoldsWhatWasWrittenInEveryFormat) {
+
+    // Several write blocks and a partial one at the end.
+    constexpr int32_t kFrames = 3 * kDiskWriteBlockSamples + 1000;
+    const struct {
+        StorageFormat format;
+        uint16_t bitsPerSample;
+        float tolerance;
+    } kCases[] = {
+            { StorageFormat::Float, 32, 0.0f },
+            { StorageFormat::I16, 16, 1.0f / 32768 },
+            { StorageFormat::Packed24, 24, 1.0f / 8388608 },
+    };
+
+    for (const auto &testCase : kCases) {
+        SCOPED_TRACE(static_cast<int>(testCase.format));
+        DiskWriter writer;
+        ASSERT_TRUE(writer.open(mPath.c_str(), kSampleRate, kChannelCountMono, testCase.format));
+        EXPECT_TRUE(writer.isOpen());
+        const std::vector<float> signal = writeSignal(writer, kFrames, kChannelCountMono);
+        EXPECT_TRUE(writer.close());
+        EXPECT_FALSE(writer.isOpen());
+
+        const DiskWriterStats stats = writer.getStats();
+        EXPECT_EQ(kFrames, stats.framesWritten);
+        EXPECT_EQ(0, stats.overflowFrameCount);
+        EXPECT_EQ(0, stats.errorCount);
+
+        WavInfo info;
+        const std::vector<float> samples = readMono(&info);
+        EXPECT_EQ(kSampleRate, static_cast<int32_t>(info.sampleRate));
+        EXPECT_EQ(testCase.bitsPerSample, info.bitsPerSample);
+        // The samples start on a page boundary so the block writes are aligned.
+        EXPECT_EQ(kWavHeaderSize, info.dataOffset);
+        EXPECT_EQ(static_cast<uint64_t>(kFrames) * testCase.bitsPerSample / 8, info.dataSize);
+        ASSERT_EQ(signal.size(), samples.size());
+        for (size_t i = 0; i < signal.size(); ++i) {
+            ASSERT_NEAR(signal[i], samples[i], testCase.tolerance) << "at frame " << i;
+        }
+    }
+}
+
+TEST_F(DiskWriterTest, StereoFramesAreInterleaved) {
+
+    DiskWriter writer;
+    ASSERT_TRUE(writer.open(mPath.c_str(), kSampleRate, kChannelCountStereo,
+                            StorageFormat::Float));
+    const std::vector<float> signal = writeSignal(writer, 5000, kChannelCountStereo);
+    EXPECT_TRUE(writer.close());
+
+    WavInfo info;
+    const std::vector<float> samples = readMono(&info);
+    EXPECT_EQ(kChannelCountStereo, info.channelCount);
+    ASSERT_EQ(5000u, samples.size());
+    for (size_t i = 0; i < samples.size(); ++i) {
+        ASSERT_FLOAT_EQ((signal[2 * i] + signal[2 * i + 1]) / 2, samples[i]);
+    }
+}
+
+TEST_F(DiskWriterTest, FramesWhichDontFitInTheRingAreCounted) {
+
+    // Nothing can be drained during a single write, so all but a ring's worth is dropped.
+    DiskWriter writer;
+    ASSERT_TRUE(writer.open(mPath.c_str(), kSampleRate, kChannelCountMono, StorageFormat::I16));
+    std::vector<float> frames(2 * kDiskRingSamples, 0.25f);
+    EXPECT_EQ(kDiskRingSamples, writer.write(frames.data(), 2 * kDiskRingSamples));
+    EXPECT_TRUE(writer.close());
+
+    const DiskWriterStats stats = writer.getStats();
+    EXPECT_EQ(kDiskRingSamples, stats.framesWritten);
+    EXPECT_EQ(kDiskRingSamples, stats.overflowFrameCount);
+    WavInfo info;
+    EXPECT_EQ(static_cast<size_t>(kDiskRingSamples), readMono(&info).size());
+}
+
+TEST_F(DiskWriterTest, WritesAreIgnoredWhenClosed) {
+
+    DiskWriter writer;
+    EXPECT_EQ(0, writer.write(std::vector<float>(10).data(), 10));
+    EXPECT_FALSE(writer.open("/nonexistent/directory/file.wav", kSampleRate, kChannelCountMono,
+                             StorageFormat::Float));
+    EXPECT_FALSE(writer.isOpen());
+}
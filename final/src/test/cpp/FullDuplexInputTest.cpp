@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Definitions.h"
+#include "FullDuplexInput.h"
+#include "OfflineBackend.h"
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int64_t kRunFrames = 10 * kSampleRate;
+
+/**
+ * An output stream whose callback pulls its input through a FullDuplexInput, with the input's
+ * clock running at clockScale times the output's.
+ */
+class DuplexRun {
+
+public:
+    explicit DuplexRun(double clockScale) : mBackend(makeConfig(clockScale)) {
+
+        StreamParameters inputParameters;
+        inputParameters.direction = StreamDirection::Input;
+        inputParameters.channelCount = kChannelCountMono;
+        inputParameters.sampleRate = kSampleRate;
+        mInput = mBackend.openStream(inputParameters);
+
+        StreamParameters outputParameters;
+        outputParameters.channelCount = kChannelCountMono;
+        outputParameters.sampleRate = kSampleRate;
+        outputParameters.dataCallback = outputCallback;
+        outputParameters.userData = this;
+        mOutput = mBackend.openStream(outputParameters);
+
+        mDuplexInput.reset();
+        mInput->requestStart();
+        mOutput->requestStart();
+        mBackend.run(kRunFrames);
+    }
+
+    const FullDuplexInput &getDuplexInput() const { return mDuplexInput; }
+
+private:
+    OfflineBackend mBackend;
+    std::unique_ptr<AudioStream> mInput;
+    std::unique_ptr<AudioStream> mOutput;
+    FullDuplexInput mDuplexInput;
+    std::vector<float> mInputBuffer;
+
+    static OfflineConfig makeConfig(double clockScale) {
+        OfflineConfig config;
+        config.sampleRate = kSampleRate;
+        config.inputClockScale = clockScale;
+        return config;
+    }
+
+    static CallbackResult outputCallback(AudioStream *, void *userData, void *audioData,
+                                         int32_t numFrames) {
+        auto *run = static_cast<DuplexRun *>(userData);
+        run->mInputBuffer.resize(numFrames);
+        run->mDuplexInput.read(*run->mInput, run->mInputBuffer.data(), numFrames);
+        memcpy(audioData, run->mInputBuffer.data(), numFrames * sizeof(float));
+        return CallbackResult::Continue;
+    }
+};
+
+// The frames the input gains or loses relative to the output over the run.
+int64_t getDrift(double clockScale) {
+    return static_cast<int64_t>(kRunFrames * std::abs(clockScale - 1.0));
+}
+
+} // namespace
+
+TEST(FullDuplexInputTest, MatchedClocksNeitherPadNorDrop) {
+    DuplexRun run(1.0);
+    EXPECT_EQ(0, run.getDuplexInput().getPaddedFrameCount());
+    EXPECT_EQ(0, run.getDuplexInput().getDroppedFrameCount());
+}
+
+TEST(FullDuplexInputTest, SlowInputIsPaddedWithSilence) {
+
+    // Padding makes up the missing frames, give or take the backlog left after priming.
+    constexpr double kClockScale = 0.999;
+    DuplexRun run(kClockScale);
+    const FullDuplexInput &input = run.getDuplexInput();
+    EXPECT_EQ(0, input.getDroppedFrameCount());
+    EXPECT_NEAR(getDrift(kClockScale), input.getPaddedFrameCount(), 2 * 192);
+    EXPECT_GT(input.getUnderflowCount(), 0);
+}
+
+TEST(FullDuplexInputTest, FastInputDropsBacklog) {
+
+    constexpr double kClockScale = 1.001;
+    DuplexRun run(kClockScale);
+    const FullDuplexInput &input = run.getDuplexInput();
+    EXPECT_EQ(0, input.getPaddedFrameCount());
+    EXPECT_NEAR(getDrift(kClockScale), input.getDroppedFrameCount(), 2 * 192);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "LatencyAnalyzer.h"
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kMlsOrder = 12;
+constexpr float kMlsAmplitude = 0.5f;
+
+// A recording of signal delayed by delayFrames, scaled by gain and buried in uniform noise.
+std::vector<float> makeRecording(const std::vector<float> &signal, int32_t delayFrames,
+                                 int32_t recordingLength, float gain, float noiseAmplitude) {
+    std::minstd_rand random(1234);
+    std::uniform_real_distribution<float> noise(-noiseAmplitude, noiseAmplitude);
+    std::vector<float> recording(recordingLength);
+    for (float &sample : recording) sample = noise(random);
+    for (size_t i = 0; i < signal.size(); ++i) {
+        recording[delayFrames + i] += gain * signal[i];
+    }
+    return recording;
+}
+
+LatencyResult analyze(const std::vector<float> &signal, const std::vector<float> &recording) {
+    return findDelay(signal.data(), static_cast<int32_t>(signal.size()),
+                     recording.data(), static_cast<int32_t>(recording.size()), kSampleRate);
+}
+
+} // namespace
+
+TEST(LatencyAnalyzerTest, MlsDelayIsRecoveredExactly) {
+
+    const std::vector<float> mls = generateMls(kMlsOrder, kMlsAmplitude);
+    for (int32_t delay : {0, 1, 517, 4800, 9000}) {
+        SCOPED_TRACE(delay);
+        const std::vector<float> recording = makeRecording(mls, delay, 16384, 0.8f, 0.0f);
+        const LatencyResult result = analyze(mls, recording);
+        ASSERT_TRUE(result.isValid);
+        EXPECT_EQ(delay, result.latencyFrames);
+        EXPECT_DOUBLE_EQ(delay * 1000.0 / kSampleRate, result.latencyMillis);
+        EXPECT_NEAR(1.0, result.confidence, 1e-6);
+    }
+}
+
+TEST(LatencyAnalyzerTest, MlsDelayIsFoundInNoise) {
+
+    // The signal sits 20dB below the noise, the correlation gain of a 4095 sample MLS still
+    // picks it out.
+    const std::vector<float> mls = generateMls(kMlsOrder, kMlsAmplitude);
+    const std::vector<float> recording = makeRecording(mls, 2345, 16384, 0.1f, 0.5f);
+    const LatencyResult result = analyze(mls, recording);
+    ASSERT_TRUE(result.isValid);
+    EXPECT_EQ(2345, result.latencyFrames);
+    EXPECT_GT(result.confidence, 0.05);
+}
+
+TEST(LatencyAnalyzerTest, InvertedRecordingIsFound) {
+
+    const std::vector<float> mls = generateMls(kMlsOrder, kMlsAmplitude);
+    const std::vector<float> recording = makeRecording(mls, 1000, 8192, -0.5f, 0.0f);
+    const LatencyResult result = analyze(mls, recording);
+    EXPECT_EQ(1000, result.latencyFrames);
+    EXPECT_NEAR(1.0, result.confidence, 1e-6);
+}
+
+TEST(LatencyAnalyzerTest, ImpulseDelayIsRecovered) {
+
+    const std::vector<float> impulse = generateImpulse(256, 1.0f);
+    const std::vector<float> recording = makeRecording(impulse, 777, 4096, 0.3f, 0.0f);
+    const LatencyResult result = analyze(impulse, recording);
+    ASSERT_TRUE(result.isValid);
+    EXPECT_EQ(777, result.latencyFrames);
+}
+
+TEST(LatencyAnalyzerTest, MissingSignalHasLowConfidence) {
+
+    const std::vector<float> mls = generateMls(kMlsOrder, kMlsAmplitude);
+    const std::vector<float> recording = makeRecording(mls, 0, 16384, 0.0f, 0.5f);
+    const LatencyResult result = analyze(mls, recording);
+    EXPECT_LT(result.confidence, 0.1);
+}
+
+TEST(LatencyAnalyzerTest, RecordingShorterThanSignalIsInvalid) {
+
+    const std::vector<float> mls = generateMls(kMlsOrder, kMlsAmplitude);
+    const std::vector<float> recording(mls.size() - 1, 0.5f);
+    EXPECT_FALSE(analyze(mls, recording).isValid);
+    EXPECT_FALSE(analyze(mls, std::vector<float>(mls.size(), 0.0f)).isValid);
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include "LatencyTuner.h"
+
+namespace {
+
+constexpr int32_t kFramesPerBurst = 192;
+constexpr int32_t kCapacityInBursts = 8;
+
+// An output stream whose xruns the test reports by hand.
+class XRunStream : public AudioStream {
+
+public:
+    bool requestStart() override { return true; }
+    bool requestStop() override { return true; }
+    SampleFormat getFormat() const override { return SampleFormat::Float; }
+    int32_t getChannelCount() const override { return 2; }
+    int32_t getSampleRate() const override { return 48000; }
+    int32_t getDeviceId() const override { return kUnspecified; }
+    int32_t getFramesPerBurst() const override { return kFramesPerBurst; }
+    int32_t getBufferSizeInFrames() const override { return mBufferSize; }
+    int32_t setBufferSizeInFrames(int32_t numFrames) override {
+        mBufferSize = std::max(1, std::min(numFrames, getBufferCapacityInFrames()));
+        return mBufferSize;
+    }
+    int32_t getBufferCapacityInFrames() const override {
+        return kCapacityInBursts * kFramesPerBurst;
+    }
+    int32_t getXRunCount() const override { return mXRunCount; }
+    int32_t read(void *, int32_t, int64_t) override { return -1; }
+    int32_t getFramesAvailable() const override { return 0; }
+
+    void addXRuns(int32_t count) { mXRunCount += count; }
+
+private:
+    int32_t mBufferSize = 4 * kFramesPerBurst;
+    int32_t mXRunCount = 0;
+};
+
+class LatencyTunerTest : public ::testing::Test {
+
+protected:
+    XRunStream mStream;
+    LatencyTuner mTuner;
+
+    void start(const LatencyTunerPolicy &policy) {
+        mTuner.setPolicy(policy);
+        mTuner.reset(mStream);
+    }
+
+    // Run callbacks, the first of which sees xRuns new xruns.
+    void callbacks(int32_t count, int32_t xRuns = 0) {
+        mStream.addXRuns(xRuns);
+        for (int32_t i = 0; i < count; ++i) mTuner.tune(mStream);
+    }
+
+    int32_t getBursts() const {
+        EXPECT_EQ(mStream.getBufferSizeInFrames(), mTuner.getState().bufferSizeInFrames);
+        return mStream.getBufferSizeInFrames() / kFramesPerBurst;
+    }
+};
+
+LatencyTunerPolicy makePolicy(int32_t holdCallbacks, int32_t shrinkAfterCallbacks) {
+    LatencyTunerPolicy policy;
+    policy.holdCallbacks = holdCallbacks;
+    policy.shrinkAfterCallbacks = shrinkAfterCallbacks;
+    return policy;
+}
+
+} // namespace
+
+TEST_F(LatencyTunerTest, StartsAtOneBurst) {
+    start(makePolicy(4, 0));
+    EXPECT_EQ(1, getBursts());
+    EXPECT_EQ(kFramesPerBurst, mTuner.getState().framesPerBurst);
+    EXPECT_EQ(kCapacityInBursts * kFramesPerBurst, mTuner.getState().capacityInFrames);
+}
+
+TEST_F(LatencyTunerTest, GrowsOnXRunAndHoldsWhileItSettles) {
+
+    start(makePolicy(4, 0));
+    // Xruns during the hold after reset are put down to the stream starting up.
+    callbacks(4, 3);
+    EXPECT_EQ(1, getBursts());
+
+    callbacks(1, 1);
+    EXPECT_EQ(2, getBursts());
+
+    // The rest of the same glitch lands in the hold and doesn't grow the buffer again.
+    callbacks(1, 2);
+    callbacks(3);
+    EXPECT_EQ(2, getBursts());
+
+    callbacks(1, 1);
+    EXPECT_EQ(3, getBursts());
+    EXPECT_EQ(2, mTuner.getState().growCount);
+    EXPECT_EQ(7, mTuner.getState().xRunCount);
+}
+
+TEST_F(LatencyTunerTest, GrowsOnlyOnceThresholdIsReached) {
+
+    LatencyTunerPolicy policy = makePolicy(0, 0);
+    policy.xRunThreshold = 3;
+    start(policy);
+    callbacks(1, 1);
+    callbacks(1, 1);
+    EXPECT_EQ(1, getBursts());
+    callbacks(1, 1);
+    EXPECT_EQ(2, getBursts());
+}
+
+TEST_F(LatencyTunerTest, StopsAtMaxBursts) {
+
+    LatencyTunerPolicy policy = makePolicy(0, 0);
+    policy.maxBursts = 3;
+    start(policy);
+    for (int32_t i = 0; i < 10; ++i) callbacks(1, 1);
+    EXPECT_EQ(3, getBursts());
+    EXPECT_EQ(2, mTuner.getState().growCount);
+}
+
+TEST_F(LatencyTunerTest, NeverShrinksWithoutShrinkPolicy) {
+
+    start(makePolicy(0, 0));
+    callbacks(1, 1);
+    callbacks(100000);
+    EXPECT_EQ(2, getBursts());
+    EXPECT_EQ(0, mTuner.getState().shrinkCount);
+}
+
+TEST_F(LatencyTunerTest, ShrinksAfterQuietSpellAndSettles) {
+
+    start(makePolicy(2, 10));
+
+    // A spike grows the buffer to three bursts.
+    callbacks(2);
+    callbacks(1, 1);
+    callbacks(2);
+    callbacks(1, 1);
+    ASSERT_EQ(3, getBursts());
+
+    // After the hold it takes 10 glitch-free callbacks to shrink by a burst.
+    callbacks(2 + 9);
+    EXPECT_EQ(3, getBursts());
+    callbacks(1);
+    EXPECT_EQ(2, getBursts());
+    callbacks(2 + 10);
+    EXPECT_EQ(1, getBursts());
+    EXPECT_EQ(2, mTuner.getState().shrinkCount);
+
+    // One burst glitches again, so the tuner grows and stays at two from then on.
+    callbacks(2);
+    callbacks(1, 1);
+    EXPECT_EQ(2, getBursts());
+    callbacks(1000);
+    EXPECT_EQ(2, getBursts());
+    EXPECT_EQ(2, mTuner.getState().shrinkCount);
+    EXPECT_EQ(3, mTuner.getState().growCount);
+}
+
+TEST_F(LatencyTunerTest, XRunBelowThresholdRestartsQuietSpell) {
+
+    LatencyTunerPolicy policy = makePolicy(0, 10);
+    policy.xRunThreshold = 2;
+    start(policy);
+    callbacks(1, 2);
+    callbacks(1, 2);
+    ASSERT_EQ(3, getBursts());
+
+    // A lone xrun doesn't grow the buffer but the 10 glitch-free callbacks start again after it.
+    callbacks(9);
+    callbacks(10, 1);
+    EXPECT_EQ(3, getBursts());
+    callbacks(1);
+    EXPECT_EQ(2, getBursts());
+}
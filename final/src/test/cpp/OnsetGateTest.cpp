@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "OnsetGate.h"
+
+namespace {
+
+constexpr float kThreshold = 0.1f;
+constexpr float kNoiseLevel = 0.001f;
+
+// Quiet noise with a loud burst from onsetFrame on. Every burst sample is above the threshold.
+std::vector<float> makeInput(int32_t numFrames, int32_t onsetFrame) {
+    std::minstd_rand random(42);
+    std::uniform_real_distribution<float> noise(-kNoiseLevel, kNoiseLevel);
+    std::vector<float> input(numFrames);
+    for (int32_t i = 0; i < numFrames; ++i) {
+        input[i] = (i < onsetFrame) ? noise(random) : ((i % 2 == 0) ? 0.5f : -0.5f);
+    }
+    return input;
+}
+
+// Run input through the gate in blocks, as the recording callback would, collecting what's
+// committed.
+std::vector<float> runGate(OnsetGate &gate, const std::vector<float> &input,
+                           int32_t blockFrames) {
+    std::vector<float> committed;
+    const auto numFrames = static_cast<int32_t>(input.size());
+    for (int32_t start = 0; start < numFrames; start += blockFrames) {
+        const int32_t length = std::min(blockFrames, numFrames - start);
+        gate.process(&input[start], length, [&](const float *frames, int32_t count) {
+            committed.insert(committed.end(), frames, frames + count);
+        });
+    }
+    return committed;
+}
+
+std::vector<float> getFramesFrom(const std::vector<float> &input, int32_t start) {
+    return std::vector<float>(input.begin() + start, input.end());
+}
+
+} // namespace
+
+TEST(OnsetGateTest, OnsetCommitsPreRollThenEverythingAfter) {
+
+    constexpr int32_t kPreRollFrames = 480;
+
+    // Hops are counted from arming, so neither the block size nor where the onset falls in its
+    // hop should make any difference, even when the hop is split over several blocks.
+    for (int32_t onsetFrame : {50 * kOnsetHopFrames, 50 * kOnsetHopFrames + 10}) {
+        const std::vector<float> input = makeInput(onsetFrame + 5000, onsetFrame);
+        for (int32_t blockFrames : {1, 37, 64, 192, 1000, 10000}) {
+            SCOPED_TRACE(testing::Message() << onsetFrame << " " << blockFrames);
+            OnsetGate gate;
+            gate.configure(true, kThreshold, kPreRollFrames);
+            gate.arm();
+            EXPECT_TRUE(gate.isWaitingForOnset());
+            EXPECT_EQ(getFramesFrom(input, onsetFrame - kPreRollFrames),
+                      runGate(gate, input, blockFrames));
+            EXPECT_FALSE(gate.isWaitingForOnset());
+        }
+    }
+}
+
+TEST(OnsetGateTest, PreRollIsLimitedToInputSinceArming) {
+
+    constexpr int32_t kOnsetFrame = 2 * kOnsetHopFrames;
+    const std::vector<float> input = makeInput(4000, kOnsetFrame);
+    OnsetGate gate;
+    gate.configure(true, kThreshold, 1000);
+    gate.arm();
+    EXPECT_EQ(input, runGate(gate, input, 192));
+}
+
+TEST(OnsetGateTest, OnsetWithoutPreRollStartsOnFirstLoudSample) {
+
+    // The burst starts part way through a hop, and the hop is still loud enough.
+    constexpr int32_t kOnsetFrame = 20 * kOnsetHopFrames + 10;
+    const std::vector<float> input = makeInput(kOnsetFrame + 1000, kOnsetFrame);
+    OnsetGate gate;
+    gate.configure(true, kThreshold, 0);
+    gate.arm();
+    EXPECT_EQ(getFramesFrom(input, kOnsetFrame), runGate(gate, input, 192));
+}
+
+TEST(OnsetGateTest, QuietInputIsNeverCommitted) {
+
+    const std::vector<float> input = makeInput(48000, 48000);
+    OnsetGate gate;
+    gate.configure(true, kThreshold, 480);
+    gate.arm();
+    EXPECT_TRUE(runGate(gate, input, 192).empty());
+    EXPECT_TRUE(gate.isWaitingForOnset());
+}
+
+TEST(OnsetGateTest, OnsetMustRiseAboveBackground) {
+
+    // A background just under the threshold, then a step which crosses the threshold without
+    // rising far enough above it, and only then a real onset.
+    constexpr int32_t kStepFrames = 32 * kOnsetHopFrames;
+    std::vector<float> input;
+    for (float level : {0.08f, 0.12f, 0.3f}) {
+        for (int32_t i = 0; i < kStepFrames; ++i) input.push_back((i % 2 == 0) ? level : -level);
+    }
+    OnsetGate gate;
+    gate.configure(true, kThreshold, 0);
+    gate.arm();
+    EXPECT_EQ(getFramesFrom(input, 2 * kStepFrames), runGate(gate, input, 192));
+}
+
+TEST(OnsetGateTest, DisabledGatePassesEverythingThrough) {
+
+    const std::vector<float> input = makeInput(5000, 4000);
+    OnsetGate gate;
+    gate.configure(false, kThreshold, 480);
+    gate.arm();
+    EXPECT_FALSE(gate.isWaitingForOnset());
+    EXPECT_EQ(input, runGate(gate, input, 192));
+}
+
+TEST(OnsetGateTest, GateStaysOpenUntilArmedAgain) {
+
+    const std::vector<float> input = makeInput(5000, 640);
+    OnsetGate gate;
+    gate.configure(true, kThreshold, 0);
+    gate.arm();
+    runGate(gate, input, 192);
+
+    // Quiet input after the onset is still recorded.
+    const std::vector<float> quiet = makeInput(1000, 1000);
+    EXPECT_EQ(quiet, runGate(gate, quiet, 192));
+    gate.arm();
+    EXPECT_TRUE(runGate(gate, quiet, 192).empty());
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "PeakPyramid.h"
+#include "SampleBlockPool.h"
+
+namespace {
+
+// Three of the coarsest bins but one plus a partial finest bin, so that every level is used and
+// some are left incomplete.
+constexpr int32_t kCoarsestBinSamples = kPeakBinSamples * 4 * 4 * 4 * 4;
+constexpr int32_t kTestSamples = 3 * kCoarsestBinSamples - kPeakBinSamples + 100;
+
+class PeakPyramidTest : public ::testing::Test {
+
+protected:
+    SampleBlockPool mBlockPool;
+    PeakPyramid mPyramid { mBlockPool };
+    std::vector<float> mSamples;
+
+    void SetUp() override {
+        ASSERT_TRUE(mBlockPool.reserve(PeakPyramid::getBlocksNeeded(kTestSamples)));
+        // A swelling sine with noise, so that no two bins are alike.
+        std::minstd_rand random(7);
+        std::uniform_real_distribution<float> noise(-0.1f, 0.1f);
+        mSamples.resize(kTestSamples);
+        for (int32_t i = 0; i < kTestSamples; ++i) {
+            mSamples[i] = 0.8f * i / kTestSamples * sinf(i * 0.001f) + noise(random);
+        }
+        // Appended in blocks which don't line up with the bins, as the recording callback would.
+        for (int32_t start = 0; start < kTestSamples; start += 1000) {
+            mPyramid.append(&mSamples[start], std::min(1000, kTestSamples - start));
+        }
+    }
+
+    // The bin for samples [first, last), straight from the samples.
+    PeakBin measure(int32_t first, int32_t last) const {
+        PeakBin bin { mSamples[first], mSamples[first], 0 };
+        double sumOfSquares = 0;
+        for (int32_t i = first; i < last; ++i) {
+            bin.min = std::min(bin.min, mSamples[i]);
+            bin.max = std::max(bin.max, mSamples[i]);
+            sumOfSquares += static_cast<double>(mSamples[i]) * mSamples[i];
+        }
+        bin.rms = static_cast<float>(sqrt(sumOfSquares / (last - first)));
+        return bin;
+    }
+
+    // Bin edges are rounded to the nearest finest bin.
+    static int32_t roundToBin(int64_t sample) {
+        return static_cast<int32_t>((sample + kPeakBinSamples / 2) / kPeakBinSamples) *
+               kPeakBinSamples;
+    }
+
+    void expectPeaks(int32_t startSample, int32_t endSample, int32_t numBins) {
+        std::vector<PeakBin> bins(numBins);
+        const int32_t binsWritten = mPyramid.getPeaks(startSample, endSample, numBins,
+                                                      bins.data());
+        const int32_t summarised = mPyramid.getSummarisedLength();
+        const int64_t span = endSample - startSample;
+        int32_t expectedBins = 0;
+        for (int32_t i = 0; i < numBins; ++i) {
+            const int32_t first = roundToBin(startSample + span * i / numBins);
+            const int32_t last = std::min(summarised,
+                                          roundToBin(startSample + span * (i + 1) / numBins));
+            if (last <= first) break;
+            expectedBins++;
+            ASSERT_LT(i, binsWritten);
+            SCOPED_TRACE(i);
+            const PeakBin expected = measure(first, last);
+            EXPECT_EQ(expected.min, bins[i].min);
+            EXPECT_EQ(expected.max, bins[i].max);
+            EXPECT_NEAR(expected.rms, bins[i].rms, expected.rms * 1e-4f);
+        }
+        EXPECT_EQ(expectedBins, binsWritten);
+    }
+};
+
+} // namespace
+
+TEST_F(PeakPyramidTest, OnlyCompleteBinsAreSummarised) {
+    EXPECT_EQ(kTestSamples / kPeakBinSamples * kPeakBinSamples, mPyramid.getSummarisedLength());
+}
+
+TEST_F(PeakPyramidTest, FinestBinsMatchSamples) {
+    expectPeaks(0, 64 * kPeakBinSamples, 64);
+}
+
+TEST_F(PeakPyramidTest, CoarseBinsMatchSamples) {
+
+    // One bin over everything is made of the coarsest level's bins and whatever's left over.
+    expectPeaks(0, kTestSamples, 1);
+    expectPeaks(0, kTestSamples, 7);
+    expectPeaks(0, 2 * kCoarsestBinSamples, 2);
+}
+
+TEST_F(PeakPyramidTest, UnalignedRangesMatchSamples) {
+    expectPeaks(1000, kTestSamples - 5000, 13);
+    expectPeaks(kPeakBinSamples * 3 + 17, kPeakBinSamples * 900 + 200, 100);
+}
+
+TEST_F(PeakPyramidTest, RangePastEndStopsAtSummarisedSamples) {
+
+    std::vector<PeakBin> bins(10);
+    EXPECT_EQ(0, mPyramid.getPeaks(kTestSamples, 2 * kTestSamples, 10, bins.data()));
+    expectPeaks(kTestSamples - 10 * kPeakBinSamples, kTestSamples + 10 * kPeakBinSamples, 10);
+}
+
+TEST_F(PeakPyramidTest, ClearedPyramidSummarisesNothing) {
+
+    mPyramid.clear();
+    PeakBin bin;
+    EXPECT_EQ(0, mPyramid.getPeaks(0, kTestSamples, 1, &bin));
+    mPyramid.append(mSamples.data(), kPeakBinSamples);
+    ASSERT_EQ(1, mPyramid.getPeaks(0, kPeakBinSamples, 1, &bin));
+    EXPECT_EQ(measure(0, kPeakBinSamples).max, bin.max);
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Resampler.h"
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+std::vector<float> makeSine(int32_t numFrames, int32_t sampleRate, double frequency,
+                            float amplitude) {
+    std::vector<float> sine(numFrames);
+    for (int32_t i = 0; i < numFrames; ++i) {
+        sine[i] = amplitude * static_cast<float>(sin(2 * kPi * frequency * i / sampleRate));
+    }
+    return sine;
+}
+
+std::vector<float> resample(Resampler &resampler, const std::vector<float> &input,
+                            int32_t blockFrames) {
+    std::vector<float> output;
+    std::vector<float> block(resampler.getMaxOutputFrames(blockFrames));
+    for (size_t start = 0; start < input.size(); start += blockFrames) {
+        const int32_t numFrames = std::min(blockFrames,
+                                           static_cast<int32_t>(input.size() - start));
+        const int32_t written = resampler.process(&input[start], numFrames, block.data());
+        output.insert(output.end(), block.begin(), block.begin() + written);
+    }
+    return output;
+}
+
+/**
+ * The ratio in dB of a sine at frequency to everything else in signal, fitting the sine's
+ * amplitude and phase by least squares.
+ */
+double getSineToResidualDb(const float *signal, int32_t numFrames, int32_t sampleRate,
+                           double frequency, double *amplitude) {
+    double sinSum = 0;
+    double cosSum = 0;
+    for (int32_t i = 0; i < numFrames; ++i) {
+        const double angle = 2 * kPi * frequency * i / sampleRate;
+        sinSum += signal[i] * sin(angle);
+        cosSum += signal[i] * cos(angle);
+    }
+    const double sinAmplitude = 2 * sinSum / numFrames;
+    const double cosAmplitude = 2 * cosSum / numFrames;
+    *amplitude = hypot(sinAmplitude, cosAmplitude);
+
+    double sineEnergy = 0;
+    double residualEnergy = 0;
+    for (int32_t i = 0; i < numFrames; ++i) {
+        const double angle = 2 * kPi * frequency * i / sampleRate;
+        const double fitted = sinAmplitude * sin(angle) + cosAmplitude * cos(angle);
+        sineEnergy += fitted * fitted;
+        residualEnergy += (signal[i] - fitted) * (signal[i] - fitted);
+    }
+    return 10 * log10(sineEnergy / residualEnergy);
+}
+
+double getRms(const float *signal, int32_t numFrames) {
+    double energy = 0;
+    for (int32_t i = 0; i < numFrames; ++i) energy += signal[i] * signal[i];
+    return sqrt(energy / numFrames);
+}
+
+} // namespace
+
+TEST(ResamplerTest, OutputLengthFollowsRateRatio) {
+
+    Resampler resampler(44100, 48000);
+    const std::vector<float> output = resample(resampler, std::vector<float>(44100, 0.0f), 192);
+    // Output lags by half the filter, which is all that's missing from a second of output.
+    EXPECT_LE(output.size(), 48000u);
+    EXPECT_GE(output.size(), 48000u - resampler.getTapsPerPhase());
+}
+
+TEST(ResamplerTest, BlockSizeDoesNotChangeOutput) {
+
+    const std::vector<float> input = makeSine(10000, 44100, 1234.5, 0.5f);
+    Resampler whole(44100, 48000);
+    const std::vector<float> expected = resample(whole, input, 10000);
+    for (int32_t blockFrames : {1, 7, 192, 1000}) {
+        SCOPED_TRACE(blockFrames);
+        Resampler blocked(44100, 48000);
+        EXPECT_EQ(expected, resample(blocked, input, blockFrames));
+    }
+}
+
+TEST(ResamplerTest, SineSurvivesConversion) {
+
+    // The minimum sine to residual ratio for each quality, which covers passband ripple,
+    // aliasing and rounding. Float arithmetic holds Medium and High to around 80dB.
+    const struct {
+        ResamplerQuality quality;
+        double minimumDb;
+    } kCases[] = {
+            { ResamplerQuality::Low, 65 },
+            { ResamplerQuality::Medium, 70 },
+            { ResamplerQuality::High, 70 },
+    };
+    const int32_t kRatePairs[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 } };
+
+    for (const auto &testCase : kCases) {
+        for (const auto &rates : kRatePairs) {
+            SCOPED_TRACE(testing::Message() << rates[0] << " -> " << rates[1] << " quality "
+                                            << static_cast<int>(testCase.quality));
+            Resampler resampler(rates[0], rates[1], testCase.quality);
+            const std::vector<float> input = makeSine(rates[0], rates[0], 1000, 0.5f);
+            const std::vector<float> output = resample(resampler, input, 192);
+
+            // Skip the filter's start up, which is fed silence before the sine.
+            const int32_t skip = resampler.getTapsPerPhase();
+            const int32_t numFrames = static_cast<int32_t>(output.size()) - skip;
+            double amplitude = 0;
+            const double ratioDb = getSineToResidualDb(&output[skip], numFrames, rates[1], 1000,
+                                                       &amplitude);
+            EXPECT_NEAR(0.5, amplitude, 0.005);
+            EXPECT_GT(ratioDb, testCase.minimumDb);
+        }
+    }
+}
+
+TEST(ResamplerTest, ToneAboveOutputNyquistIsRemoved) {
+
+    // 30kHz can't be represented at 48kHz and would alias to 18kHz if it weren't filtered out.
+    // It falls in the transition band of the short Low filter, so that only takes the edge off.
+    const struct {
+        ResamplerQuality quality;
+        double maximumDb;
+    } kCases[] = {
+            { ResamplerQuality::Low, -30 },
+            { ResamplerQuality::Medium, -80 },
+            { ResamplerQuality::High, -100 },
+    };
+    for (const auto &testCase : kCases) {
+        SCOPED_TRACE(static_cast<int>(testCase.quality));
+        Resampler resampler(96000, 48000, testCase.quality);
+        const std::vector<float> output = resample(resampler, makeSine(96000, 96000, 30000, 0.5f),
+                                                   192);
+        const int32_t skip = resampler.getTapsPerPhase();
+        const double rms = getRms(&output[skip], static_cast<int32_t>(output.size()) - skip);
+        EXPECT_LT(20 * log10(rms / (0.5 / sqrt(2.0))), testCase.maximumDb);
+    }
+}
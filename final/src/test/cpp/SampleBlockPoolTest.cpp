@@ -0,0 +1,72 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "SampleBlockPool.h"
+
+namespace {
+
+// Long enough for the refill thread to have had several goes.
+void waitForRefills() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+} // namespace
+
+TEST(SampleBlockPoolTest, ReservedBlocksAreReadyWhenReserveReturns) {
+
+    SampleBlockPool pool;
+    pool.reserve(20);
+    EXPECT_EQ(20, pool.getReadyBlockCount());
+}
+
+TEST(SampleBlockPoolTest, RefillStopsAtWhatsLeftOfReservation) {
+
+    SampleBlockPool pool;
+    pool.reserve(20);
+    pool.startRefilling();
+    std::vector<uint8_t *> blocks;
+    for (int32_t i = 0; i < 5; ++i) blocks.push_back(pool.claimBlock());
+    waitForRefills();
+    EXPECT_EQ(15, pool.getReadyBlockCount());
+
+    // Once the reservation has been used up the low watermark still applies.
+    for (int32_t i = 0; i < 15; ++i) blocks.push_back(pool.claimBlock());
+    waitForRefills();
+    EXPECT_EQ(static_cast<int32_t>(kBlockPoolLowWatermark), pool.getReadyBlockCount());
+
+    // A new reservation starts the count again.
+    pool.reserve(20);
+    EXPECT_EQ(20, pool.getReadyBlockCount());
+    pool.stopRefilling();
+
+    for (uint8_t *block : blocks) SampleBlockPool::releaseBlock(block);
+}
+
+TEST(SampleBlockPoolTest, LowWatermarkIsKeptWithoutReservation) {
+
+    SampleBlockPool pool;
+    pool.startRefilling();
+    EXPECT_EQ(static_cast<int32_t>(kBlockPoolLowWatermark), pool.getReadyBlockCount());
+    uint8_t *block = pool.claimBlock();
+    waitForRefills();
+    EXPECT_EQ(static_cast<int32_t>(kBlockPoolLowWatermark), pool.getReadyBlockCount());
+    pool.stopRefilling();
+    SampleBlockPool::releaseBlock(block);
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include "SampleBlockPool.h"
+#include "SoundRecording.h"
+
+namespace {
+
+constexpr int32_t kTestSamples = 1000;
+
+class SoundRecordingTest : public ::testing::Test {
+
+protected:
+    SampleBlockPool mBlockPool;
+    std::unique_ptr<SoundRecording> mRecording;
+
+    void SetUp() override {
+        mBlockPool.reserve(4);
+        mRecording = createSoundRecording(StorageFormat::Float, mBlockPool);
+        // Each sample holds its own index.
+        std::vector<float> samples(kTestSamples);
+        for (int32_t i = 0; i < kTestSamples; ++i) samples[i] = static_cast<float>(i);
+        ASSERT_EQ(kTestSamples, mRecording->write(samples.data(), kTestSamples));
+    }
+
+    void TearDown() override {
+        mRecording.reset();
+    }
+
+    // Every sample holds its index, so a bin's min, max and RMS follow from its range.
+    static void expectBin(int32_t first, int32_t last, const PeakBin &bin) {
+        double sumOfSquares = 0;
+        for (int32_t i = first; i < last; ++i) sumOfSquares += static_cast<double>(i) * i;
+        EXPECT_EQ(static_cast<float>(first), bin.min);
+        EXPECT_EQ(static_cast<float>(last - 1), bin.max);
+        // The summary sums in float, so the RMS is only close.
+        const auto rms = static_cast<float>(sqrt(sumOfSquares / (last - first)));
+        EXPECT_NEAR(rms, bin.rms, rms * 1e-5f);
+    }
+
+    float readOne() {
+        float sample = -1;
+        EXPECT_EQ(1, mRecording->read(&sample, 1));
+        return sample;
+    }
+};
+
+} // namespace
+
+TEST_F(SoundRecordingTest, ShorteningLoopPastReadPositionWraps) {
+
+    mRecording->setLooping(true);
+    std::vector<float> buffer(800);
+    mRecording->read(buffer.data(), 800);
+    mRecording->setLoopLength(500);
+    EXPECT_EQ(300, mRecording->getReadPosition());
+    EXPECT_EQ(300, readOne());
+    EXPECT_EQ(199, mRecording->getSamplesUntilEnd());
+}
+
+TEST_F(SoundRecordingTest, ReadWrapsPositionLeftPastShortenedLoop) {
+
+    // The loop is shortened while not looping, so the position is left past it.
+    std::vector<float> buffer(800);
+    mRecording->read(buffer.data(), 800);
+    mRecording->setLoopLength(500);
+    EXPECT_EQ(0, mRecording->read(buffer.data(), 1));
+    EXPECT_EQ(0, mRecording->skip(1));
+
+    mRecording->setLooping(true);
+    EXPECT_EQ(300, readOne());
+    mRecording->setLoopLength(0);
+    mRecording->read(buffer.data(), 600);
+    mRecording->setLoopLength(200);
+    EXPECT_EQ(101, mRecording->getReadPosition());
+    EXPECT_EQ(100, mRecording->skip(100));
+    EXPECT_EQ(1, readOne());
+}
+
+TEST_F(SoundRecordingTest, ReadPositionWrapsBothWays) {
+    mRecording->setReadPosition(1250);
+    EXPECT_EQ(250, mRecording->getReadPosition());
+    mRecording->setReadPosition(-250);
+    EXPECT_EQ(750, mRecording->getReadPosition());
+}
+
+TEST_F(SoundRecordingTest, ZoomedInPeaksAreReadFromSamples) {
+
+    // Fewer than kPeakBinSamples per bin, including bins of a single sample.
+    PeakBin bins[20];
+    ASSERT_EQ(10, mRecording->getPeaks(100, 200, 10, bins));
+    for (int32_t i = 0; i < 10; ++i) expectBin(100 + 10 * i, 110 + 10 * i, bins[i]);
+    ASSERT_EQ(20, mRecording->getPeaks(500, 520, 20, bins));
+    for (int32_t i = 0; i < 20; ++i) expectBin(500 + i, 501 + i, bins[i]);
+
+    // The last bins run past what's been recorded.
+    EXPECT_EQ(10, mRecording->getPeaks(900, 1100, 20, bins));
+    expectBin(990, 1000, bins[9]);
+}
+
+TEST_F(SoundRecordingTest, ZoomedOutPeaksComeFromSummary) {
+
+    // Only complete summary bins count, and edges are rounded to them.
+    PeakBin bins[2];
+    ASSERT_EQ(2, mRecording->getPeaks(0, kTestSamples, 2, bins));
+    expectBin(0, 2 * kPeakBinSamples, bins[0]);
+    expectBin(2 * kPeakBinSamples, 3 * kPeakBinSamples, bins[1]);
+}
+
+TEST_F(SoundRecordingTest, InvalidPeakRangesReturnNothing) {
+    PeakBin bin;
+    EXPECT_EQ(0, mRecording->getPeaks(-1, 100, 1, &bin));
+    EXPECT_EQ(0, mRecording->getPeaks(100, 100, 1, &bin));
+    EXPECT_EQ(0, mRecording->getPeaks(0, 100, 0, &bin));
+}
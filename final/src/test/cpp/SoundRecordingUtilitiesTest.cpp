@@ -0,0 +1,227 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "SoundRecordingUtilities.h"
+
+namespace {
+
+const char *const kSimdImplementations[] = { "neon", "sse2", "avx2" };
+
+// Lengths which leave every possible remainder after the vector loops, plus a long run.
+std::vector<int32_t> getTestLengths() {
+    std::vector<int32_t> lengths;
+    for (int32_t length = 0; length <= 40; ++length) lengths.push_back(length);
+    lengths.push_back(1021);
+    return lengths;
+}
+
+// Random samples mostly in range, with every awkward value mixed in.
+std::vector<float> makeSamples(int32_t length) {
+
+    const float kEdges[] = {
+            std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN(),
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+            1.0f, -1.0f, 0.0f, -0.0f, std::nextafter(1.0f, 2.0f), std::nextafter(-1.0f, -2.0f),
+            std::nextafter(1.0f, 0.0f), std::nextafter(-1.0f, 0.0f),
+            std::numeric_limits<float>::denorm_min(), -std::numeric_limits<float>::denorm_min(),
+            // Halfway between two int16 values, to check rounding.
+            0.5f / 32767, -0.5f / 32768, 1.5f / 32767, -2.5f / 32768,
+            std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()
+    };
+    constexpr int32_t kEdgeCount = sizeof(kEdges) / sizeof(kEdges[0]);
+
+    std::mt19937 random(static_cast<uint32_t>(length));
+    std::uniform_real_distribution<float> distribution(-1.25f, 1.25f);
+    std::vector<float> samples(length);
+    for (int32_t i = 0; i < length; ++i) {
+        samples[i] = (i % 3 == 0) ? kEdges[(i / 3) % kEdgeCount] : distribution(random);
+    }
+    return samples;
+}
+
+template <typename T>
+void expectSameBits(const std::vector<T> &expected, const std::vector<T> &actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(0, memcmp(&expected[i], &actual[i], sizeof(T))) << "at index " << i;
+    }
+}
+
+/**
+ * Runs kernel, which returns its output as a vector, with the scalar implementation and then
+ * with each SIMD one this machine supports, and checks that they match bit for bit.
+ */
+template <typename Kernel>
+void expectMatchesScalar(Kernel &&kernel) {
+
+    const std::string original = getSimdImplementationName();
+    for (int32_t length : getTestLengths()) {
+        ASSERT_TRUE(setSimdImplementation("scalar"));
+        const auto expected = kernel(length);
+        for (const char *name : kSimdImplementations) {
+            if (!setSimdImplementation(name)) continue;
+            SCOPED_TRACE(std::string(name) + ", length " + std::to_string(length));
+            expectSameBits(expected, kernel(length));
+        }
+    }
+    setSimdImplementation(original.c_str());
+}
+
+} // namespace
+
+TEST(SoundRecordingUtilitiesTest, ClampsEdgeValuesToInt16) {
+    EXPECT_EQ(32767, convertFloatToInt16(1.0f));
+    EXPECT_EQ(-32768, convertFloatToInt16(-1.0f));
+    EXPECT_EQ(32767, convertFloatToInt16(std::numeric_limits<float>::infinity()));
+    EXPECT_EQ(-32768, convertFloatToInt16(-std::numeric_limits<float>::infinity()));
+    EXPECT_EQ(32767, convertFloatToInt16(std::numeric_limits<float>::quiet_NaN()));
+    EXPECT_EQ(0, convertFloatToInt16(-0.0f));
+}
+
+TEST(SoundRecordingUtilitiesTest, Int16ToFloatMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        std::vector<int16_t> source(length);
+        for (int32_t i = 0; i < length; ++i) {
+            // Cover the whole range, including both extremes, in the long run.
+            source[i] = static_cast<int16_t>(INT16_MIN + ((i * 65535) / std::max(1, length - 1)));
+        }
+        std::vector<float> target(length);
+        convertArrayInt16ToFloat(source.data(), target.data(), length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, FloatToInt16MatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> source = makeSamples(length);
+        std::vector<int16_t> target(length);
+        convertArrayFloatToInt16(source.data(), target.data(), length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, Packed24ToFloatMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        std::mt19937 random(static_cast<uint32_t>(length));
+        std::vector<uint8_t> source(length * 3);
+        for (uint8_t &byte : source) byte = static_cast<uint8_t>(random());
+        // Both extremes.
+        if (length >= 2) {
+            const uint8_t extremes[] = { 0x00, 0x00, 0x80, 0xff, 0xff, 0x7f };
+            memcpy(source.data(), extremes, sizeof(extremes));
+        }
+        std::vector<float> target(length);
+        convertArrayPacked24ToFloat(source.data(), target.data(), length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, FloatToPacked24MatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> source = makeSamples(length);
+        std::vector<uint8_t> target(length * 3);
+        convertArrayFloatToPacked24(source.data(), target.data(), length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, FillWithZerosMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        std::vector<float> data = makeSamples(length);
+        fillArrayWithZeros(data.data(), length);
+        return data;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, MonoToStereoMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        std::vector<float> data = makeSamples(length);
+        data.resize(length * 2);
+        convertArrayMonoToStereo(data.data(), length);
+        return data;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, InterleaveMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> left = makeSamples(length);
+        const std::vector<float> right = makeSamples(length + 1);
+        std::vector<float> target(length * 2);
+        interleaveStereo(left.data(), right.data(), target.data(), length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, DeinterleaveMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> source = makeSamples(length * 2);
+        std::vector<float> target(length * 2);
+        deinterleaveStereo(source.data(), target.data(), &target[length], length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, MixWithGainMatchesScalar) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> source = makeSamples(length);
+        std::vector<float> target = makeSamples(length + 1);
+        target.resize(length);
+        mixArrayWithGain(source.data(), target.data(), 0.7f, length);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, CopyWithLevelsCopiesExactly) {
+    expectMatchesScalar([](int32_t length) {
+        const std::vector<float> source = makeSamples(length);
+        std::vector<float> target(length);
+        SignalLevels levels;
+        copyArrayWithLevels(source.data(), target.data(), length, levels);
+        return target;
+    });
+}
+
+TEST(SoundRecordingUtilitiesTest, LevelsAgreeWithScalar) {
+
+    // The sums are added in a different order, so only the peak and clip count are exact.
+    std::vector<float> source(1021);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(-1.25f, 1.25f);
+    for (float &sample : source) sample = distribution(random);
+
+    const std::string original = getSimdImplementationName();
+    ASSERT_TRUE(setSimdImplementation("scalar"));
+    SignalLevels expected;
+    measureArrayLevels(source.data(), static_cast<int32_t>(source.size()), expected);
+    for (const char *name : kSimdImplementations) {
+        if (!setSimdImplementation(name)) continue;
+        SCOPED_TRACE(name);
+        SignalLevels actual;
+        measureArrayLevels(source.data(), static_cast<int32_t>(source.size()), actual);
+        EXPECT_EQ(expected.peak, actual.peak);
+        EXPECT_EQ(expected.clipCount, actual.clipCount);
+        EXPECT_EQ(expected.numSamples, actual.numSamples);
+        EXPECT_NEAR(expected.sumOfSquares, actual.sumOfSquares, expected.sumOfSquares * 1e-5f);
+    }
+    setSimdImplementation(original.c_str());
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "SampleBlockPool.h"
+#include "TrackMixer.h"
+
+namespace {
+
+constexpr int32_t kLoopFrames = 1000;
+
+class TrackMixerTest : public ::testing::Test {
+
+protected:
+    SampleBlockPool mBlockPool;
+    TrackMixer mMixer { mBlockPool };
+
+    void SetUp() override {
+        mBlockPool.reserve(16);
+        mMixer.setLooping(true);
+    }
+
+    // Record a take whose sample k is the loop position startPosition + k, as if it had been
+    // played in time with a loop whose samples hold their own positions.
+    Track *recordTake(int32_t startPosition, int32_t numFrames) {
+        Track *take = mMixer.prepareTake();
+        if (take == nullptr) return nullptr;
+        std::vector<float> samples(numFrames);
+        for (int32_t k = 0; k < numFrames; ++k) {
+            samples[k] = static_cast<float>((startPosition + k) % kLoopFrames);
+        }
+        take->getRecording().write(samples.data(), numFrames);
+        return take;
+    }
+
+    std::vector<float> render(int32_t numFrames) {
+        mMixer.applyRequestedTracks();
+        std::vector<float> output(numFrames);
+        mMixer.render<1>(output.data(), numFrames);
+        return output;
+    }
+
+    // A take recorded over a whole loop while the others play, then added.
+    Track *overdubTake() {
+        Track *take = recordTake(0, kLoopFrames);
+        render(kLoopFrames);
+        mMixer.addTake();
+        return take;
+    }
+
+    void expectInTime(int32_t trackCount) {
+        expectInTime(render(kLoopFrames), trackCount);
+    }
+
+    // Each track is in time with the loop if every frame is the loop position times the count.
+    static void expectInTime(const std::vector<float> &output, int32_t trackCount) {
+        const float first = output[0] / trackCount;
+        for (int32_t i = 0; i < kLoopFrames; ++i) {
+            ASSERT_EQ(trackCount * static_cast<float>((static_cast<int32_t>(first) + i) %
+                                                      kLoopFrames), output[i])
+                    << "at frame " << i;
+        }
+    }
+};
+
+} // namespace
+
+TEST_F(TrackMixerTest, TakeStartedPartWayRoundLoopStaysInTime) {
+
+    recordTake(0, kLoopFrames);
+    mMixer.addTake();
+    render(300);
+
+    // A loop's worth of overdub, started at position 300 and published when it ends.
+    recordTake(300, kLoopFrames);
+    render(kLoopFrames);
+    mMixer.addTake();
+    expectInTime(2);
+
+    // Playing from the start again keeps the take's place in the loop.
+    mMixer.setReadPositionToStart();
+    const std::vector<float> output = render(1);
+    EXPECT_EQ(0.0f, output[0]);
+    expectInTime(2);
+}
+
+TEST_F(TrackMixerTest, FirstTakeStartsFromItsBeginning) {
+    recordTake(0, kLoopFrames);
+    mMixer.addTake();
+    EXPECT_EQ(0.0f, render(1)[0]);
+    EXPECT_EQ(1, mMixer.getTrackCount());
+}
+
+TEST_F(TrackMixerTest, UndoAndRedoSwitchBetweenTakes) {
+
+    overdubTake();
+    overdubTake();
+    expectInTime(2);
+
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_EQ(1, mMixer.getTrackCount());
+    expectInTime(1);
+    TakeHistoryState state = mMixer.getHistoryState();
+    EXPECT_EQ(1, state.undoCount);
+    EXPECT_EQ(1, state.redoCount);
+
+    EXPECT_TRUE(mMixer.redo());
+    EXPECT_EQ(2, mMixer.getTrackCount());
+    expectInTime(2);
+    EXPECT_FALSE(mMixer.redo());
+
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_FALSE(mMixer.undo());
+    EXPECT_EQ(0, mMixer.getTrackCount());
+}
+
+TEST_F(TrackMixerTest, NewTakeReplacesWhatCouldBeRedone) {
+
+    overdubTake();
+    overdubTake();
+    EXPECT_TRUE(mMixer.undo());
+
+    // Nothing can be undone while a take is in progress.
+    Track *take = recordTake(0, kLoopFrames);
+    EXPECT_FALSE(mMixer.undo());
+    EXPECT_FALSE(mMixer.redo());
+    EXPECT_FALSE(mMixer.clear());
+
+    render(kLoopFrames);
+    mMixer.addTake();
+    EXPECT_FALSE(mMixer.redo());
+    EXPECT_EQ(2, mMixer.getTrackCount());
+    EXPECT_EQ(take, mMixer.getTrack(1));
+    expectInTime(2);
+}
+
+TEST_F(TrackMixerTest, UndoClearRedoKeepsTracksStillBeingMixed) {
+
+    overdubTake();
+    overdubTake();
+    expectInTime(2);
+
+    // The callback hasn't caught up with the undo or the clear, and the clear has dropped the
+    // list it's still mixing from the history.
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_TRUE(mMixer.clear());
+    EXPECT_FALSE(mMixer.redo());
+    EXPECT_EQ(0, mMixer.getHistoryState().redoCount);
+    mMixer.releaseUnusedTracks();
+    std::vector<float> output(kLoopFrames);
+    mMixer.render<1>(output.data(), kLoopFrames);
+    expectInTime(output, 2);
+
+    // Once it has caught up, the first take can still be brought back.
+    EXPECT_EQ(std::vector<float>(kLoopFrames, 0.0f), render(kLoopFrames));
+    mMixer.releaseUnusedTracks();
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_EQ(1, mMixer.getTrackCount());
+    expectInTime(1);
+}
+
+TEST_F(TrackMixerTest, CurrentTakeIsPreparedTakeThenNewestTrack) {
+
+    EXPECT_EQ(nullptr, mMixer.getCurrentTake());
+    Track *first = overdubTake();
+    EXPECT_EQ(first, mMixer.getCurrentTake());
+
+    Track *second = mMixer.prepareTake();
+    EXPECT_EQ(second, mMixer.getCurrentTake());
+    mMixer.cancelTake();
+    EXPECT_EQ(first, mMixer.getCurrentTake());
+
+    EXPECT_TRUE(mMixer.clear());
+    EXPECT_EQ(nullptr, mMixer.getCurrentTake());
+}
+
+TEST_F(TrackMixerTest, HistoryOverBudgetLosesOldestTakesFirst) {
+
+    // Each take fills one block, so the budget holds three of them. Clearing between takes leaves
+    // each take in its own step, so dropping a step drops its take.
+    mMixer.setHistoryBudget(3 * kBlockSizeInBytes);
+    std::vector<Track *> takes;
+    for (int32_t i = 0; i < 5; ++i) {
+        if (i > 0) EXPECT_TRUE(mMixer.clear());
+        takes.push_back(overdubTake());
+    }
+
+    // Only the steps from the clear after the second take onwards are left.
+    TakeHistoryState state = mMixer.getHistoryState();
+    EXPECT_EQ(3 * kBlockSizeInBytes, state.historyBytes);
+    EXPECT_EQ(5, state.undoCount);
+    EXPECT_EQ(0, state.redoCount);
+    EXPECT_EQ(takes[4], mMixer.getCurrentTake());
+
+    for (int32_t i = 3; i >= 2; --i) {
+        EXPECT_TRUE(mMixer.undo());
+        EXPECT_EQ(0, mMixer.getTrackCount());
+        EXPECT_TRUE(mMixer.undo());
+        EXPECT_EQ(1, mMixer.getTrackCount());
+        EXPECT_EQ(takes[i], mMixer.getCurrentTake());
+        expectInTime(1);
+    }
+    EXPECT_TRUE(mMixer.undo());
+    EXPECT_EQ(0, mMixer.getTrackCount());
+    EXPECT_FALSE(mMixer.undo());
+}